@@ -0,0 +1,331 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <glm/glm.hpp>
+
+#include "Frustum.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Default BVH values
+const unsigned int BVH_LEAF_SIZE = 2;  // items a leaf may hold before it is considered for a split
+const unsigned int BVH_BINS = 16;      // candidate split planes per axis
+const unsigned int BVH_MAX_DEPTH = 64; // traversal stack
+
+// 32 bytes, two to a cache line. Children of an interior node are stored next to each other.
+struct BVHNode {
+    glm::vec3 Min;
+    unsigned int LeftFirst; // left child for interior nodes, first entry of Items for leaves
+    glm::vec3 Max;
+    unsigned int Count;     // items in a leaf, 0 for interior nodes
+};
+
+// A bounding volume hierarchy over a set of boxes (the meshes of a model), built with the binned
+// surface area heuristic and kept as one flat node array. Items are referred to by their index in
+// the arrays passed to Build().
+class BVH
+{
+public:
+    std::vector<BVHNode> Nodes;
+    std::vector<unsigned int> Items; // item indices, each leaf owns a contiguous run
+
+    void Build(const std::vector<glm::vec3>& mins, const std::vector<glm::vec3>& maxs)
+    {
+        boxMin = mins;
+        boxMax = maxs;
+        centroids.resize(mins.size());
+        Items.resize(mins.size());
+        for (unsigned int i = 0; i < mins.size(); i++)
+        {
+            centroids[i] = (mins[i] + maxs[i]) * 0.5f;
+            Items[i] = i;
+        }
+
+        Nodes.clear();
+        Nodes.reserve(2 * mins.size());
+        if (mins.empty())
+            return;
+        Nodes.push_back({ glm::vec3(0.0f), 0, glm::vec3(0.0f), (unsigned int)mins.size() });
+        updateBounds(0);
+        subdivide(0);
+    }
+
+    unsigned int ItemCount() const
+    {
+        return boxMin.size();
+    }
+
+    // visible[i] is set to 1 for every item whose box may be inside the frustum, returns how many
+    unsigned int CullFrustum(const Frustum& frustum, std::vector<unsigned char>& visible) const
+    {
+        visible.assign(ItemCount(), 0);
+        if (Nodes.empty())
+            return 0;
+        unsigned int inside = 0;
+        unsigned int stack[BVH_MAX_DEPTH];
+        unsigned int top = 0;
+        stack[top++] = 0;
+        while (top > 0)
+        {
+            unsigned int index = stack[--top];
+            const BVHNode& node = Nodes[index];
+            FrustumTest test = frustum.ClassifyAABB(node.Min, node.Max);
+            if (test == FRUSTUM_OUTSIDE)
+                continue;
+            if (test == FRUSTUM_INSIDE)
+            {
+                // the whole subtree is visible, no more plane tests
+                inside += markSubtree(index, visible);
+                continue;
+            }
+            if (node.Count > 0)
+            {
+                for (unsigned int i = 0; i < node.Count; i++)
+                {
+                    unsigned int item = Items[node.LeftFirst + i];
+                    if (frustum.IntersectsAABB(boxMin[item], boxMax[item]))
+                    {
+                        visible[item] = 1;
+                        inside++;
+                    }
+                }
+                continue;
+            }
+            stack[top++] = node.LeftFirst;
+            stack[top++] = node.LeftFirst + 1;
+        }
+        return inside;
+    }
+
+    // nearest item box hit by the ray within maxDistance, false if there is none
+    bool Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, unsigned int& hitItem, float& hitDistance) const
+    {
+        if (Nodes.empty())
+            return false;
+        glm::vec3 inverse = glm::vec3(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+        hitDistance = maxDistance;
+        bool hit = false;
+        unsigned int stack[BVH_MAX_DEPTH];
+        unsigned int top = 0;
+        if (rayBox(origin, inverse, Nodes[0].Min, Nodes[0].Max, hitDistance) < hitDistance)
+            stack[top++] = 0;
+        while (top > 0)
+        {
+            const BVHNode& node = Nodes[stack[--top]];
+            if (node.Count > 0)
+            {
+                for (unsigned int i = 0; i < node.Count; i++)
+                {
+                    unsigned int item = Items[node.LeftFirst + i];
+                    float distance = rayBox(origin, inverse, boxMin[item], boxMax[item], hitDistance);
+                    if (distance < hitDistance)
+                    {
+                        hitDistance = distance;
+                        hitItem = item;
+                        hit = true;
+                    }
+                }
+                continue;
+            }
+            // push the further child first so the nearer one is visited first and shrinks hitDistance
+            unsigned int nearChild = node.LeftFirst, farChild = node.LeftFirst + 1;
+            float nearDistance = rayBox(origin, inverse, Nodes[nearChild].Min, Nodes[nearChild].Max, hitDistance);
+            float farDistance = rayBox(origin, inverse, Nodes[farChild].Min, Nodes[farChild].Max, hitDistance);
+            if (farDistance < nearDistance)
+            {
+                std::swap(nearChild, farChild);
+                std::swap(nearDistance, farDistance);
+            }
+            if (farDistance < hitDistance)
+                stack[top++] = farChild;
+            if (nearDistance < hitDistance)
+                stack[top++] = nearChild;
+        }
+        return hit;
+    }
+
+    // every item whose box touches the sphere
+    void OverlapSphere(const glm::vec3& center, float radius, std::vector<unsigned int>& result) const
+    {
+        result.clear();
+        if (Nodes.empty())
+            return;
+        unsigned int stack[BVH_MAX_DEPTH];
+        unsigned int top = 0;
+        stack[top++] = 0;
+        while (top > 0)
+        {
+            const BVHNode& node = Nodes[stack[--top]];
+            if (!sphereBox(center, radius, node.Min, node.Max))
+                continue;
+            if (node.Count > 0)
+            {
+                for (unsigned int i = 0; i < node.Count; i++)
+                {
+                    unsigned int item = Items[node.LeftFirst + i];
+                    if (sphereBox(center, radius, boxMin[item], boxMax[item]))
+                        result.push_back(item);
+                }
+                continue;
+            }
+            stack[top++] = node.LeftFirst;
+            stack[top++] = node.LeftFirst + 1;
+        }
+    }
+
+private:
+    std::vector<glm::vec3> boxMin, boxMax, centroids;
+
+    static float area(const glm::vec3& min, const glm::vec3& max)
+    {
+        glm::vec3 e = max - min;
+        return e.x * e.y + e.y * e.z + e.z * e.x;
+    }
+
+    void updateBounds(unsigned int index)
+    {
+        BVHNode& node = Nodes[index];
+        node.Min = glm::vec3(1e30f);
+        node.Max = glm::vec3(-1e30f);
+        for (unsigned int i = 0; i < node.Count; i++)
+        {
+            unsigned int item = Items[node.LeftFirst + i];
+            node.Min = glm::min(node.Min, boxMin[item]);
+            node.Max = glm::max(node.Max, boxMax[item]);
+        }
+    }
+
+    void subdivide(unsigned int index, unsigned int depth = 1)
+    {
+        // the traversal stack holds at most one entry per level
+        if (Nodes[index].Count <= BVH_LEAF_SIZE || depth >= BVH_MAX_DEPTH / 2)
+            return;
+        unsigned int first = Nodes[index].LeftFirst, count = Nodes[index].Count;
+
+        // bounds of the centroids, the bins are spread over these
+        glm::vec3 centroidMin = glm::vec3(1e30f), centroidMax = glm::vec3(-1e30f);
+        for (unsigned int i = 0; i < count; i++)
+        {
+            centroidMin = glm::min(centroidMin, centroids[Items[first + i]]);
+            centroidMax = glm::max(centroidMax, centroids[Items[first + i]]);
+        }
+
+        // cheapest split over every axis and bin boundary, cost is area x items on each side
+        float bestCost = area(Nodes[index].Min, Nodes[index].Max) * count;
+        int bestAxis = -1;
+        unsigned int bestSplit = 0;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float extent = centroidMax[axis] - centroidMin[axis];
+            if (extent <= 0.0f)
+                continue;
+            glm::vec3 binMin[BVH_BINS], binMax[BVH_BINS];
+            unsigned int binCount[BVH_BINS] = {};
+            for (unsigned int b = 0; b < BVH_BINS; b++)
+            {
+                binMin[b] = glm::vec3(1e30f);
+                binMax[b] = glm::vec3(-1e30f);
+            }
+            float scale = BVH_BINS / extent;
+            for (unsigned int i = 0; i < count; i++)
+            {
+                unsigned int item = Items[first + i];
+                unsigned int b = std::min(BVH_BINS - 1, (unsigned int)((centroids[item][axis] - centroidMin[axis]) * scale));
+                binCount[b]++;
+                binMin[b] = glm::min(binMin[b], boxMin[item]);
+                binMax[b] = glm::max(binMax[b], boxMax[item]);
+            }
+
+            // sweep from both ends so every split's cost is known in two passes
+            float leftArea[BVH_BINS - 1], rightArea[BVH_BINS - 1];
+            unsigned int leftCount[BVH_BINS - 1], rightCount[BVH_BINS - 1];
+            glm::vec3 leftMin = glm::vec3(1e30f), leftMax = glm::vec3(-1e30f);
+            glm::vec3 rightMin = glm::vec3(1e30f), rightMax = glm::vec3(-1e30f);
+            unsigned int leftSum = 0, rightSum = 0;
+            for (unsigned int b = 0; b < BVH_BINS - 1; b++)
+            {
+                leftSum += binCount[b];
+                leftCount[b] = leftSum;
+                leftMin = glm::min(leftMin, binMin[b]);
+                leftMax = glm::max(leftMax, binMax[b]);
+                leftArea[b] = leftSum > 0 ? area(leftMin, leftMax) : 0.0f;
+
+                unsigned int r = BVH_BINS - 1 - b;
+                rightSum += binCount[r];
+                rightCount[r - 1] = rightSum;
+                rightMin = glm::min(rightMin, binMin[r]);
+                rightMax = glm::max(rightMax, binMax[r]);
+                rightArea[r - 1] = rightSum > 0 ? area(rightMin, rightMax) : 0.0f;
+            }
+            for (unsigned int b = 0; b < BVH_BINS - 1; b++)
+            {
+                float cost = leftArea[b] * leftCount[b] + rightArea[b] * rightCount[b];
+                if (leftCount[b] > 0 && rightCount[b] > 0 && cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = b;
+                }
+            }
+        }
+        // splitting doesn't pay off
+        if (bestAxis < 0)
+            return;
+
+        // partition the items in place around the chosen bin boundary
+        float scale = BVH_BINS / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+        unsigned int i = first, j = first + count - 1;
+        while (i <= j && j != (unsigned int)-1)
+        {
+            unsigned int b = std::min(BVH_BINS - 1, (unsigned int)((centroids[Items[i]][bestAxis] - centroidMin[bestAxis]) * scale));
+            if (b <= bestSplit)
+                i++;
+            else
+                std::swap(Items[i], Items[j--]);
+        }
+        unsigned int leftCount = i - first;
+
+        unsigned int left = Nodes.size();
+        Nodes.push_back({ glm::vec3(0.0f), first, glm::vec3(0.0f), leftCount });
+        Nodes.push_back({ glm::vec3(0.0f), i, glm::vec3(0.0f), count - leftCount });
+        Nodes[index].LeftFirst = left;
+        Nodes[index].Count = 0;
+        updateBounds(left);
+        updateBounds(left + 1);
+        subdivide(left, depth + 1);
+        subdivide(left + 1, depth + 1);
+    }
+
+    unsigned int markSubtree(unsigned int index, std::vector<unsigned char>& visible) const
+    {
+        const BVHNode& node = Nodes[index];
+        if (node.Count == 0)
+            return markSubtree(node.LeftFirst, visible) + markSubtree(node.LeftFirst + 1, visible);
+        for (unsigned int i = 0; i < node.Count; i++)
+            visible[Items[node.LeftFirst + i]] = 1;
+        return node.Count;
+    }
+
+    // distance along the ray to the box (0 if the origin is inside), or maxDistance if it misses
+    static float rayBox(const glm::vec3& origin, const glm::vec3& inverse, const glm::vec3& min, const glm::vec3& max, float maxDistance)
+    {
+        float t1 = (min.x - origin.x) * inverse.x, t2 = (max.x - origin.x) * inverse.x;
+        float tmin = std::min(t1, t2), tmax = std::max(t1, t2);
+        t1 = (min.y - origin.y) * inverse.y; t2 = (max.y - origin.y) * inverse.y;
+        tmin = std::max(tmin, std::min(t1, t2)); tmax = std::min(tmax, std::max(t1, t2));
+        t1 = (min.z - origin.z) * inverse.z; t2 = (max.z - origin.z) * inverse.z;
+        tmin = std::max(tmin, std::min(t1, t2)); tmax = std::min(tmax, std::max(t1, t2));
+        if (tmax < std::max(tmin, 0.0f) || tmin >= maxDistance)
+            return maxDistance;
+        return std::max(tmin, 0.0f);
+    }
+
+    static bool sphereBox(const glm::vec3& center, float radius, const glm::vec3& min, const glm::vec3& max)
+    {
+        glm::vec3 d = center - glm::max(min, glm::min(center, max));
+        return glm::dot(d, d) <= radius * radius;
+    }
+};
+#endif
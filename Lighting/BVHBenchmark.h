@@ -0,0 +1,115 @@
+#ifndef BVH_BENCHMARK_H
+#define BVH_BENCHMARK_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "BVH.h"
+#include "Frustum.h"
+#include "Model.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+// Default benchmark values
+const unsigned int BVH_BENCH_BUILDS = 100;
+const unsigned int BVH_BENCH_FRUSTA = 20000;
+const unsigned int BVH_BENCH_RAYS = 200000;
+const unsigned int BVH_BENCH_SPHERES = 200000;
+
+// CPU timings of the model's BVH (run with --bvh-benchmark): build time, then frustum culling from
+// random cameras inside the scene against the flat SIMD test of every mesh, ray casts and sphere
+// overlap queries sized like the point lights.
+inline void RunBVHBenchmark(Model& model, const glm::mat4& transform)
+{
+    typedef std::chrono::high_resolution_clock Clock;
+    std::srand(1);
+
+    model.UpdateBounds(transform);
+    const BVH& tree = model.Tree;
+    if (tree.Nodes.empty())
+    {
+        std::cout << "BVH benchmark: the model has no meshes" << std::endl;
+        return;
+    }
+    glm::vec3 sceneMin = tree.Nodes[0].Min, sceneMax = tree.Nodes[0].Max;
+    glm::vec3 sceneSize = sceneMax - sceneMin;
+    // random point inside the scene bounds, and a random unit direction
+    auto randomPoint = [&]() {
+        return sceneMin + sceneSize * glm::vec3(std::rand() / (float)RAND_MAX, std::rand() / (float)RAND_MAX, std::rand() / (float)RAND_MAX);
+    };
+    auto randomDirection = [&]() {
+        glm::vec3 d;
+        do
+            d = glm::vec3(std::rand() / (float)RAND_MAX, std::rand() / (float)RAND_MAX, std::rand() / (float)RAND_MAX) * 2.0f - 1.0f;
+        while (glm::dot(d, d) < 0.01f || glm::dot(d, d) > 1.0f);
+        return glm::normalize(d);
+    };
+
+    // build
+    std::vector<glm::vec3> mins(model.meshes.size()), maxs(model.meshes.size());
+    for (unsigned int i = 0; i < model.meshes.size(); i++)
+        TransformAABB(transform, model.meshes[i].AABBMin, model.meshes[i].AABBMax, mins[i], maxs[i]);
+    BVH scratch;
+    Clock::time_point start = Clock::now();
+    for (unsigned int i = 0; i < BVH_BENCH_BUILDS; i++)
+        scratch.Build(mins, maxs);
+    double buildMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / BVH_BENCH_BUILDS;
+    std::cout << "BVH: " << model.meshes.size() << " meshes, " << tree.Nodes.size() << " nodes, built in " << buildMs << " ms" << std::endl;
+
+    // frustum culling, the same cameras through the tree and through the flat test
+    std::vector<Frustum> frusta;
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, glm::length(sceneSize));
+    for (unsigned int i = 0; i < BVH_BENCH_FRUSTA; i++)
+    {
+        glm::vec3 eye = randomPoint();
+        frusta.push_back(Frustum(projection * glm::lookAt(eye, eye + randomDirection(), glm::vec3(0.0f, 1.0f, 0.0f))));
+    }
+    std::vector<unsigned char> visible;
+    unsigned long long treeVisible = 0, flatVisible = 0;
+    start = Clock::now();
+    for (unsigned int i = 0; i < frusta.size(); i++)
+        treeVisible += tree.CullFrustum(frusta[i], visible);
+    double treeUs = std::chrono::duration<double, std::micro>(Clock::now() - start).count() / frusta.size();
+    start = Clock::now();
+    for (unsigned int i = 0; i < frusta.size(); i++)
+        flatVisible += frusta[i].CullBatch(model.WorldBounds, visible);
+    double flatUs = std::chrono::duration<double, std::micro>(Clock::now() - start).count() / frusta.size();
+    std::cout << "Frustum culling: BVH " << treeUs << " us/query (" << treeVisible / frusta.size() << " visible), flat SIMD "
+        << flatUs << " us/query (" << flatVisible / frusta.size() << " visible)" << std::endl;
+
+    // ray casts against the mesh boxes
+    std::vector<glm::vec3> origins, directions;
+    for (unsigned int i = 0; i < BVH_BENCH_RAYS; i++)
+    {
+        origins.push_back(randomPoint());
+        directions.push_back(randomDirection());
+    }
+    unsigned int hits = 0;
+    start = Clock::now();
+    for (unsigned int i = 0; i < origins.size(); i++)
+    {
+        unsigned int item;
+        float distance;
+        hits += tree.Raycast(origins[i], directions[i], 1e30f, item, distance) ? 1 : 0;
+    }
+    double raySeconds = std::chrono::duration<double>(Clock::now() - start).count();
+    std::cout << "Ray casts: " << origins.size() / raySeconds / 1.0e6 << " M rays/s (" << 100.0 * hits / origins.size() << "% hit)" << std::endl;
+
+    // sphere overlaps, a twentieth of the scene across like a point light's radius
+    std::vector<unsigned int> overlapping;
+    unsigned long long overlaps = 0;
+    float radius = glm::length(sceneSize) * 0.05f;
+    start = Clock::now();
+    for (unsigned int i = 0; i < BVH_BENCH_SPHERES; i++)
+    {
+        tree.OverlapSphere(origins[i % origins.size()], radius, overlapping);
+        overlaps += overlapping.size();
+    }
+    double sphereSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+    std::cout << "Sphere overlaps: " << BVH_BENCH_SPHERES / sphereSeconds / 1.0e6 << " M queries/s (" << overlaps / BVH_BENCH_SPHERES
+        << " meshes each)" << std::endl;
+}
+#endif
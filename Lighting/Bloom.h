@@ -0,0 +1,76 @@
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include <glad/glad.h>
+
+#include "RenderGraph.h"
+#include "Shader.h"
+
+#include <string>
+#include <vector>
+
+// Default bloom values
+const unsigned int BLOOM_MIPS = 5;          // half resolution down to 1/32
+const float BLOOM_THRESHOLD = 1.0f;         // only HDR values above this bloom
+const float BLOOM_FILTER_RADIUS = 0.005f;   // tent radius of the upsample, in UV
+
+// Bloom as a chain of progressively smaller targets: each level is a 13-tap downsample of the one
+// above it, then the levels are tent-filtered back up and added together. Every pass touches a
+// quarter of the pixels of the one before, so the chain is far cheaper than blurring at full
+// resolution while reaching a much wider radius.
+class Bloom
+{
+public:
+    std::vector<RenderGraph::Resource> Mips;
+
+    // declares the downsample and upsample passes, returns the half resolution result
+    RenderGraph::Resource AddPasses(RenderGraph& graph, RenderGraph::Resource hdr, unsigned int width, unsigned int height,
+        Shader& downsampleShader, Shader& upsampleShader, unsigned int quadVAO)
+    {
+        Mips.clear();
+        for (unsigned int i = 0; i < BLOOM_MIPS; i++)
+        {
+            width = width / 2 > 0 ? width / 2 : 1;
+            height = height / 2 > 0 ? height / 2 : 1;
+            // 4 bytes per pixel, bloom doesn't need alpha or 16-bit precision
+            RGTextureDesc desc = { width, height, GL_R11F_G11F_B10F, GL_RGB, GL_FLOAT, GL_LINEAR };
+            Mips.push_back(graph.CreateTexture("bloomMip" + std::to_string(i), desc));
+        }
+
+        // downsample, the first pass also drops everything below the threshold
+        for (unsigned int i = 0; i < Mips.size(); i++)
+        {
+            RenderGraph::Resource source = i == 0 ? hdr : Mips[i - 1];
+            graph.AddPass("bloom down " + std::to_string(i), { source }, { Mips[i] }, [&graph, &downsampleShader, source, i, quadVAO]() {
+                downsampleShader.use();
+                downsampleShader.setInt("srcTexture", 0);
+                downsampleShader.setFloat("threshold", BLOOM_THRESHOLD);
+                downsampleShader.setBool("prefilter", i == 0);
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_2D, graph.GetTexture(source));
+                glBindVertexArray(quadVAO);
+                glDrawArrays(GL_TRIANGLES, 0, 6);
+            });
+        }
+
+        // upsample, adding each level onto the next larger one
+        for (unsigned int i = Mips.size() - 1; i > 0; i--)
+        {
+            RenderGraph::Resource source = Mips[i];
+            graph.AddPass("bloom up " + std::to_string(i), { source, Mips[i - 1] }, { Mips[i - 1] }, [&graph, &upsampleShader, source, quadVAO]() {
+                upsampleShader.use();
+                upsampleShader.setInt("srcTexture", 0);
+                upsampleShader.setFloat("filterRadius", BLOOM_FILTER_RADIUS);
+                glEnable(GL_BLEND);
+                glBlendFunc(GL_ONE, GL_ONE);
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_2D, graph.GetTexture(source));
+                glBindVertexArray(quadVAO);
+                glDrawArrays(GL_TRIANGLES, 0, 6);
+                glDisable(GL_BLEND);
+            });
+        }
+        return Mips[0];
+    }
+};
+#endif
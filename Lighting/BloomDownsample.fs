@@ -0,0 +1,76 @@
+#version 330 core
+out vec3 FragColor;
+
+in vec2 TexCoord;
+
+uniform sampler2D srcTexture;
+// the first downsample also applies the threshold and a Karis average against fireflies
+uniform bool prefilter;
+uniform float threshold;
+
+float KarisWeight(vec3 c) {
+	float luma = dot(c, vec3(0.2126, 0.7152, 0.0722));
+	return 1.0 / (1.0 + luma);
+}
+
+// soft knee so pixels don't pop in as they cross the threshold
+vec3 Threshold(vec3 c) {
+	float brightness = max(c.r, max(c.g, c.b));
+	float knee = threshold * 0.5;
+	float soft = clamp(brightness - threshold + knee, 0.0, 2.0 * knee);
+	soft = soft * soft / (4.0 * knee + 0.00001);
+	float contribution = max(soft, brightness - threshold) / max(brightness, 0.00001);
+	return c * contribution;
+}
+
+void main() {
+	vec2 texel = 1.0 / vec2(textureSize(srcTexture, 0));
+	float x = texel.x;
+	float y = texel.y;
+
+	// 13 taps, a - b - c
+	//           - j - k -
+	//          d - e - f
+	//           - l - m -
+	//          g - h - i
+	vec3 a = texture(srcTexture, TexCoord + vec2(-2.0 * x, 2.0 * y)).rgb;
+	vec3 b = texture(srcTexture, TexCoord + vec2(0.0, 2.0 * y)).rgb;
+	vec3 c = texture(srcTexture, TexCoord + vec2(2.0 * x, 2.0 * y)).rgb;
+	vec3 d = texture(srcTexture, TexCoord + vec2(-2.0 * x, 0.0)).rgb;
+	vec3 e = texture(srcTexture, TexCoord).rgb;
+	vec3 f = texture(srcTexture, TexCoord + vec2(2.0 * x, 0.0)).rgb;
+	vec3 g = texture(srcTexture, TexCoord + vec2(-2.0 * x, -2.0 * y)).rgb;
+	vec3 h = texture(srcTexture, TexCoord + vec2(0.0, -2.0 * y)).rgb;
+	vec3 i = texture(srcTexture, TexCoord + vec2(2.0 * x, -2.0 * y)).rgb;
+	vec3 j = texture(srcTexture, TexCoord + vec2(-x, y)).rgb;
+	vec3 k = texture(srcTexture, TexCoord + vec2(x, y)).rgb;
+	vec3 l = texture(srcTexture, TexCoord + vec2(-x, -y)).rgb;
+	vec3 m = texture(srcTexture, TexCoord + vec2(x, -y)).rgb;
+
+	vec3 result;
+	if (prefilter) {
+		// five overlapping boxes, each weighted by its inverse luma
+		vec3 groups[5];
+		groups[0] = (a + b + d + e) * 0.25;
+		groups[1] = (b + c + e + f) * 0.25;
+		groups[2] = (d + e + g + h) * 0.25;
+		groups[3] = (e + f + h + i) * 0.25;
+		groups[4] = (j + k + l + m) * 0.25;
+		float weights[5] = float[](0.125, 0.125, 0.125, 0.125, 0.5);
+		float total = 0.0;
+		result = vec3(0.0);
+		for (int n = 0; n < 5; n++) {
+			float w = weights[n] * KarisWeight(groups[n]);
+			result += groups[n] * w;
+			total += w;
+		}
+		result = Threshold(result / total);
+	}
+	else {
+		result = e * 0.125;
+		result += (a + c + g + i) * 0.03125;
+		result += (b + d + f + h) * 0.0625;
+		result += (j + k + l + m) * 0.125;
+	}
+	FragColor = max(result, vec3(0.0001));
+}
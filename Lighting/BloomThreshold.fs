@@ -0,0 +1,14 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoord;
+
+// bright pass for the full resolution Gaussian bloom
+uniform sampler2D image;
+uniform float threshold;
+
+void main() {
+	vec3 color = texture(image, TexCoord).rgb;
+	float brightness = max(color.r, max(color.g, color.b));
+	FragColor = vec4(brightness > threshold ? color : vec3(0.0), 1.0);
+}
@@ -0,0 +1,20 @@
+#version 330 core
+out vec3 FragColor;
+
+in vec2 TexCoord;
+
+uniform sampler2D srcTexture;
+uniform float filterRadius;
+
+void main() {
+	// 3x3 tent, added onto the larger level by blending
+	float x = filterRadius;
+	float y = filterRadius;
+
+	vec3 result = texture(srcTexture, TexCoord).rgb * 4.0;
+	result += (texture(srcTexture, TexCoord + vec2(0.0, y)).rgb + texture(srcTexture, TexCoord - vec2(0.0, y)).rgb
+		+ texture(srcTexture, TexCoord + vec2(x, 0.0)).rgb + texture(srcTexture, TexCoord - vec2(x, 0.0)).rgb) * 2.0;
+	result += texture(srcTexture, TexCoord + vec2(x, y)).rgb + texture(srcTexture, TexCoord + vec2(-x, y)).rgb
+		+ texture(srcTexture, TexCoord + vec2(x, -y)).rgb + texture(srcTexture, TexCoord + vec2(-x, -y)).rgb;
+	FragColor = result / 16.0;
+}
@@ -5,6 +5,8 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "Frustum.h"
+
 #include <vector>
 
 // Defines several possible options for camera movement. Used as abstraction to stay away from window-system specific input methods
@@ -68,6 +70,18 @@ public:
         return glm::lookAt(Position, Position + Front, Up);
     }
 
+    // returns the perspective projection for the camera's current zoom between the given planes
+    glm::mat4 GetProjectionMatrix(float aspect, float nearPlane, float farPlane)
+    {
+        return glm::perspective(glm::radians(Zoom), aspect, nearPlane, farPlane);
+    }
+
+    // the six planes of the camera's view volume in world space
+    Frustum GetFrustum(float aspect, float nearPlane, float farPlane)
+    {
+        return Frustum(GetProjectionMatrix(aspect, nearPlane, farPlane) * GetViewMatrix());
+    }
+
     // processes input received from any keyboard-like input system. Accepts input parameter in the form of camera defined ENUM (to abstract it from windowing systems)
     void ProcessKeyboard(Camera_Movement direction, float deltaTime)
     {
@@ -108,6 +122,14 @@ public:
         updateCameraVectors();
     }
 
+    // sets the Euler angles directly, as a recorded camera path does
+    void SetOrientation(float yaw, float pitch)
+    {
+        Yaw = yaw;
+        Pitch = pitch;
+        updateCameraVectors();
+    }
+
     // processes input received from a mouse scroll-wheel event. Only requires input on the vertical wheel-axis
     void ProcessMouseScroll(float yoffset)
     {
@@ -0,0 +1,99 @@
+#ifndef CAMERA_PATH_H
+#define CAMERA_PATH_H
+
+#include "Camera.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Default camera path values
+const float CAMERA_PATH_STEP = 1.0f / 60.0f; // seconds between replayed frames
+
+// the camera's state at a point of a recorded fly-through, seconds from the start of the recording
+struct CameraKey {
+    float Time;
+    glm::vec3 Position;
+    float Yaw, Pitch, Zoom;
+};
+
+// A fly-through recorded from the interactive camera and replayed on a fixed timestep, so two runs
+// (or two builds) render exactly the same frames whatever their frame rate. Saved as text, one key
+// per line: time, position, yaw, pitch and zoom.
+class CameraPath
+{
+public:
+    std::vector<CameraKey> Keys;
+
+    // appends the camera's state, time is the caller's clock, the path starts at the first key
+    void Record(float time, const Camera& camera)
+    {
+        if (Keys.empty())
+            startTime = time;
+        Keys.push_back({ time - startTime, camera.Position, camera.Yaw, camera.Pitch, camera.Zoom });
+    }
+
+    bool Save(const std::string& path) const
+    {
+        std::ofstream file(path.c_str());
+        file << "# time x y z yaw pitch zoom" << std::endl;
+        for (unsigned int i = 0; i < Keys.size(); i++)
+        {
+            const CameraKey& key = Keys[i];
+            file << key.Time << " " << key.Position.x << " " << key.Position.y << " " << key.Position.z << " "
+                << key.Yaw << " " << key.Pitch << " " << key.Zoom << std::endl;
+        }
+        return file.good();
+    }
+
+    bool Load(const std::string& path)
+    {
+        std::ifstream file(path.c_str());
+        if (!file.is_open())
+            return false;
+        Keys.clear();
+        std::string line;
+        while (std::getline(file, line))
+        {
+            if (line.empty() || line[0] == '#')
+                continue;
+            std::istringstream fields(line);
+            CameraKey key;
+            if (fields >> key.Time >> key.Position.x >> key.Position.y >> key.Position.z >> key.Yaw >> key.Pitch >> key.Zoom)
+                Keys.push_back(key);
+        }
+        return !Keys.empty();
+    }
+
+    float Duration() const
+    {
+        return Keys.empty() ? 0.0f : Keys.back().Time;
+    }
+
+    // frames a replay renders, one every CAMERA_PATH_STEP including both ends
+    unsigned int Frames() const
+    {
+        return (unsigned int)(Duration() / CAMERA_PATH_STEP + 1e-3f) + 1;
+    }
+
+    // puts the camera where the path is at time, between two keys their states are blended linearly
+    void Apply(float time, Camera& camera) const
+    {
+        if (Keys.empty())
+            return;
+        unsigned int next = std::upper_bound(Keys.begin(), Keys.end(), time,
+            [](float t, const CameraKey& key) { return t < key.Time; }) - Keys.begin();
+        const CameraKey& a = Keys[next > 0 ? next - 1 : 0];
+        const CameraKey& b = Keys[std::min<unsigned int>(next, Keys.size() - 1)];
+        float t = b.Time > a.Time ? glm::clamp((time - a.Time) / (b.Time - a.Time), 0.0f, 1.0f) : 0.0f;
+        camera.Position = glm::mix(a.Position, b.Position, t);
+        camera.Zoom = glm::mix(a.Zoom, b.Zoom, t);
+        camera.SetOrientation(glm::mix(a.Yaw, b.Yaw, t), glm::mix(a.Pitch, b.Pitch, t));
+    }
+
+private:
+    float startTime = 0.0f;
+};
+#endif
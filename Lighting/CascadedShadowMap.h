@@ -0,0 +1,386 @@
+#ifndef CASCADED_SHADOW_MAP_H
+#define CASCADED_SHADOW_MAP_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "Camera.h"
+#include "Frustum.h"
+#include "Model.h"
+#include "Shader.h"
+#include "ShadowCaster.h"
+
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Default cascade values
+const unsigned int NR_CASCADES = 4;
+const float CASCADE_SPLIT_LAMBDA = 0.75f; // blend between logarithmic (1) and uniform (0) splits
+const float SHADOW_DISTANCE = 40.0f;      // cascades cover the view frustum up to here
+const float SHADOW_CASTER_DISTANCE = 50.0f; // how far behind a cascade casters are still caught
+const float CASCADE_SNAP_DIVISIONS = 16.0f; // cascades move in steps of 1/16 of their radius (1/32 of their width) so cached tiles stay valid
+const int SHADOW_MOMENT_LEVELS = 4;         // mips of the prefiltered maps, kept few so tiles don't bleed into each other
+
+// shadow filtering modes, see GenerateDirectionalShadow in DeferredLighting.fs
+enum ShadowFilter {
+    SHADOW_FILTER_PCF, // hardware compare, 4 rotated Poisson taps
+    SHADOW_FILTER_VSM, // variance shadow map, 1 tap
+    SHADOW_FILTER_ESM  // exponential shadow map, 1 tap
+};
+const char* const SHADOW_FILTER_NAMES[] = { "PCF", "VSM", "ESM" };
+
+// Directional light shadows as NR_CASCADES cascades fitted to slices of the camera frustum, packed
+// 2x2 into a single depth atlas. Each cascade is a bounding sphere of its slice so its size doesn't
+// change as the camera rotates, and its origin is snapped to whole texels so edges don't shimmer.
+//
+// Static casters are cached: a cascade's tile of the static atlas is only re-rendered when its light
+// matrix changes (the light moved or the camera left the snapped cell) or MarkStaticDirty() was called.
+// Dynamic casters are drawn each time they're marked dirty on top of a copy of the static atlas.
+//
+// With VSM or ESM filtering the changed tiles are converted to half resolution moments, blurred and
+// mipmapped once per shadow update by Prefilter(), so the lighting pass gets by with a single fetch.
+class CascadedShadowMap
+{
+public:
+    unsigned int FBO;        // static casters
+    unsigned int DepthAtlas;
+    unsigned int CompositeFBO = 0; // static + dynamic casters, only created once there are dynamic casters
+    unsigned int CompositeAtlas = 0;
+    bool Composited = false;       // the composite holds the current dynamic casters, otherwise there are none
+    unsigned int AtlasSize;
+    unsigned int CascadeSize;
+    unsigned int CascadesRendered = 0; // static tiles re-rendered by the last Render()
+    unsigned int MeshesDrawn = 0;      // by the last Render(), after culling against each cascade
+
+    glm::mat4 CascadeMatrices[NR_CASCADES];
+    float CascadeSplits[NR_CASCADES];   // view-space distance where each cascade ends
+    glm::vec4 CascadeRects[NR_CASCADES]; // atlas offset (xy) and scale (zw)
+    float CascadeTexelSizes[NR_CASCADES]; // world-space size of one shadow texel
+    float CascadeDepthRanges[NR_CASCADES];
+    bool StaticDirty[NR_CASCADES];
+    bool DynamicDirty = true;
+    bool MomentsDirty[NR_CASCADES];
+    ShadowFilter Filter = SHADOW_FILTER_PCF;
+    unsigned int MomentsFBO[2] = { 0, 0 }; // moments and the blur's intermediate target, created on first use
+    unsigned int MomentsAtlas[2] = { 0, 0 };
+
+    // atlasSize^2 32-bit depth, e.g. 4096 -> 64 MiB for four 2048^2 cascades
+    CascadedShadowMap(unsigned int atlasSize) : AtlasSize(atlasSize), CascadeSize(atlasSize / 2)
+    {
+        createAtlas(&FBO, &DepthAtlas);
+
+        for (unsigned int i = 0; i < NR_CASCADES; i++)
+        {
+            CascadeRects[i] = glm::vec4((i % 2) * 0.5f, (i / 2) * 0.5f, 0.5f, 0.5f);
+            CascadeMatrices[i] = glm::mat4(0.0f);
+            StaticDirty[i] = true;
+            MomentsDirty[i] = true;
+        }
+
+        // the atlas compares in hardware, this sampler reads the raw depth when building the moments
+        glGenSamplers(1, &rawDepthSampler);
+        glSamplerParameteri(rawDepthSampler, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glSamplerParameteri(rawDepthSampler, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glSamplerParameteri(rawDepthSampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glSamplerParameteri(rawDepthSampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glSamplerParameteri(rawDepthSampler, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+    }
+
+    void SetFilter(ShadowFilter filter)
+    {
+        Filter = filter;
+        for (unsigned int i = 0; i < NR_CASCADES; i++)
+            MomentsDirty[i] = true;
+    }
+
+    // call when static geometry changed, every cascade is re-rendered on the next Render()
+    void MarkStaticDirty()
+    {
+        for (unsigned int i = 0; i < NR_CASCADES; i++)
+            StaticDirty[i] = true;
+    }
+
+    // call when a dynamic caster moved
+    void MarkDynamicDirty()
+    {
+        DynamicDirty = true;
+    }
+
+    // the atlas the lighting pass should sample
+    unsigned int ShadowAtlas() const
+    {
+        return Composited ? CompositeAtlas : DepthAtlas;
+    }
+
+    // refits every cascade to the current camera, lightDir is the direction the light travels in
+    void Update(Camera& camera, float aspect, float nearPlane, float farPlane, const glm::vec3& lightDir)
+    {
+        float shadowFar = std::fmin(farPlane, SHADOW_DISTANCE);
+        glm::vec3 up = (std::fabs(lightDir.y) > 0.99f) ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        // the light's orientation never depends on the camera, only its bounds do
+        glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f), lightDir, up);
+        glm::mat4 view = camera.GetViewMatrix();
+
+        float sliceNear = nearPlane;
+        for (unsigned int i = 0; i < NR_CASCADES; i++)
+        {
+            // practical split scheme
+            float p = (float)(i + 1) / NR_CASCADES;
+            float logSplit = nearPlane * std::pow(shadowFar / nearPlane, p);
+            float uniformSplit = nearPlane + (shadowFar - nearPlane) * p;
+            float sliceFar = CASCADE_SPLIT_LAMBDA * logSplit + (1.0f - CASCADE_SPLIT_LAMBDA) * uniformSplit;
+            CascadeSplits[i] = sliceFar;
+
+            // world-space corners of the slice
+            glm::mat4 invSlice = glm::inverse(camera.GetProjectionMatrix(aspect, sliceNear, sliceFar) * view);
+            glm::vec3 corners[8];
+            glm::vec3 center = glm::vec3(0.0f);
+            for (unsigned int c = 0; c < 8; c++)
+            {
+                glm::vec4 corner = invSlice * glm::vec4((c & 1) ? 1.0f : -1.0f, (c & 2) ? 1.0f : -1.0f, (c & 4) ? 1.0f : -1.0f, 1.0f);
+                corners[c] = glm::vec3(corner) / corner.w;
+                center += corners[c];
+            }
+            center /= 8.0f;
+            float radius = 0.0f;
+            for (unsigned int c = 0; c < 8; c++)
+                radius = std::fmax(radius, glm::length(corners[c] - center));
+            // quantize the radius so rounding noise doesn't rescale the cascade from frame to frame
+            radius = std::ceil(radius * 16.0f) / 16.0f;
+            // grow the sphere so it still covers the slice from anywhere inside its snap cell
+            radius /= 1.0f - std::sqrt(3.0f) / CASCADE_SNAP_DIVISIONS;
+
+            // snap the centre to a coarse grid of whole texels in the light's view
+            float texelSize = 2.0f * radius / CascadeSize;
+            float snap = texelSize * std::floor(CascadeSize / (2.0f * CASCADE_SNAP_DIVISIONS));
+            glm::vec3 lightCenter = glm::vec3(lightView * glm::vec4(center, 1.0f));
+            lightCenter = glm::floor(lightCenter / snap) * snap;
+
+            // view space looks down -z, push the near plane back so casters outside the slice still land in the map
+            float nearDistance = -lightCenter.z - radius - SHADOW_CASTER_DISTANCE;
+            float farDistance = -lightCenter.z + radius;
+            glm::mat4 lightProjection = glm::ortho(lightCenter.x - radius, lightCenter.x + radius,
+                lightCenter.y - radius, lightCenter.y + radius, nearDistance, farDistance);
+
+            glm::mat4 cascadeMatrix = lightProjection * lightView;
+            if (cascadeMatrix != CascadeMatrices[i])
+                StaticDirty[i] = true;
+            CascadeMatrices[i] = cascadeMatrix;
+            CascadeTexelSizes[i] = texelSize;
+            CascadeDepthRanges[i] = farDistance - nearDistance;
+            sliceNear = sliceFar;
+        }
+    }
+
+    // re-renders the dirty static tiles, then composites the dynamic casters if they changed
+    void Render(const std::vector<ShadowCaster>& staticCasters, const std::vector<ShadowCaster>& dynamicCasters, Shader& depthShader)
+    {
+        depthShader.use();
+        CascadesRendered = 0;
+        MeshesDrawn = 0;
+
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glEnable(GL_SCISSOR_TEST);
+        for (unsigned int i = 0; i < NR_CASCADES; i++)
+        {
+            if (!StaticDirty[i])
+                continue;
+            renderCascade(i, staticCasters, depthShader, true);
+            StaticDirty[i] = false;
+            MomentsDirty[i] = true;
+            CascadesRendered++;
+        }
+
+        if (dynamicCasters.empty() && Composited)
+        {
+            // back to the static atlas, whose moments are older than the composite's
+            Composited = false;
+            for (unsigned int i = 0; i < NR_CASCADES; i++)
+                MomentsDirty[i] = true;
+        }
+        if (!dynamicCasters.empty() && (DynamicDirty || CascadesRendered > 0 || !Composited))
+        {
+            if (CompositeFBO == 0)
+                createAtlas(&CompositeFBO, &CompositeAtlas);
+            // start from the cached static depth and add the dynamic casters on top
+            glDisable(GL_SCISSOR_TEST);
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, CompositeFBO);
+            glBlitFramebuffer(0, 0, AtlasSize, AtlasSize, 0, 0, AtlasSize, AtlasSize, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+            glBindFramebuffer(GL_FRAMEBUFFER, CompositeFBO);
+            glEnable(GL_SCISSOR_TEST);
+            for (unsigned int i = 0; i < NR_CASCADES; i++)
+            {
+                renderCascade(i, dynamicCasters, depthShader, false);
+                MomentsDirty[i] = true;
+            }
+            DynamicDirty = false;
+            Composited = true;
+        }
+        glDisable(GL_SCISSOR_TEST);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // rebuilds the prefiltered moments of the cascades that changed, a no-op with PCF
+    void Prefilter(Shader& momentsShader, Shader& blurShader, unsigned int quadVAO)
+    {
+        if (Filter == SHADOW_FILTER_PCF)
+            return;
+        if (MomentsFBO[0] == 0)
+            createMoments();
+
+        unsigned int momentsSize = AtlasSize / 2;
+        unsigned int tileSize = momentsSize / 2;
+        bool changed = false;
+        glDisable(GL_DEPTH_TEST);
+        glBindVertexArray(quadVAO);
+        for (unsigned int i = 0; i < NR_CASCADES; i++)
+        {
+            if (!MomentsDirty[i])
+                continue;
+            glViewport((i % 2) * tileSize, (i / 2) * tileSize, tileSize, tileSize);
+
+            // depth to moments, averaging the 2x2 depth texels under each moment texel
+            glBindFramebuffer(GL_FRAMEBUFFER, MomentsFBO[0]);
+            momentsShader.use();
+            momentsShader.setInt("depthAtlas", 0);
+            momentsShader.setInt("shadowFilter", Filter);
+            momentsShader.setVec4("rect", CascadeRects[i]);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, ShadowAtlas());
+            glBindSampler(0, rawDepthSampler);
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+            glBindSampler(0, 0);
+
+            // separable blur, kept inside the tile
+            blurShader.use();
+            blurShader.setInt("image", 0);
+            blurShader.setVec4("rect", CascadeRects[i]);
+            glBindFramebuffer(GL_FRAMEBUFFER, MomentsFBO[1]);
+            glBindTexture(GL_TEXTURE_2D, MomentsAtlas[0]);
+            blurShader.setVec2("direction", 1.0f / momentsSize, 0.0f);
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+            glBindFramebuffer(GL_FRAMEBUFFER, MomentsFBO[0]);
+            glBindTexture(GL_TEXTURE_2D, MomentsAtlas[1]);
+            blurShader.setVec2("direction", 0.0f, 1.0f / momentsSize);
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+
+            MomentsDirty[i] = false;
+            changed = true;
+        }
+        if (changed)
+        {
+            glBindTexture(GL_TEXTURE_2D, MomentsAtlas[0]);
+            glGenerateMipmap(GL_TEXTURE_2D);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindVertexArray(0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glEnable(GL_DEPTH_TEST);
+    }
+
+    // binds the atlas and the moments to the given texture units and uploads the cascade parameters
+    void SetUniforms(Shader& shader, unsigned int unit, unsigned int momentsUnit)
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D, ShadowAtlas());
+        glActiveTexture(GL_TEXTURE0 + momentsUnit);
+        glBindTexture(GL_TEXTURE_2D, MomentsAtlas[0]);
+        glActiveTexture(GL_TEXTURE0);
+        shader.setInt("shadowMap", unit);
+        shader.setInt("shadowMoments", momentsUnit);
+        shader.setInt("shadowFilter", Filter);
+        for (unsigned int i = 0; i < NR_CASCADES; i++)
+        {
+            string index = "[" + std::to_string(i) + "]";
+            shader.setMat4("cascadeMatrices" + index, CascadeMatrices[i]);
+            shader.setFloat("cascadeSplits" + index, CascadeSplits[i]);
+            shader.setVec4("cascadeRects" + index, CascadeRects[i]);
+            // depth bias of about one and a half texels in the cascade's own depth units
+            shader.setFloat("cascadeBias" + index, 1.5f * CascadeTexelSizes[i] / CascadeDepthRanges[i]);
+            shader.setFloat("cascadeTexelSizes" + index, CascadeTexelSizes[i]);
+        }
+    }
+
+private:
+    unsigned int rawDepthSampler;
+
+    void createAtlas(unsigned int* fbo, unsigned int* atlas)
+    {
+        GpuMemoryScope tag(GPU_MEMORY_SHADOW);
+        glGenFramebuffers(1, fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, *fbo);
+
+        glGenTextures(1, atlas);
+        glBindTexture(GL_TEXTURE_2D, *atlas);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, AtlasSize, AtlasSize, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        // linear filtering with a compare mode gives a bilinear PCF tap per fetch through sampler2DShadow
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, *atlas, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::FRAMEBUFFER::Shadow atlas is not complete" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // half resolution RG32F, two moments for VSM or the exponential depth for ESM
+    void createMoments()
+    {
+        GpuMemoryScope tag(GPU_MEMORY_SHADOW);
+        unsigned int momentsSize = AtlasSize / 2;
+        glGenFramebuffers(2, MomentsFBO);
+        glGenTextures(2, MomentsAtlas);
+        for (unsigned int i = 0; i < 2; i++)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, MomentsFBO[i]);
+            glBindTexture(GL_TEXTURE_2D, MomentsAtlas[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, momentsSize, momentsSize, 0, GL_RG, GL_FLOAT, NULL);
+            // only the final moments are mipmapped, the blur's intermediate target is read at level 0
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, i == 0 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, i == 0 ? SHADOW_MOMENT_LEVELS : 0);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, MomentsAtlas[i], 0);
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+                std::cout << "ERROR::FRAMEBUFFER::Shadow moments are not complete" << std::endl;
+        }
+        glBindTexture(GL_TEXTURE_2D, MomentsAtlas[0]);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // draws the casters into cascade i's tile of the bound atlas
+    void renderCascade(unsigned int i, const std::vector<ShadowCaster>& casters, Shader& depthShader, bool clear)
+    {
+        glViewport((i % 2) * CascadeSize, (i / 2) * CascadeSize, CascadeSize, CascadeSize);
+        glScissor((i % 2) * CascadeSize, (i / 2) * CascadeSize, CascadeSize, CascadeSize);
+        if (clear)
+            glClear(GL_DEPTH_BUFFER_BIT);
+        depthShader.setMat4("lightSpaceMatrix", CascadeMatrices[i]);
+        // anything outside the cascade's box can't rasterize into its tile
+        Frustum cascadeFrustum(CascadeMatrices[i]);
+        for (unsigned int c = 0; c < casters.size(); c++)
+        {
+            depthShader.setMat4("model", casters[c].ModelMatrix);
+            casters[c].Caster->UpdateBounds(casters[c].ModelMatrix);
+            casters[c].Caster->DrawGeometry(cascadeFrustum);
+            MeshesDrawn += casters[c].Caster->MeshesDrawn;
+        }
+    }
+};
+#endif
@@ -3,21 +3,8 @@ out vec4 FragColor;
 
 in vec2 TexCoord;
 
-vec4 FragPosLightSpace;
-
-uniform sampler2D gPosition;
-uniform sampler2D gNormal;
-uniform sampler2D gAlbedoSpec;
-uniform mat4 lightSpaceMatrix;
-
-struct Light {
-	vec3 Position;
-	vec3 Color;
-
-	float Linear;
-    float Quadratic;
-};
-
+#include "GBuffer.glsl"
+#include "PointShadow.glsl"
 
 struct DirLight {
     vec3 direction;
@@ -26,56 +13,86 @@ struct DirLight {
 	vec3 diffuse;
 };
 
-const int NR_LIGHTS = 8;
-uniform Light lights[NR_LIGHTS];
+//the point lights LightSystem.h packs into the ring buffer, three texels each:
+//position and radius, colour and shadow slot, linear and quadratic attenuation
+uniform samplerBuffer lightData;
+uniform int lightOffset; //texel of this frame's first light
+uniform int lightCount;
 uniform vec3 viewPos;
+// point lights are accumulated separately by LightVolume.fs
+uniform bool lightVolumes;
+
+//cascaded shadow map, every cascade is a tile of the shadowMap atlas
+const int NR_CASCADES = 4;
+uniform sampler2DShadow shadowMap;
+// prefiltered VSM moments or ESM exponential depth, half resolution with the same tile layout
+uniform sampler2D shadowMoments;
+uniform int shadowFilter; // 0 PCF, 1 VSM, 2 ESM
+uniform mat4 cascadeMatrices[NR_CASCADES];
+uniform float cascadeSplits[NR_CASCADES];
+uniform vec4 cascadeRects[NR_CASCADES];
+uniform float cascadeBias[NR_CASCADES];
+uniform float cascadeTexelSizes[NR_CASCADES];
+uniform mat4 view;
 
-uniform sampler2D shadowMap;
 uniform DirLight dirlight;
 uniform float far_plane;
 
 float bias = 0.0;
 
 vec3 CalculateDirectionalLight(DirLight light, vec3 Normal, vec3 Albedo);
-float GenerateDirectionalShadow(vec4 fragPosLightSpace);
+int SelectCascade(vec3 fragPos);
+float GenerateDirectionalShadow(vec3 Normal);
+float MomentsLod(int cascade);
 
 vec3 FragPos;
+//screen-space derivatives of FragPos, taken before any branching
+vec3 FragPosDx;
+vec3 FragPosDy;
 
-vec3 sampleOffsetDirections[20] = vec3[]
+//each tap is a bilinear hardware compare, rotated per pixel so the pattern turns into noise
+const vec2 poissonDisk[4] = vec2[]
 (
-   vec3( 1,  1,  1), vec3( 1, -1,  1), vec3(-1, -1,  1), vec3(-1,  1,  1), 
-   vec3( 1,  1, -1), vec3( 1, -1, -1), vec3(-1, -1, -1), vec3(-1,  1, -1),
-   vec3( 1,  1,  0), vec3( 1, -1,  0), vec3(-1, -1,  0), vec3(-1,  1,  0),
-   vec3( 1,  0,  1), vec3(-1,  0,  1), vec3( 1,  0, -1), vec3(-1,  0, -1),
-   vec3( 0,  1,  1), vec3( 0, -1,  1), vec3( 0, -1, -1), vec3( 0,  1, -1)
-);   
+   vec2(-0.94201624, -0.39906216), vec2(0.94558609, -0.76890725),
+   vec2(-0.09418410, -0.92938870), vec2(0.34495938, 0.29387760)
+);
+
+const float ESM_EXPONENT = 80.0; // must match ShadowMoments.fs
 
 void main() {
-	FragPos = texture(gPosition, TexCoord).rgb;
-	vec3 Normal = texture(gNormal, TexCoord).rgb;
+	FragPos = GBufferPosition(TexCoord);
+	FragPosDx = dFdx(FragPos);
+	FragPosDy = dFdy(FragPos);
+	vec3 Normal = GBufferNormal(TexCoord);
 	vec3 Albedo = texture(gAlbedoSpec, TexCoord).rgb;
 	float Specular = texture(gAlbedoSpec, TexCoord).a;
-	FragPosLightSpace = lightSpaceMatrix * vec4(FragPos, 1.0);
 
 	vec3 lighting = Albedo * 0.1; //hardcoded ambient
 	vec3 viewDir = normalize(viewPos - FragPos);
 	//Directional Light
 	lighting += CalculateDirectionalLight(dirlight, Normal, Albedo);
 
-	for (int i=0; i<NR_LIGHTS; i++) {
+	for (int i=0; i<lightCount && !lightVolumes; i++) {
+		vec4 positionRadius = texelFetch(lightData, lightOffset + 3 * i);
+		vec4 colorShadow = texelFetch(lightData, lightOffset + 3 * i + 1);
+		vec2 attenuationFactors = texelFetch(lightData, lightOffset + 3 * i + 2).xy;
+		// past the radius the light is below the cutoff, the same lights the volumes would shade
+        float distance = length(positionRadius.xyz - FragPos);
+		if (distance > positionRadius.w)
+			continue;
 		//diffuse
-		vec3 lightDir = normalize(lights[i].Position - FragPos);
-		vec3 diffuse = max(dot(lightDir, Normal), 0.0) * Albedo * lights[i].Color;
+		vec3 lightDir = normalize(positionRadius.xyz - FragPos);
+		vec3 diffuse = max(dot(lightDir, Normal), 0.0) * Albedo * colorShadow.rgb;
 		// specular
         vec3 halfwayDir = normalize(lightDir + viewDir);  
         float spec = pow(max(dot(Normal, halfwayDir), 0.0), 16.0);
-        vec3 specular = lights[i].Color * spec * Specular;
+        vec3 specular = colorShadow.rgb * spec * Specular;
         // attenuation
-        float distance = length(lights[i].Position - FragPos);
-        float attenuation = 1.0 / (1.0 + lights[i].Linear * distance + lights[i].Quadratic * distance * distance);
+        float attenuation = 1.0 / (1.0 + attenuationFactors.x * distance + attenuationFactors.y * distance * distance);
         diffuse *= attenuation;
         specular *= attenuation;
-        lighting += diffuse + specular;       
+        float shadow = PointShadow(int(colorShadow.a), positionRadius.xyz, FragPos, Normal);
+        lighting += (diffuse + specular) * (1.0 - shadow);       
 	}
 
 	FragColor = vec4(lighting, 1.0);
@@ -94,36 +111,85 @@ vec3 CalculateDirectionalLight(DirLight light, vec3 Normal, vec3 Albedo) {
 	vec3 ambient = light.ambient * vec3(textureColour);
 	vec3 diffuse = vec3(textureColour);
 
-	bias = max(0.05 * (1.0 - dot(Normal, lightDir)), 0.005);
+	//slope scaled, in texels of the selected cascade
+	bias = 1.0 + 3.0 * (1.0 - max(dot(Normal, lightDir), 0.0));
 
-	float shadow = GenerateDirectionalShadow(FragPosLightSpace);
+	float shadow = GenerateDirectionalShadow(Normal);
 
 	diffuse *= (1.0 - shadow);
 
 	return (ambient + diffuse);
 }
 
-float GenerateDirectionalShadow(vec4 fragPosLightSpace) {
+int SelectCascade(vec3 fragPos) {
+	float depth = -(view * vec4(fragPos, 1.0)).z;
+	for (int i = 0; i < NR_CASCADES; i++) {
+		if (depth < cascadeSplits[i])
+			return i;
+	}
+	return NR_CASCADES;
+}
+
+float GenerateDirectionalShadow(vec3 Normal) {
+	int cascade = SelectCascade(FragPos);
+	//past the last cascade
+	if (cascade == NR_CASCADES)
+		return 0.0;
+
+	//offset along the normal by a texel of this cascade to keep acne off surfaces facing away from the light
+	vec4 fragPosLightSpace = cascadeMatrices[cascade] * vec4(FragPos + Normal * cascadeTexelSizes[cascade], 1.0);
 	//perspective divide
 	vec3 projCoord = fragPosLightSpace.xyz / fragPosLightSpace.w;
 	projCoord = projCoord * 0.5 + 0.5;
-	float shadow = 0.0;
-	float currentDepth = projCoord.z;
-	float spread = 300.0;
-	int samples  = 20;
+	if (projCoord.z > 1.0)
+		return 0.0;
+
+	vec4 rect = cascadeRects[cascade];
+	vec2 atlasCoord = rect.xy + projCoord.xy * rect.zw;
+	float currentDepth = projCoord.z - bias * cascadeBias[cascade];
+
+	if (shadowFilter == 1) {
+		//variance, Chebyshev's upper bound on the lit fraction
+		vec2 moments = textureLod(shadowMoments, atlasCoord, MomentsLod(cascade)).rg;
+		if (currentDepth <= moments.x)
+			return 0.0;
+		float variance = max(moments.y - moments.x * moments.x, 0.00002);
+		float d = currentDepth - moments.x;
+		float lit = variance / (variance + d * d);
+		//cut off the tail that causes light bleeding
+		return 1.0 - clamp((lit - 0.2) / 0.8, 0.0, 1.0);
+	}
+	if (shadowFilter == 2) {
+		//exponential
+		float occluder = textureLod(shadowMoments, atlasCoord, MomentsLod(cascade)).r;
+		return 1.0 - clamp(occluder * exp(-ESM_EXPONENT * currentDepth), 0.0, 1.0);
+	}
+
+	//keep every tap inside this cascade's tile of the atlas
+	vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0));
+	vec2 minCoord = rect.xy + texel * 0.5;
+	vec2 maxCoord = rect.xy + rect.zw - texel * 0.5;
+
 	float viewDistance = length(viewPos - FragPos);
-	float diskRadius = (1.0 + (viewDistance / far_plane)) / 25.0;;
-	for(int i = 0; i < samples; ++i)
+	float diskRadius = 1.5 * (1.0 + viewDistance / far_plane);
+	float angle = 6.2831853 * fract(52.9829189 * fract(dot(gl_FragCoord.xy, vec2(0.06711056, 0.00583715))));
+	mat2 rotation = mat2(cos(angle), sin(angle), -sin(angle), cos(angle));
+	float shadow = 0.0;
+	for(int i = 0; i < 4; ++i)
 	{
-		float closestDepth = texture(shadowMap, projCoord.xy + sampleOffsetDirections[i].xy * diskRadius / spread).r;
-		if(currentDepth - bias > closestDepth)
-			shadow += 1.0;
+		vec2 sampleCoord = clamp(atlasCoord + rotation * poissonDisk[i] * texel * diskRadius, minCoord, maxCoord);
+		shadow += 1.0 - texture(shadowMap, vec3(sampleCoord, currentDepth));
 	}
-	shadow /= float(samples); 
+	shadow /= 4.0;
 
-	if (projCoord.z > 1.0) {
-		shadow = 0.0;
-	}
-	
 	return shadow;
-}
\ No newline at end of file
+}
+
+//mip level of the prefiltered moments from the pixel's footprint in the cascade
+float MomentsLod(int cascade) {
+	vec2 size = vec2(textureSize(shadowMoments, 0));
+	vec2 dx = (cascadeMatrices[cascade] * vec4(FragPosDx, 0.0)).xy * 0.5 * cascadeRects[cascade].zw * size;
+	vec2 dy = (cascadeMatrices[cascade] * vec4(FragPosDy, 0.0)).xy * 0.5 * cascadeRects[cascade].zw * size;
+	//clamped, the derivatives jump across depth edges in the G-Buffer and would blur shadows around silhouettes
+	return clamp(log2(max(length(dx), length(dy))), 0.0, 2.0);
+}
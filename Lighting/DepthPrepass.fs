@@ -0,0 +1,14 @@
+#version 330 core
+
+in vec2 TexCoords;
+
+uniform sampler2D texture_diffuse1;
+
+void main() {
+#ifdef ALPHA_TEST
+	// the cutouts must be left out of the depth buffer, the G-Buffer pass then only matches visible texels
+	if (texture(texture_diffuse1, TexCoords).a < 0.5) {
+		discard;
+	}
+#endif
+}
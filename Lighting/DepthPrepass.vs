@@ -0,0 +1,21 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 5) in mat4 aInstance;
+
+out vec2 TexCoords;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+// the same expression as G-Buffer.vs, so the G-Buffer pass can depth test with GL_EQUAL
+invariant gl_Position;
+
+void main()
+{
+    mat4 world = model * aInstance;
+    vec4 worldPos = world * vec4(aPos, 1.0);
+    TexCoords = aTexCoords;
+    gl_Position = projection * view * worldPos;
+}
@@ -0,0 +1,79 @@
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+#include "GpuTimer.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Default dynamic resolution values
+const float DRS_BUDGET_MS = 14.0f;  // GPU frame time to aim for, leaves some of a 60Hz frame spare
+const float DRS_HEADROOM = 0.8f;    // scale back up once frames are this far under budget
+const float DRS_MIN_SCALE = 0.5f;
+const float DRS_MAX_SCALE = 1.0f;
+const float DRS_STEP = 0.05f;       // scales are quantized so the targets aren't reallocated for tiny changes
+const unsigned int DRS_INTERVAL = 30; // frames averaged between adjustments
+
+// Picks the internal resolution of the G-Buffer and lighting targets from the measured GPU frame
+// time. The cost of those passes grows with the pixel count, so a frame that is over budget by a
+// factor k is scaled by 1/sqrt(k) on each axis in one go, while recovering happens a step at a time
+// so the scale doesn't oscillate around the budget.
+class DynamicResolution
+{
+public:
+    float Scale = DRS_MAX_SCALE;
+    bool Enabled = true;
+    float BudgetMs;
+    float LastFrameMs = 0.0f; // average GPU frame time of the last interval
+
+    DynamicResolution(float budgetMs = DRS_BUDGET_MS) : BudgetMs(budgetMs) {}
+
+    void BeginFrame()
+    {
+        frameTimer.Begin();
+    }
+
+    void EndFrame()
+    {
+        frameTimer.End();
+    }
+
+    // true when the scale changed, call once per frame after EndFrame()
+    bool Update()
+    {
+        if (!Enabled)
+        {
+            bool changed = Scale != DRS_MAX_SCALE;
+            Scale = DRS_MAX_SCALE;
+            frameTimer.Reset();
+            return changed;
+        }
+        if (++frames < DRS_INTERVAL || frameTimer.Samples() == 0)
+            return false;
+        LastFrameMs = (float)frameTimer.AverageMs();
+        frameTimer.Reset();
+        frames = 0;
+
+        float scale = Scale;
+        if (LastFrameMs > BudgetMs)
+            scale = std::floor(Scale * std::sqrt(BudgetMs / LastFrameMs) / DRS_STEP) * DRS_STEP;
+        else if (LastFrameMs < BudgetMs * DRS_HEADROOM)
+            scale = Scale + DRS_STEP;
+        scale = std::min(std::max(scale, DRS_MIN_SCALE), DRS_MAX_SCALE);
+        if (std::fabs(scale - Scale) < DRS_STEP * 0.5f)
+            return false;
+        Scale = scale;
+        return true;
+    }
+
+    // internal size for a window dimension, never 0 so a minimized window still has valid targets
+    unsigned int Size(unsigned int windowSize) const
+    {
+        return std::max(1u, (unsigned int)(windowSize * Scale + 0.5f));
+    }
+
+private:
+    GpuTimer frameTimer;
+    unsigned int frames = 0;
+};
+#endif
@@ -0,0 +1,161 @@
+#ifndef FRAME_TIMINGS_H
+#define FRAME_TIMINGS_H
+
+#include "GpuTimer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Default frame timing values
+const unsigned int TIMING_WARMUP_FRAMES = 10; // left out of the summary, shader compiles and first uploads land here
+const unsigned int TIMING_HISTOGRAM_BUCKETS = 16;
+const unsigned int TIMING_HISTOGRAM_WIDTH = 50; // characters of the fullest bucket's bar
+
+// Per-frame timings for benchmark runs. The CPU time covers recording a frame, the frame time is the
+// interval between two frame ends, so without a swap interval it is the throughput the CPU and GPU
+// reach together. GPU times come from timestamp queries a few frames late and are filled in per frame as
+// they arrive; a frame whose query was reused before its result came back has none.
+// Without gpu (no GL context, the software rasterizer) only the CPU side is timed.
+class FrameTimings
+{
+public:
+    FrameTimings(bool gpu = true)
+    {
+        if (gpu)
+        {
+            gpuTimer.reset(new GpuTimer());
+            gpuTimer->KeepResults = true;
+        }
+    }
+
+    void BeginFrame()
+    {
+        frameStart = std::chrono::steady_clock::now();
+        if (gpuTimer)
+            gpuTimer->Begin();
+    }
+
+    void EndFrame()
+    {
+        if (gpuTimer)
+            gpuTimer->End();
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        cpuMs.push_back(milliseconds(frameStart, now));
+        frameMs.push_back(milliseconds(cpuMs.size() > 1 ? lastEnd : frameStart, now));
+        lastEnd = now;
+        gpuMs.push_back(-1.0);
+        gatherGpu();
+        if (gpuTimer && cpuMs.size() == TIMING_WARMUP_FRAMES)
+            gpuTimer->Reset();
+    }
+
+    // picks up the GPU times still in flight, after the GPU has finished (glFinish)
+    void Finish()
+    {
+        if (gpuTimer)
+            gpuTimer->Collect();
+        gatherGpu();
+    }
+
+    unsigned int Frames() const
+    {
+        return cpuMs.size();
+    }
+
+    void Report(std::ostream& out) const
+    {
+        unsigned int first = firstMeasured();
+        std::vector<double> frame(frameMs.begin() + first, frameMs.end());
+        std::vector<double> cpu(cpuMs.begin() + first, cpuMs.end());
+        if (frame.empty())
+            return;
+        std::sort(frame.begin(), frame.end());
+        std::sort(cpu.begin(), cpu.end());
+        out << "Frames: " << frameMs.size() << " (" << first << " warm-up)" << std::endl;
+        out << "Frame time: avg " << average(frame) << " ms, min " << frame.front() << ", p50 " << percentile(frame, 0.5)
+            << ", p95 " << percentile(frame, 0.95) << ", max " << frame.back() << std::endl;
+        out << "CPU time: avg " << average(cpu) << " ms, p95 " << percentile(cpu, 0.95) << std::endl;
+        if (gpuTimer && gpuTimer->Samples() > 0)
+            out << "GPU time: avg " << gpuTimer->AverageMs() << " ms over " << gpuTimer->Samples() << " frames" << std::endl;
+    }
+
+    // frame times between the fastest and the slowest frame in equal buckets, after the warm-up
+    void Histogram(std::ostream& out) const
+    {
+        std::vector<double> frame(frameMs.begin() + firstMeasured(), frameMs.end());
+        if (frame.empty())
+            return;
+        double low = *std::min_element(frame.begin(), frame.end());
+        double width = std::max((*std::max_element(frame.begin(), frame.end()) - low) / TIMING_HISTOGRAM_BUCKETS, 1e-3);
+        std::vector<unsigned int> counts(TIMING_HISTOGRAM_BUCKETS, 0);
+        for (unsigned int i = 0; i < frame.size(); i++)
+            counts[std::min(TIMING_HISTOGRAM_BUCKETS - 1, (unsigned int)((frame[i] - low) / width))]++;
+        unsigned int fullest = *std::max_element(counts.begin(), counts.end());
+        out << "Frame time histogram (ms):" << std::endl;
+        for (unsigned int b = 0; b < TIMING_HISTOGRAM_BUCKETS; b++)
+            out << "  " << low + b * width << " - " << low + (b + 1) * width << "\t"
+                << std::string(counts[b] * TIMING_HISTOGRAM_WIDTH / fullest, '#') << " " << counts[b] << std::endl;
+    }
+
+    // one line per frame, warm-up frames included
+    bool WriteCSV(const std::string& path) const
+    {
+        std::ofstream file(path.c_str());
+        file << "frame,cpu_ms,frame_ms,gpu_ms" << std::endl;
+        for (unsigned int i = 0; i < frameMs.size(); i++)
+        {
+            file << i << "," << cpuMs[i] << "," << frameMs[i] << ",";
+            // left empty for a frame without a GPU time
+            if (gpuMs[i] >= 0.0)
+                file << gpuMs[i];
+            file << std::endl;
+        }
+        return file.good();
+    }
+
+private:
+    std::unique_ptr<GpuTimer> gpuTimer;
+    std::chrono::steady_clock::time_point frameStart, lastEnd;
+    std::vector<double> cpuMs, frameMs;
+    std::vector<double> gpuMs; // by frame, -1 until its result arrives
+    unsigned int gpuResultsRead = 0;
+
+    void gatherGpu()
+    {
+        if (!gpuTimer)
+            return;
+        const std::vector<std::pair<unsigned int, double>>& results = gpuTimer->Results();
+        for (; gpuResultsRead < results.size(); gpuResultsRead++)
+            if (results[gpuResultsRead].first < gpuMs.size())
+                gpuMs[results[gpuResultsRead].first] = results[gpuResultsRead].second;
+    }
+
+    unsigned int firstMeasured() const
+    {
+        return frameMs.size() > TIMING_WARMUP_FRAMES ? TIMING_WARMUP_FRAMES : 0;
+    }
+
+    static double milliseconds(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to)
+    {
+        return std::chrono::duration<double, std::milli>(to - from).count();
+    }
+
+    static double average(const std::vector<double>& sorted)
+    {
+        double total = 0.0;
+        for (unsigned int i = 0; i < sorted.size(); i++)
+            total += sorted[i];
+        return total / sorted.size();
+    }
+
+    static double percentile(const std::vector<double>& sorted, double p)
+    {
+        return sorted[std::min<size_t>(sorted.size() - 1, (size_t)(p * sorted.size()))];
+    }
+};
+#endif
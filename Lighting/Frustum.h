@@ -0,0 +1,175 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define FRUSTUM_SSE
+#endif
+
+// World-space bounds of many meshes, one array per component so four of them can be tested against
+// a plane at once. Each mesh has a box (centre and half extent) and a bounding sphere.
+struct BoundsBatch {
+    std::vector<float> CenterX, CenterY, CenterZ;
+    std::vector<float> ExtentX, ExtentY, ExtentZ;
+    std::vector<float> SphereX, SphereY, SphereZ, Radius;
+
+    unsigned int Size() const
+    {
+        return CenterX.size();
+    }
+
+    void Clear()
+    {
+        CenterX.clear(); CenterY.clear(); CenterZ.clear();
+        ExtentX.clear(); ExtentY.clear(); ExtentZ.clear();
+        SphereX.clear(); SphereY.clear(); SphereZ.clear(); Radius.clear();
+    }
+
+    void Add(const glm::vec3& min, const glm::vec3& max, const glm::vec3& sphereCenter, float radius)
+    {
+        glm::vec3 center = (min + max) * 0.5f;
+        glm::vec3 extent = (max - min) * 0.5f;
+        CenterX.push_back(center.x); CenterY.push_back(center.y); CenterZ.push_back(center.z);
+        ExtentX.push_back(extent.x); ExtentY.push_back(extent.y); ExtentZ.push_back(extent.z);
+        SphereX.push_back(sphereCenter.x); SphereY.push_back(sphereCenter.y); SphereZ.push_back(sphereCenter.z);
+        Radius.push_back(radius);
+    }
+};
+
+enum FrustumTest {
+    FRUSTUM_OUTSIDE,
+    FRUSTUM_INTERSECT,
+    FRUSTUM_INSIDE
+};
+
+// The six planes of a view-projection matrix, pointing inwards (Gribb & Hartmann).
+struct Frustum {
+    glm::vec4 Planes[6]; // left, right, bottom, top, near, far
+
+    Frustum() {}
+
+    Frustum(const glm::mat4& viewProjection)
+    {
+        // glm is column major, so row i of the matrix is (m[0][i], m[1][i], m[2][i], m[3][i])
+        glm::vec4 row0 = glm::vec4(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]);
+        glm::vec4 row1 = glm::vec4(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]);
+        glm::vec4 row2 = glm::vec4(viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]);
+        glm::vec4 row3 = glm::vec4(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+        Planes[0] = row3 + row0;
+        Planes[1] = row3 - row0;
+        Planes[2] = row3 + row1;
+        Planes[3] = row3 - row1;
+        Planes[4] = row3 + row2;
+        Planes[5] = row3 - row2;
+        for (unsigned int i = 0; i < 6; i++)
+            Planes[i] /= glm::length(glm::vec3(Planes[i]));
+    }
+
+    // false only if the box is entirely outside one of the planes
+    bool IntersectsAABB(const glm::vec3& min, const glm::vec3& max) const
+    {
+        for (unsigned int i = 0; i < 6; i++)
+        {
+            // the corner furthest along the plane normal
+            glm::vec3 p = glm::vec3(Planes[i].x > 0.0f ? max.x : min.x, Planes[i].y > 0.0f ? max.y : min.y, Planes[i].z > 0.0f ? max.z : min.z);
+            if (glm::dot(glm::vec3(Planes[i]), p) + Planes[i].w < 0.0f)
+                return false;
+        }
+        return true;
+    }
+
+    // like IntersectsAABB, but also tells when the box is entirely inside so a hierarchy can stop testing
+    FrustumTest ClassifyAABB(const glm::vec3& min, const glm::vec3& max) const
+    {
+        FrustumTest result = FRUSTUM_INSIDE;
+        for (unsigned int i = 0; i < 6; i++)
+        {
+            glm::vec3 normal = glm::vec3(Planes[i]);
+            glm::vec3 p = glm::vec3(normal.x > 0.0f ? max.x : min.x, normal.y > 0.0f ? max.y : min.y, normal.z > 0.0f ? max.z : min.z);
+            if (glm::dot(normal, p) + Planes[i].w < 0.0f)
+                return FRUSTUM_OUTSIDE;
+            // the nearest corner behind the plane means the box straddles it
+            glm::vec3 n = glm::vec3(normal.x > 0.0f ? min.x : max.x, normal.y > 0.0f ? min.y : max.y, normal.z > 0.0f ? min.z : max.z);
+            if (glm::dot(normal, n) + Planes[i].w < 0.0f)
+                result = FRUSTUM_INTERSECT;
+        }
+        return result;
+    }
+
+    bool IntersectsSphere(const glm::vec3& center, float radius) const
+    {
+        for (unsigned int i = 0; i < 6; i++)
+        {
+            if (glm::dot(glm::vec3(Planes[i]), center) + Planes[i].w < -radius)
+                return false;
+        }
+        return true;
+    }
+
+    // visible[i] is set to 1 if mesh i may be inside, 0 if its box or its sphere is outside a plane.
+    // Either volume alone is conservative, so rejecting on whichever is tighter culls the most.
+    // Returns the number of visible meshes.
+    unsigned int CullBatch(const BoundsBatch& bounds, std::vector<unsigned char>& visible) const
+    {
+        unsigned int count = bounds.Size();
+        visible.resize(count);
+        unsigned int inside = 0;
+        unsigned int i = 0;
+#ifdef FRUSTUM_SSE
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 cx = _mm_loadu_ps(&bounds.CenterX[i]), cy = _mm_loadu_ps(&bounds.CenterY[i]), cz = _mm_loadu_ps(&bounds.CenterZ[i]);
+            __m128 ex = _mm_loadu_ps(&bounds.ExtentX[i]), ey = _mm_loadu_ps(&bounds.ExtentY[i]), ez = _mm_loadu_ps(&bounds.ExtentZ[i]);
+            __m128 sx = _mm_loadu_ps(&bounds.SphereX[i]), sy = _mm_loadu_ps(&bounds.SphereY[i]), sz = _mm_loadu_ps(&bounds.SphereZ[i]);
+            __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&bounds.Radius[i]));
+            __m128 mask = _mm_cmpeq_ps(_mm_setzero_ps(), _mm_setzero_ps()); // all lanes inside
+            for (unsigned int p = 0; p < 6; p++)
+            {
+                __m128 nx = _mm_set1_ps(Planes[p].x), ny = _mm_set1_ps(Planes[p].y), nz = _mm_set1_ps(Planes[p].z), w = _mm_set1_ps(Planes[p].w);
+                // box: signed distance of the centre plus the extent projected on the normal
+                __m128 boxDistance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)), _mm_add_ps(_mm_mul_ps(nz, cz), w));
+                __m128 projected = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(std::fabs(Planes[p].x)), ex),
+                    _mm_mul_ps(_mm_set1_ps(std::fabs(Planes[p].y)), ey)), _mm_mul_ps(_mm_set1_ps(std::fabs(Planes[p].z)), ez));
+                mask = _mm_and_ps(mask, _mm_cmpge_ps(_mm_add_ps(boxDistance, projected), _mm_setzero_ps()));
+                // sphere
+                __m128 sphereDistance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, sx), _mm_mul_ps(ny, sy)), _mm_add_ps(_mm_mul_ps(nz, sz), w));
+                mask = _mm_and_ps(mask, _mm_cmpge_ps(sphereDistance, negRadius));
+            }
+            int bits = _mm_movemask_ps(mask);
+            for (unsigned int j = 0; j < 4; j++)
+            {
+                visible[i + j] = (bits >> j) & 1;
+                inside += visible[i + j];
+            }
+        }
+#endif
+        // whatever doesn't fill a group of four, or everything without SSE
+        for (; i < count; i++)
+        {
+            glm::vec3 center(bounds.CenterX[i], bounds.CenterY[i], bounds.CenterZ[i]);
+            glm::vec3 extent(bounds.ExtentX[i], bounds.ExtentY[i], bounds.ExtentZ[i]);
+            visible[i] = IntersectsAABB(center - extent, center + extent)
+                && IntersectsSphere(glm::vec3(bounds.SphereX[i], bounds.SphereY[i], bounds.SphereZ[i]), bounds.Radius[i]);
+            inside += visible[i];
+        }
+        return inside;
+    }
+};
+
+// world-space bounds of an object-space box under an affine transform
+inline void TransformAABB(const glm::mat4& transform, const glm::vec3& min, const glm::vec3& max, glm::vec3& outMin, glm::vec3& outMax)
+{
+    glm::vec3 center = glm::vec3(transform * glm::vec4((min + max) * 0.5f, 1.0f));
+    glm::vec3 extent = (max - min) * 0.5f;
+    glm::vec3 worldExtent;
+    for (int i = 0; i < 3; i++)
+        worldExtent[i] = std::fabs(transform[0][i]) * extent.x + std::fabs(transform[1][i]) * extent.y + std::fabs(transform[2][i]) * extent.z;
+    outMin = center - worldExtent;
+    outMax = center + worldExtent;
+}
+#endif
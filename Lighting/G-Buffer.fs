@@ -1,8 +1,14 @@
 #version 330 core
 
+#ifdef COMPACT_GBUFFER
+// position comes back from the depth buffer, normal is octahedral encoded
+layout (location = 0) out vec2 gNormal;
+layout (location = 1) out vec4 gAlbedoSpec;
+#else
 layout (location = 0) out vec3 gPosition;
 layout (location = 1) out vec3 gNormal;
 layout (location = 2) out vec4 gAlbedoSpec;
+#endif
 
 in vec2 TexCoords;
 in vec3 FragPos;
@@ -15,9 +21,18 @@ uniform sampler2D texture_normal1;
 
 float bias = 0.0;
 
+// maps a unit vector onto the [0,1]^2 octahedron unfolding
+vec2 OctEncode(vec3 n) {
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	vec2 oct = n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	return oct * 0.5 + 0.5;
+}
+
 void main() {
+#ifndef COMPACT_GBUFFER
 	// store the fragment position vector in the first gbuffer texture
     gPosition = FragPos;
+#endif
     // also store the per-fragment normals into the gbuffer
     vec3 norm = texture(texture_normal1, TexCoords).rgb;
 	norm = normalize(norm * 2.0 - 1.0);
@@ -39,11 +54,18 @@ void main() {
 	else {
 		norm = normalize(tbn * norm);
 	}
+#ifdef COMPACT_GBUFFER
+	gNormal = OctEncode(norm);
+#else
 	gNormal = norm;
+#endif
     // and the diffuse per-fragment color
+#ifdef ALPHA_TEST
+	// only the variant for cutout meshes discards, so early depth testing stays on for the rest
 	if (texture(texture_diffuse1, TexCoords).a < 0.5) {
 		discard;
 	}
+#endif
     gAlbedoSpec.rgb = texture(texture_diffuse1, TexCoords).rgb;
     // store specular intensity in gAlbedoSpec's alpha component
     gAlbedoSpec.a = texture(texture_specular1, TexCoords).r;
@@ -4,6 +4,7 @@ layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
 layout (location = 3) in vec3 aTangent; 
 layout (location = 4) in vec3 aBitangent;
+layout (location = 5) in mat4 aInstance; // places a copy of shared geometry, identity for most meshes
 
 out vec3 FragPos;
 out vec2 TexCoords;
@@ -14,18 +15,22 @@ uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+// must match DepthPrepass.vs bit for bit, the pass is depth tested with GL_EQUAL after the prepass
+invariant gl_Position;
+
 void main()
 {
-    vec4 worldPos = model * vec4(aPos, 1.0);
+    mat4 world = model * aInstance;
+    vec4 worldPos = world * vec4(aPos, 1.0);
     FragPos = worldPos.xyz; 
     TexCoords = aTexCoords;
     
-    vec3 T = normalize(vec3(model * vec4(aTangent, 0.0)));
-    vec3 B = normalize(vec3(model * vec4(aBitangent, 0.0)));
-    vec3 N = normalize(vec3(model * vec4(aNormal, 0.0)));
+    vec3 T = normalize(vec3(world * vec4(aTangent, 0.0)));
+    vec3 B = normalize(vec3(world * vec4(aBitangent, 0.0)));
+    vec3 N = normalize(vec3(world * vec4(aNormal, 0.0)));
     TBN = transpose(mat3(T, B, N));
 
-    mat3 normalMatrix = transpose(inverse(mat3(model)));
+    mat3 normalMatrix = transpose(inverse(mat3(world)));
     Normal = normalMatrix * aNormal;
 
     gl_Position = projection * view * worldPos;
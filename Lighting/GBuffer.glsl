@@ -0,0 +1,35 @@
+// G-Buffer reads shared by the lighting shaders, #include "GBuffer.glsl" after the #version line.
+// Compiled with COMPACT_GBUFFER the position is rebuilt from depth and the normal is octahedral.
+
+#ifdef COMPACT_GBUFFER
+uniform sampler2D gDepth;
+uniform mat4 invViewProjection;
+#else
+uniform sampler2D gPosition;
+#endif
+uniform sampler2D gNormal;
+uniform sampler2D gAlbedoSpec;
+
+vec3 GBufferPosition(vec2 uv) {
+#ifdef COMPACT_GBUFFER
+	float depth = texture(gDepth, uv).r;
+	vec4 clip = vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+	vec4 world = invViewProjection * clip;
+	return world.xyz / world.w;
+#else
+	return texture(gPosition, uv).rgb;
+#endif
+}
+
+vec3 GBufferNormal(vec2 uv) {
+#ifdef COMPACT_GBUFFER
+	vec2 oct = texture(gNormal, uv).rg * 2.0 - 1.0;
+	vec3 n = vec3(oct, 1.0 - abs(oct.x) - abs(oct.y));
+	float t = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+#else
+	return texture(gNormal, uv).rgb;
+#endif
+}
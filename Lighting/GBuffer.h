@@ -0,0 +1,133 @@
+#ifndef GBUFFER_H
+#define GBUFFER_H
+
+#include <glad/glad.h>
+
+#include "RenderGraph.h"
+#include "Shader.h"
+
+#include <vector>
+
+// The geometry buffer for the deferred passes. Two layouts are supported so they can be compared:
+//   classic: gPosition RGBA16F, gNormal RGBA16F, gAlbedoSpec RGBA8 + depth (24 bytes/pixel)
+//   compact: gNormal RG16 (octahedral), gAlbedoSpec RGBA8 + sampled depth texture (12 bytes/pixel),
+//            the position is reconstructed from depth and the inverse view-projection in GBuffer.glsl
+// The targets are transient render graph resources, declared again every frame.
+class GBuffer
+{
+public:
+    RenderGraph::Resource gPosition = -1, gNormal = -1, gAlbedoSpec = -1, gDepth = -1;
+    bool Compact = false;
+    unsigned int Width = 0, Height = 0;
+
+    ~GBuffer()
+    {
+        if (copyFBO)
+            glDeleteFramebuffers(1, &copyFBO);
+    }
+
+    void Declare(RenderGraph& graph, unsigned int width, unsigned int height, bool compact)
+    {
+        Width = width;
+        Height = height;
+        Compact = compact;
+
+        gPosition = -1;
+        if (!Compact)
+        {
+            // - Position Color Buffer
+            gPosition = graph.CreateTexture("gPosition", target(GL_RGBA16F, GL_RGBA, GL_FLOAT), GPU_MEMORY_GBUFFER);
+            // - Normal Color Buffer
+            gNormal = graph.CreateTexture("gNormal", target(GL_RGBA16F, GL_RGBA, GL_FLOAT), GPU_MEMORY_GBUFFER);
+            // - Color + Specular Color Buffer
+            gAlbedoSpec = graph.CreateTexture("gAlbedoSpec", target(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE), GPU_MEMORY_GBUFFER);
+            gDepth = graph.CreateTexture("gDepth", target(GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT), GPU_MEMORY_GBUFFER);
+        }
+        else
+        {
+            // - Octahedral Normal Buffer
+            gNormal = graph.CreateTexture("gNormal", target(GL_RG16, GL_RG, GL_UNSIGNED_SHORT), GPU_MEMORY_GBUFFER);
+            // - Color + Specular Color Buffer
+            gAlbedoSpec = graph.CreateTexture("gAlbedoSpec", target(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE), GPU_MEMORY_GBUFFER);
+            // - Depth, sampled to rebuild the position
+            gDepth = graph.CreateTexture("gDepth", target(GL_DEPTH_COMPONENT32F, GL_DEPTH_COMPONENT, GL_FLOAT), GPU_MEMORY_GBUFFER);
+        }
+    }
+
+    // attachments of the geometry pass, in draw buffer order
+    std::vector<RenderGraph::Resource> Targets() const
+    {
+        if (Compact)
+            return { gNormal, gAlbedoSpec, gDepth };
+        return { gPosition, gNormal, gAlbedoSpec, gDepth };
+    }
+
+    // what the lighting passes sample
+    std::vector<RenderGraph::Resource> Inputs() const
+    {
+        if (Compact)
+            return { gDepth, gNormal, gAlbedoSpec };
+        return { gPosition, gNormal, gAlbedoSpec };
+    }
+
+    // the depth the lighting passes attach to depth test the light volumes. The compact layout samples
+    // gDepth in those passes, so it gets a copy blitted from gDepth; attaching the sampled texture
+    // would be a feedback loop even with depth writes off
+    RenderGraph::Resource LightingDepth(RenderGraph& graph)
+    {
+        if (!Compact)
+            return gDepth;
+        RenderGraph::Resource copy = graph.CreateTexture("lightingDepth", target(GL_DEPTH_COMPONENT32F, GL_DEPTH_COMPONENT, GL_FLOAT), GPU_MEMORY_GBUFFER);
+        RenderGraph::Resource source = gDepth;
+        graph.AddPass("copy depth", { source }, { copy }, [this, &graph, source]() {
+            if (!copyFBO)
+                glGenFramebuffers(1, &copyFBO);
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, copyFBO);
+            glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, graph.GetTexture(source), 0);
+            glBlitFramebuffer(0, 0, Width, Height, 0, 0, Width, Height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+            glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, 0, 0);
+        });
+        return copy;
+    }
+
+    // binds the G-Buffer textures to units 0-2 and points the shader's samplers at them
+    void BindTextures(RenderGraph& graph, Shader& shader)
+    {
+        if (!Compact)
+        {
+            shader.setInt("gPosition", 0);
+            shader.setInt("gNormal", 1);
+            shader.setInt("gAlbedoSpec", 2);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, graph.GetTexture(gPosition));
+        }
+        else
+        {
+            shader.setInt("gDepth", 0);
+            shader.setInt("gNormal", 1);
+            shader.setInt("gAlbedoSpec", 2);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, graph.GetTexture(gDepth));
+        }
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, graph.GetTexture(gNormal));
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, graph.GetTexture(gAlbedoSpec));
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // bytes written per pixel by the geometry pass, depth included
+    unsigned int BytesPerPixel() const
+    {
+        return Compact ? 4 + 4 + 4 : 8 + 8 + 4 + 4;
+    }
+
+private:
+    unsigned int copyFBO = 0; // reads gDepth for the copy
+
+    RGTextureDesc target(GLint internalFormat, GLenum format, GLenum type) const
+    {
+        return { Width, Height, internalFormat, format, type, GL_NEAREST };
+    }
+};
+#endif
@@ -0,0 +1,290 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+#include "GpuMemory.h"
+
+#include <iostream>
+#include <unordered_map>
+
+// Default state cache values
+const unsigned int GL_STATE_TEXTURE_UNITS = 32;
+const GLuint GL_STATE_UNKNOWN = 0xffffffffu; // a binding the cache hasn't seen set, the next call always goes through
+
+// calls the cache dropped since the last Reset(), by kind
+struct GLStateFiltered {
+    unsigned long long Programs = 0;
+    unsigned long long VertexArrays = 0;
+    unsigned long long ActiveTextures = 0;
+    unsigned long long Textures = 0;
+    unsigned long long Framebuffers = 0;
+    unsigned long long Viewports = 0;
+    unsigned long long Capabilities = 0; // glEnable/glDisable
+    unsigned long long Uniforms = 0;     // integer uniforms, the sampler units set for every mesh
+
+    unsigned long long Total() const
+    {
+        return Programs + VertexArrays + ActiveTextures + Textures + Framebuffers + Viewports + Capabilities + Uniforms;
+    }
+};
+
+// A shadow copy of the GL state the renderer keeps re-setting: the bound program, VAO, active unit and
+// the textures on each unit, the draw and read framebuffers, the viewport, the common enable flags and
+// integer uniforms. Like GLStats.h this header redefines the glad entry points, so every file compiled
+// after it goes through the cache; a call that would leave the state as it is never reaches the driver.
+//
+// The cache is only right while every call goes through it, so it has to be included before any header
+// that makes GL calls (Shader.h includes it). Deleting an object forgets wherever it was bound, since
+// GL may hand its name out again, and Invalidate() forgets everything after code the cache can't see.
+class GLState
+{
+public:
+    static GLStateFiltered& Filtered()
+    {
+        static GLStateFiltered filtered;
+        return filtered;
+    }
+
+    static void Invalidate()
+    {
+        state() = State();
+    }
+
+    static void Report(std::ostream& out)
+    {
+        const GLStateFiltered& f = Filtered();
+        out << "GL state cache filtered " << f.Total() << " calls: " << f.Programs << " programs, " << f.VertexArrays << " VAOs, "
+            << f.ActiveTextures << " active units, " << f.Textures << " textures, " << f.Framebuffers << " framebuffers, "
+            << f.Viewports << " viewports, " << f.Capabilities << " enables, " << f.Uniforms << " uniforms" << std::endl;
+    }
+
+    static void Reset()
+    {
+        Filtered() = GLStateFiltered();
+    }
+
+    static void UseProgram(GLuint program)
+    {
+        if (state().Program == program)
+            return filtered(Filtered().Programs);
+        state().Program = program;
+        glUseProgram(program);
+    }
+
+    static void BindVertexArray(GLuint vertexArray)
+    {
+        if (state().VertexArray == vertexArray)
+            return filtered(Filtered().VertexArrays);
+        state().VertexArray = vertexArray;
+        glBindVertexArray(vertexArray);
+    }
+
+    static void ActiveTexture(GLenum unit)
+    {
+        if (state().Unit == unit)
+            return filtered(Filtered().ActiveTextures);
+        state().Unit = unit;
+        glActiveTexture(unit);
+    }
+
+    static void BindTexture(GLenum target, GLuint texture)
+    {
+        GLuint* bound = textureSlot(target);
+        if (bound && *bound == texture)
+            return filtered(Filtered().Textures);
+        if (bound)
+            *bound = texture;
+        glBindTexture(target, texture);
+    }
+
+    static void BindFramebuffer(GLenum target, GLuint framebuffer)
+    {
+        bool draw = target != GL_READ_FRAMEBUFFER, read = target != GL_DRAW_FRAMEBUFFER;
+        if ((!draw || state().DrawFramebuffer == framebuffer) && (!read || state().ReadFramebuffer == framebuffer))
+            return filtered(Filtered().Framebuffers);
+        if (draw)
+            state().DrawFramebuffer = framebuffer;
+        if (read)
+            state().ReadFramebuffer = framebuffer;
+        glBindFramebuffer(target, framebuffer);
+    }
+
+    static void Viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+    {
+        GLint* viewport = state().Viewport;
+        if (state().ViewportKnown && viewport[0] == x && viewport[1] == y && viewport[2] == width && viewport[3] == height)
+            return filtered(Filtered().Viewports);
+        viewport[0] = x;
+        viewport[1] = y;
+        viewport[2] = width;
+        viewport[3] = height;
+        state().ViewportKnown = true;
+        glViewport(x, y, width, height);
+    }
+
+    static void Enable(GLenum capability)
+    {
+        if (setCapability(capability, 1))
+            glEnable(capability);
+    }
+
+    static void Disable(GLenum capability)
+    {
+        if (setCapability(capability, 0))
+            glDisable(capability);
+    }
+
+    static void Uniform1i(GLint location, GLint value)
+    {
+        // -1 is a uniform the program doesn't have, GL ignores it
+        if (location < 0 || state().Program == GL_STATE_UNKNOWN)
+        {
+            glUniform1i(location, value);
+            return;
+        }
+        unsigned long long key = ((unsigned long long)state().Program << 32) | (unsigned int)location;
+        std::unordered_map<unsigned long long, GLint>::iterator known = state().Uniforms.find(key);
+        if (known != state().Uniforms.end() && known->second == value)
+            return filtered(Filtered().Uniforms);
+        state().Uniforms[key] = value;
+        glUniform1i(location, value);
+    }
+
+    static void DeleteTextures(GLsizei count, const GLuint* textures)
+    {
+        for (GLsizei i = 0; i < count; i++)
+            for (unsigned int unit = 0; unit < GL_STATE_TEXTURE_UNITS; unit++)
+                for (unsigned int t = 0; t < TARGETS; t++)
+                    if (state().Textures[unit][t] == textures[i])
+                        state().Textures[unit][t] = GL_STATE_UNKNOWN;
+        glDeleteTextures(count, textures);
+    }
+
+    static void DeleteVertexArrays(GLsizei count, const GLuint* vertexArrays)
+    {
+        for (GLsizei i = 0; i < count; i++)
+            if (state().VertexArray == vertexArrays[i])
+                state().VertexArray = GL_STATE_UNKNOWN;
+        glDeleteVertexArrays(count, vertexArrays);
+    }
+
+    static void DeleteFramebuffers(GLsizei count, const GLuint* framebuffers)
+    {
+        for (GLsizei i = 0; i < count; i++)
+        {
+            if (state().DrawFramebuffer == framebuffers[i])
+                state().DrawFramebuffer = GL_STATE_UNKNOWN;
+            if (state().ReadFramebuffer == framebuffers[i])
+                state().ReadFramebuffer = GL_STATE_UNKNOWN;
+        }
+        glDeleteFramebuffers(count, framebuffers);
+    }
+
+    static void DeleteProgram(GLuint program)
+    {
+        if (state().Program == program)
+            state().Program = GL_STATE_UNKNOWN;
+        for (std::unordered_map<unsigned long long, GLint>::iterator i = state().Uniforms.begin(); i != state().Uniforms.end(); )
+            i = (i->first >> 32) == program ? state().Uniforms.erase(i) : ++i;
+        glDeleteProgram(program);
+    }
+
+private:
+    static const unsigned int TARGETS = 3; // GL_TEXTURE_2D, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_2D_ARRAY
+    static const unsigned int CAPABILITIES = 8;
+
+    struct State {
+        GLuint Program = GL_STATE_UNKNOWN, VertexArray = GL_STATE_UNKNOWN;
+        GLenum Unit = GL_STATE_UNKNOWN;
+        GLuint Textures[GL_STATE_TEXTURE_UNITS][TARGETS];
+        GLuint DrawFramebuffer = GL_STATE_UNKNOWN, ReadFramebuffer = GL_STATE_UNKNOWN;
+        GLint Viewport[4] = {};
+        bool ViewportKnown = false;
+        int Capabilities[CAPABILITIES]; // 1 enabled, 0 disabled, -1 unknown
+        std::unordered_map<unsigned long long, GLint> Uniforms; // by program and location
+
+        State()
+        {
+            for (unsigned int unit = 0; unit < GL_STATE_TEXTURE_UNITS; unit++)
+                for (unsigned int t = 0; t < TARGETS; t++)
+                    Textures[unit][t] = GL_STATE_UNKNOWN;
+            for (unsigned int c = 0; c < CAPABILITIES; c++)
+                Capabilities[c] = -1;
+        }
+    };
+
+    static State& state()
+    {
+        static State current;
+        return current;
+    }
+
+    static void filtered(unsigned long long& counter)
+    {
+        counter++;
+        GL_STATS_FILTERED();
+    }
+
+    // where the texture bound to target on the active unit is kept, NULL for what the cache doesn't track
+    static GLuint* textureSlot(GLenum target)
+    {
+        unsigned int unit = state().Unit - GL_TEXTURE0;
+        if (state().Unit == GL_STATE_UNKNOWN || unit >= GL_STATE_TEXTURE_UNITS)
+            return NULL;
+        switch (target)
+        {
+        case GL_TEXTURE_2D: return &state().Textures[unit][0];
+        case GL_TEXTURE_CUBE_MAP: return &state().Textures[unit][1];
+        case GL_TEXTURE_2D_ARRAY: return &state().Textures[unit][2];
+        default: return NULL;
+        }
+    }
+
+    // records the flag and returns whether the call has to go through
+    static bool setCapability(GLenum capability, int enabled)
+    {
+        static const GLenum tracked[CAPABILITIES] = { GL_DEPTH_TEST, GL_BLEND, GL_CULL_FACE, GL_SCISSOR_TEST,
+            GL_STENCIL_TEST, GL_MULTISAMPLE, GL_POLYGON_OFFSET_FILL, GL_TEXTURE_CUBE_MAP_SEAMLESS };
+        for (unsigned int c = 0; c < CAPABILITIES; c++)
+        {
+            if (tracked[c] != capability)
+                continue;
+            if (state().Capabilities[c] == enabled)
+            {
+                filtered(Filtered().Capabilities);
+                return false;
+            }
+            state().Capabilities[c] = enabled;
+            return true;
+        }
+        return true;
+    }
+};
+
+#undef glUseProgram
+#define glUseProgram(program) GLState::UseProgram(program)
+#undef glBindVertexArray
+#define glBindVertexArray(vertexArray) GLState::BindVertexArray(vertexArray)
+#undef glActiveTexture
+#define glActiveTexture(unit) GLState::ActiveTexture(unit)
+#undef glBindTexture
+#define glBindTexture(target, texture) GLState::BindTexture(target, texture)
+#undef glBindFramebuffer
+#define glBindFramebuffer(target, framebuffer) GLState::BindFramebuffer(target, framebuffer)
+#undef glViewport
+#define glViewport(x, y, width, height) GLState::Viewport(x, y, width, height)
+#undef glEnable
+#define glEnable(capability) GLState::Enable(capability)
+#undef glDisable
+#define glDisable(capability) GLState::Disable(capability)
+#undef glUniform1i
+#define glUniform1i(location, value) GLState::Uniform1i(location, value)
+#undef glDeleteTextures
+#define glDeleteTextures(count, textures) GLState::DeleteTextures(count, textures)
+#undef glDeleteVertexArrays
+#define glDeleteVertexArrays(count, vertexArrays) GLState::DeleteVertexArrays(count, vertexArrays)
+#undef glDeleteFramebuffers
+#define glDeleteFramebuffers(count, framebuffers) GLState::DeleteFramebuffers(count, framebuffers)
+#undef glDeleteProgram
+#define glDeleteProgram(program) GLState::DeleteProgram(program)
+#endif
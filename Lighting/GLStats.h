@@ -0,0 +1,240 @@
+#ifndef GL_STATS_H
+#define GL_STATS_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Debug builds count the GL calls made after this header is included: the glad entry points below are
+// redefined to bump a counter and forward the call. Release builds (NDEBUG), or any build defining
+// GL_STATS_DISABLED, leave glad's names alone, so the counting compiles out entirely.
+#if !defined(NDEBUG) && !defined(GL_STATS_DISABLED)
+#define GL_STATS
+#endif
+
+// Default GL stats values
+const unsigned int GL_STATS_TEXTURE_UNITS = 32; // units whose bindings are tracked
+
+// the GL work of one frame
+struct GLFrameStats {
+    unsigned long long DrawCalls = 0;
+    unsigned long long Triangles = 0;        // of the direct draws, the indirect ones are culled on the GPU
+    unsigned long long IndirectCommands = 0; // draws submitted through multi-draw indirect
+    unsigned long long ProgramSwitches = 0;
+    unsigned long long TextureBinds = 0;
+    unsigned long long VertexArrayBinds = 0;
+    unsigned long long RedundantBinds = 0;   // programs, textures and VAOs bound where they already were
+    unsigned long long FilteredCalls = 0;    // dropped by the GLState.h cache before reaching the driver
+    unsigned long long UniformUpdates = 0;
+    unsigned long long BufferUploads = 0;
+    unsigned long long UploadedBytes = 0;
+};
+
+#ifdef GL_STATS
+// the counters of the frame in flight, and the bindings they are compared against
+class GLStats
+{
+public:
+    static GLFrameStats& Current()
+    {
+        static GLFrameStats stats;
+        return stats;
+    }
+
+    static void Draw(GLenum mode, GLsizei count, GLsizei instances)
+    {
+        Current().DrawCalls++;
+        if (mode == GL_TRIANGLES)
+            Current().Triangles += (unsigned long long)(count / 3) * instances;
+        else if (mode == GL_TRIANGLE_STRIP || mode == GL_TRIANGLE_FAN)
+            Current().Triangles += (unsigned long long)std::max(count - 2, 0) * instances;
+    }
+
+    static void Indirect(GLsizei commands)
+    {
+        Current().DrawCalls++;
+        Current().IndirectCommands += commands;
+    }
+
+    static void UseProgram(GLuint program)
+    {
+        if (program == state().Program)
+            Current().RedundantBinds++;
+        else
+            Current().ProgramSwitches++;
+        state().Program = program;
+    }
+
+    static void ActiveTexture(GLenum unit)
+    {
+        state().Unit = std::min<unsigned int>(unit - GL_TEXTURE0, GL_STATS_TEXTURE_UNITS - 1);
+    }
+
+    static void BindTexture(GLuint texture)
+    {
+        Current().TextureBinds++;
+        // texture names are unique across targets, so the name alone says what the unit holds
+        if (state().Textures[state().Unit] == texture)
+            Current().RedundantBinds++;
+        state().Textures[state().Unit] = texture;
+    }
+
+    static void BindVertexArray(GLuint vertexArray)
+    {
+        Current().VertexArrayBinds++;
+        if (vertexArray == state().VertexArray)
+            Current().RedundantBinds++;
+        state().VertexArray = vertexArray;
+    }
+
+    static void Uniform()
+    {
+        Current().UniformUpdates++;
+    }
+
+    static void Upload(GLsizeiptr bytes)
+    {
+        Current().BufferUploads++;
+        Current().UploadedBytes += bytes;
+    }
+
+    // glBufferData without data only allocates
+    static void BufferData(GLsizeiptr bytes, const void* data)
+    {
+        if (data)
+            Upload(bytes);
+    }
+
+private:
+    struct Bindings {
+        GLuint Program = 0, VertexArray = 0;
+        unsigned int Unit = 0;
+        GLuint Textures[GL_STATS_TEXTURE_UNITS] = {};
+    };
+
+    static Bindings& state()
+    {
+        static Bindings bindings;
+        return bindings;
+    }
+};
+
+// the frames of a run, for the CSV and the summary at exit
+class GLStatsLog
+{
+public:
+    void BeginFrame()
+    {
+        GLStats::Current() = GLFrameStats();
+    }
+
+    void EndFrame()
+    {
+        frames.push_back(GLStats::Current());
+    }
+
+    void Summary(std::ostream& out) const
+    {
+        if (frames.empty())
+            return;
+        out << "GL calls per frame over " << frames.size() << " frames (average / max):" << std::endl;
+        for (unsigned int c = 0; c < counters().size(); c++)
+        {
+            unsigned long long GLFrameStats::* counter = counters()[c].second;
+            unsigned long long total = 0, peak = 0;
+            for (unsigned int i = 0; i < frames.size(); i++)
+            {
+                total += frames[i].*counter;
+                peak = std::max(peak, frames[i].*counter);
+            }
+            out << "  " << counters()[c].first << ": " << total / frames.size() << " / " << peak << std::endl;
+        }
+    }
+
+    bool WriteCSV(const std::string& path) const
+    {
+        std::ofstream file(path.c_str());
+        file << "frame";
+        for (unsigned int c = 0; c < counters().size(); c++)
+            file << "," << counters()[c].first;
+        file << std::endl;
+        for (unsigned int i = 0; i < frames.size(); i++)
+        {
+            file << i;
+            for (unsigned int c = 0; c < counters().size(); c++)
+                file << "," << frames[i].*counters()[c].second;
+            file << std::endl;
+        }
+        return file.good();
+    }
+
+private:
+    std::vector<GLFrameStats> frames;
+
+    typedef std::vector<std::pair<const char*, unsigned long long GLFrameStats::*>> Counters;
+
+    // the CSV column of every counter
+    static const Counters& counters()
+    {
+        static const Counters list = {
+            { "draw_calls", &GLFrameStats::DrawCalls }, { "triangles", &GLFrameStats::Triangles },
+            { "indirect_commands", &GLFrameStats::IndirectCommands }, { "program_switches", &GLFrameStats::ProgramSwitches },
+            { "texture_binds", &GLFrameStats::TextureBinds }, { "vao_binds", &GLFrameStats::VertexArrayBinds },
+            { "redundant_binds", &GLFrameStats::RedundantBinds }, { "filtered_calls", &GLFrameStats::FilteredCalls },
+            { "uniform_updates", &GLFrameStats::UniformUpdates },
+            { "buffer_uploads", &GLFrameStats::BufferUploads }, { "uploaded_bytes", &GLFrameStats::UploadedBytes }
+        };
+        return list;
+    }
+};
+
+#undef glDrawArrays
+#define glDrawArrays(mode, first, count) (GLStats::Draw(mode, count, 1), glad_glDrawArrays(mode, first, count))
+#undef glDrawElements
+#define glDrawElements(mode, count, type, indices) (GLStats::Draw(mode, count, 1), glad_glDrawElements(mode, count, type, indices))
+#undef glDrawArraysInstanced
+#define glDrawArraysInstanced(mode, first, count, instances) (GLStats::Draw(mode, count, instances), glad_glDrawArraysInstanced(mode, first, count, instances))
+#undef glDrawElementsInstanced
+#define glDrawElementsInstanced(mode, count, type, indices, instances) (GLStats::Draw(mode, count, instances), glad_glDrawElementsInstanced(mode, count, type, indices, instances))
+#undef glUseProgram
+#define glUseProgram(program) (GLStats::UseProgram(program), glad_glUseProgram(program))
+#undef glActiveTexture
+#define glActiveTexture(unit) (GLStats::ActiveTexture(unit), glad_glActiveTexture(unit))
+#undef glBindTexture
+#define glBindTexture(target, texture) (GLStats::BindTexture(texture), glad_glBindTexture(target, texture))
+#undef glBindVertexArray
+#define glBindVertexArray(vertexArray) (GLStats::BindVertexArray(vertexArray), glad_glBindVertexArray(vertexArray))
+#undef glUniform1i
+#define glUniform1i(location, x) (GLStats::Uniform(), glad_glUniform1i(location, x))
+#undef glUniform1f
+#define glUniform1f(location, x) (GLStats::Uniform(), glad_glUniform1f(location, x))
+#undef glUniform2f
+#define glUniform2f(location, x, y) (GLStats::Uniform(), glad_glUniform2f(location, x, y))
+#undef glUniform3f
+#define glUniform3f(location, x, y, z) (GLStats::Uniform(), glad_glUniform3f(location, x, y, z))
+#undef glUniform3fv
+#define glUniform3fv(location, count, value) (GLStats::Uniform(), glad_glUniform3fv(location, count, value))
+#undef glUniform4fv
+#define glUniform4fv(location, count, value) (GLStats::Uniform(), glad_glUniform4fv(location, count, value))
+#undef glUniformMatrix4fv
+#define glUniformMatrix4fv(location, count, transpose, value) (GLStats::Uniform(), glad_glUniformMatrix4fv(location, count, transpose, value))
+#undef glBufferData
+#define glBufferData(target, size, data, usage) (GLStats::BufferData(size, data), glad_glBufferData(target, size, data, usage))
+#undef glBufferSubData
+#define glBufferSubData(target, offset, size, data) (GLStats::Upload(size), glad_glBufferSubData(target, offset, size, data))
+
+// for the calls that don't go through glad
+#define GL_STATS_INDIRECT(commands) GLStats::Indirect(commands)
+#define GL_STATS_UPLOAD(bytes) GLStats::Upload(bytes)
+#define GL_STATS_FILTERED() GLStats::Current().FilteredCalls++
+#else
+#define GL_STATS_INDIRECT(commands)
+#define GL_STATS_UPLOAD(bytes)
+#define GL_STATS_FILTERED()
+#endif
+#endif
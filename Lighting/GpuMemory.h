@@ -0,0 +1,340 @@
+#ifndef GPU_MEMORY_H
+#define GPU_MEMORY_H
+
+#include <glad/glad.h>
+#include "GLStats.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <map>
+
+#ifndef GL_SHADER_STORAGE_BUFFER
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#endif
+#ifndef GL_SHADER_STORAGE_BUFFER_BINDING
+#define GL_SHADER_STORAGE_BUFFER_BINDING 0x90D3
+#endif
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+#ifndef GL_DRAW_INDIRECT_BUFFER_BINDING
+#define GL_DRAW_INDIRECT_BUFFER_BINDING 0x8F43
+#endif
+
+// what an allocation is for, set with a GpuMemoryScope around the code that allocates it
+enum GpuMemoryCategory {
+    GPU_MEMORY_OTHER,    // untagged
+    GPU_MEMORY_SHADOW,
+    GPU_MEMORY_GBUFFER,
+    GPU_MEMORY_POST,     // lighting, bloom and the other full-screen targets
+    GPU_MEMORY_MATERIAL, // textures loaded from disk
+    GPU_MEMORY_GEOMETRY, // vertex, index, instance and draw command buffers
+    GPU_MEMORY_DYNAMIC,  // per-frame data streamed every frame
+    GPU_MEMORY_CATEGORIES
+};
+const char* const GPU_MEMORY_NAMES[] = { "other", "shadow", "G-Buffer", "post", "material", "geometry", "dynamic" };
+
+// Default GPU memory values
+const unsigned int GPU_MEMORY_BUDGET_MB = 1024;
+
+// bytes per texel of the formats the renderer uses
+inline unsigned int TextureFormatBytes(GLint internalFormat)
+{
+    switch (internalFormat)
+    {
+    case GL_RGBA32F: return 16;
+    case GL_RGBA16F: case GL_RG32F: case GL_RGBA16: return 8;
+    case GL_RGB16F: return 6;
+    case GL_DEPTH_COMPONENT16: case GL_RG8: case GL_R16F: return 2;
+    case GL_RED: case GL_R8: return 1;
+    default: return 4; // RGBA8, RGB8 (padded by most drivers), RG16, R11F_G11F_B10F, 24/32-bit depth
+    }
+}
+
+// Accounts for the memory behind every texture, renderbuffer and buffer. Like GLStats.h this header
+// redefines the glad entry points that allocate or free storage, finds the object they act on from the
+// current binding and charges its size to the category in effect. Current and peak bytes are kept per
+// category, and crossing the budget prints a warning with the breakdown. The sizes are what the
+// formats need, drivers add their own padding and compression on top.
+class GpuMemory
+{
+public:
+    static GpuMemoryCategory& Category()
+    {
+        static GpuMemoryCategory category = GPU_MEMORY_OTHER;
+        return category;
+    }
+
+    static unsigned long long& BudgetBytes()
+    {
+        static unsigned long long budget = (unsigned long long)GPU_MEMORY_BUDGET_MB << 20;
+        return budget;
+    }
+
+    static unsigned long long CurrentBytes(GpuMemoryCategory category)
+    {
+        return totals().Current[category];
+    }
+
+    static unsigned long long PeakBytes(GpuMemoryCategory category)
+    {
+        return totals().Peak[category];
+    }
+
+    static void Report(std::ostream& out)
+    {
+        const Totals& t = totals();
+        std::streamsize precision = out.precision();
+        unsigned long long current = 0;
+        out << "GPU memory (MB, current / peak, objects):" << std::endl;
+        for (unsigned int c = 0; c < GPU_MEMORY_CATEGORIES; c++)
+        {
+            current += t.Current[c];
+            out << "  " << std::left << std::setw(10) << GPU_MEMORY_NAMES[c] << std::right << std::fixed << std::setprecision(1)
+                << megabytes(t.Current[c]) << " / " << megabytes(t.Peak[c]) << ", " << t.Objects[c] << std::endl;
+        }
+        out << "  total     " << megabytes(current) << " / " << megabytes(t.TotalPeak) << " of a " << megabytes(BudgetBytes())
+            << " budget" << std::defaultfloat << std::setprecision(precision) << std::endl;
+    }
+
+    static void TexImage2D(GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLint border,
+        GLenum format, GLenum type, const void* data)
+    {
+        glTexImage2D(target, level, internalFormat, width, height, border, format, type, data);
+        GLenum binding = GL_TEXTURE_BINDING_2D;
+        unsigned int face = 0;
+        if (target >= GL_TEXTURE_CUBE_MAP_POSITIVE_X && target <= GL_TEXTURE_CUBE_MAP_NEGATIVE_Z)
+        {
+            binding = GL_TEXTURE_BINDING_CUBE_MAP;
+            face = target - GL_TEXTURE_CUBE_MAP_POSITIVE_X;
+        }
+        Allocation& texture = allocation(TEXTURE, bound(binding));
+        texture.Images[(level << 3) | face] = (unsigned long long)width * height * TextureFormatBytes(internalFormat);
+        resize(texture);
+    }
+
+    static void TexImage3D(GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLsizei depth,
+        GLint border, GLenum format, GLenum type, const void* data)
+    {
+        glTexImage3D(target, level, internalFormat, width, height, depth, border, format, type, data);
+        Allocation& texture = allocation(TEXTURE, bound(target == GL_TEXTURE_3D ? GL_TEXTURE_BINDING_3D : GL_TEXTURE_BINDING_2D_ARRAY));
+        texture.Images[level << 3] = (unsigned long long)width * height * depth * TextureFormatBytes(internalFormat);
+        resize(texture);
+    }
+
+    static void GenerateMipmap(GLenum target)
+    {
+        glGenerateMipmap(target);
+        GLenum binding = target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_BINDING_CUBE_MAP
+            : target == GL_TEXTURE_2D_ARRAY ? GL_TEXTURE_BINDING_2D_ARRAY : GL_TEXTURE_BINDING_2D;
+        Allocation& texture = allocation(TEXTURE, bound(binding));
+        texture.Mipmapped = true;
+        resize(texture);
+    }
+
+    static void RenderbufferStorage(GLenum target, GLenum internalFormat, GLsizei width, GLsizei height)
+    {
+        glRenderbufferStorage(target, internalFormat, width, height);
+        renderbuffer(internalFormat, width, height, 1);
+    }
+
+    static void RenderbufferStorageMultisample(GLenum target, GLsizei samples, GLenum internalFormat, GLsizei width, GLsizei height)
+    {
+        glRenderbufferStorageMultisample(target, samples, internalFormat, width, height);
+        renderbuffer(internalFormat, width, height, samples);
+    }
+
+    static void BufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage)
+    {
+        glBufferData(target, size, data, usage);
+        Storage(target, size);
+    }
+
+    // storage allocated without glBufferData, e.g. glBufferStorage, for the buffer bound to target
+    static void Storage(GLenum target, GLsizeiptr size)
+    {
+        GLenum binding;
+        switch (target)
+        {
+        case GL_ELEMENT_ARRAY_BUFFER: binding = GL_ELEMENT_ARRAY_BUFFER_BINDING; break;
+        case GL_UNIFORM_BUFFER: binding = GL_UNIFORM_BUFFER_BINDING; break;
+        case GL_SHADER_STORAGE_BUFFER: binding = GL_SHADER_STORAGE_BUFFER_BINDING; break;
+        case GL_DRAW_INDIRECT_BUFFER: binding = GL_DRAW_INDIRECT_BUFFER_BINDING; break;
+        case GL_COPY_READ_BUFFER: case GL_COPY_WRITE_BUFFER: binding = target; break;
+        default: binding = GL_ARRAY_BUFFER_BINDING; break;
+        }
+        Allocation& buffer = allocation(BUFFER, bound(binding));
+        buffer.Images[0] = size;
+        resize(buffer);
+    }
+
+    static void DeleteTextures(GLsizei count, const GLuint* textures)
+    {
+        release(TEXTURE, count, textures);
+        glDeleteTextures(count, textures);
+    }
+
+    static void DeleteRenderbuffers(GLsizei count, const GLuint* renderbuffers)
+    {
+        release(RENDERBUFFER, count, renderbuffers);
+        glDeleteRenderbuffers(count, renderbuffers);
+    }
+
+    static void DeleteBuffers(GLsizei count, const GLuint* buffers)
+    {
+        release(BUFFER, count, buffers);
+        glDeleteBuffers(count, buffers);
+    }
+
+private:
+    enum Kind { TEXTURE, RENDERBUFFER, BUFFER };
+
+    struct Allocation {
+        GpuMemoryCategory Category = GPU_MEMORY_OTHER;
+        std::map<unsigned int, unsigned long long> Images; // bytes by mip level << 3 | cube face
+        bool Mipmapped = false;
+        unsigned long long Bytes = 0; // what is charged to the category
+    };
+
+    struct Totals {
+        unsigned long long Current[GPU_MEMORY_CATEGORIES] = {};
+        unsigned long long Peak[GPU_MEMORY_CATEGORIES] = {};
+        unsigned int Objects[GPU_MEMORY_CATEGORIES] = {};
+        unsigned long long TotalPeak = 0;
+        bool OverBudget = false;
+    };
+
+    static Totals& totals()
+    {
+        static Totals t;
+        return t;
+    }
+
+    static std::map<unsigned long long, Allocation>& allocations()
+    {
+        static std::map<unsigned long long, Allocation> all;
+        return all;
+    }
+
+    static double megabytes(unsigned long long bytes)
+    {
+        return bytes / (1024.0 * 1024.0);
+    }
+
+    static GLuint bound(GLenum binding)
+    {
+        GLint name = 0;
+        glGetIntegerv(binding, &name);
+        return name;
+    }
+
+    // the allocation behind an object, a new one is charged to the current category
+    static Allocation& allocation(Kind kind, GLuint name)
+    {
+        unsigned long long key = ((unsigned long long)kind << 32) | name;
+        std::map<unsigned long long, Allocation>::iterator found = allocations().find(key);
+        if (found != allocations().end())
+            return found->second;
+        Allocation& created = allocations()[key];
+        created.Category = Category();
+        totals().Objects[created.Category]++;
+        return created;
+    }
+
+    static void renderbuffer(GLenum internalFormat, GLsizei width, GLsizei height, GLsizei samples)
+    {
+        Allocation& renderbuffer = allocation(RENDERBUFFER, bound(GL_RENDERBUFFER_BINDING));
+        renderbuffer.Images[0] = (unsigned long long)width * height * TextureFormatBytes(internalFormat) * std::max(samples, 1);
+        resize(renderbuffer);
+    }
+
+    // recharges an allocation after its images changed, a full mip chain adds a third to the top level
+    static void resize(Allocation& a)
+    {
+        unsigned long long bytes = 0;
+        for (std::map<unsigned int, unsigned long long>::iterator image = a.Images.begin(); image != a.Images.end(); ++image)
+        {
+            bool topLevel = (image->first >> 3) == 0;
+            if (!a.Mipmapped)
+                bytes += image->second;
+            else if (topLevel)
+                bytes += image->second + image->second / 3;
+        }
+        charge(a.Category, bytes, a.Bytes);
+        a.Bytes = bytes;
+    }
+
+    static void release(Kind kind, GLsizei count, const GLuint* names)
+    {
+        for (GLsizei i = 0; i < count; i++)
+        {
+            std::map<unsigned long long, Allocation>::iterator found = allocations().find(((unsigned long long)kind << 32) | names[i]);
+            if (found == allocations().end())
+                continue;
+            charge(found->second.Category, 0, found->second.Bytes);
+            totals().Objects[found->second.Category]--;
+            allocations().erase(found);
+        }
+    }
+
+    static void charge(GpuMemoryCategory category, unsigned long long bytes, unsigned long long previous)
+    {
+        Totals& t = totals();
+        t.Current[category] += bytes - previous;
+        t.Peak[category] = std::max(t.Peak[category], t.Current[category]);
+        unsigned long long current = 0;
+        for (unsigned int c = 0; c < GPU_MEMORY_CATEGORIES; c++)
+            current += t.Current[c];
+        t.TotalPeak = std::max(t.TotalPeak, current);
+        // warn once per crossing
+        if (current > BudgetBytes() && !t.OverBudget)
+        {
+            std::cout << "WARNING::GPU_MEMORY::Over the " << megabytes(BudgetBytes()) << " MB budget after a "
+                << GPU_MEMORY_NAMES[category] << " allocation" << std::endl;
+            Report(std::cout);
+        }
+        t.OverBudget = current > BudgetBytes();
+    }
+};
+
+// tags the allocations made in the enclosing block
+class GpuMemoryScope
+{
+public:
+    GpuMemoryScope(GpuMemoryCategory category) : previous(GpuMemory::Category())
+    {
+        GpuMemory::Category() = category;
+    }
+
+    ~GpuMemoryScope()
+    {
+        GpuMemory::Category() = previous;
+    }
+
+private:
+    GpuMemoryCategory previous;
+};
+
+#undef glTexImage2D
+#define glTexImage2D(target, level, internalFormat, width, height, border, format, type, data) \
+    GpuMemory::TexImage2D(target, level, internalFormat, width, height, border, format, type, data)
+#undef glTexImage3D
+#define glTexImage3D(target, level, internalFormat, width, height, depth, border, format, type, data) \
+    GpuMemory::TexImage3D(target, level, internalFormat, width, height, depth, border, format, type, data)
+#undef glGenerateMipmap
+#define glGenerateMipmap(target) GpuMemory::GenerateMipmap(target)
+#undef glRenderbufferStorage
+#define glRenderbufferStorage(target, internalFormat, width, height) GpuMemory::RenderbufferStorage(target, internalFormat, width, height)
+#undef glRenderbufferStorageMultisample
+#define glRenderbufferStorageMultisample(target, samples, internalFormat, width, height) \
+    GpuMemory::RenderbufferStorageMultisample(target, samples, internalFormat, width, height)
+#undef glBufferData
+#define glBufferData(target, size, data, usage) GpuMemory::BufferData(target, size, data, usage)
+#undef glDeleteTextures
+#define glDeleteTextures(count, textures) GpuMemory::DeleteTextures(count, textures)
+#undef glDeleteRenderbuffers
+#define glDeleteRenderbuffers(count, renderbuffers) GpuMemory::DeleteRenderbuffers(count, renderbuffers)
+#undef glDeleteBuffers
+#define glDeleteBuffers(count, buffers) GpuMemory::DeleteBuffers(count, buffers)
+#endif
@@ -0,0 +1,103 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include <glad/glad.h>
+
+#include <utility>
+#include <vector>
+
+// Default timer values
+const unsigned int GPU_TIMER_QUERIES = 3; // frames a result may take to come back before its query is reused
+
+// GPU time of a block of commands from a pair of GL_TIMESTAMP queries. Results are read back a few
+// frames late so the CPU never waits on the GPU, and averaged until Reset(). Unlike GL_TIME_ELAPSED,
+// timestamps let timers nest (the whole frame around the bloom passes).
+class GpuTimer
+{
+public:
+    bool KeepResults = false; // also keep every result with the index of its Begin()/End() pair
+
+    GpuTimer()
+    {
+        glGenQueries(GPU_TIMER_QUERIES, startQueries);
+        glGenQueries(GPU_TIMER_QUERIES, endQueries);
+    }
+
+    void Begin()
+    {
+        // a result that never arrived is dropped rather than waited on
+        pending[current] = false;
+        glQueryCounter(startQueries[current], GL_TIMESTAMP);
+    }
+
+    void End()
+    {
+        glQueryCounter(endQueries[current], GL_TIMESTAMP);
+        pending[current] = true;
+        index[current] = issued++;
+        current = (current + 1) % GPU_TIMER_QUERIES;
+        collect();
+    }
+
+    // average milliseconds over the results collected since the last Reset()
+    double AverageMs() const
+    {
+        return samples > 0 ? totalNs / 1.0e6 / samples : 0.0;
+    }
+
+    unsigned int Samples() const
+    {
+        return samples;
+    }
+
+    // the kept results, pair index and milliseconds, in the order they came back
+    const std::vector<std::pair<unsigned int, double>>& Results() const
+    {
+        return results;
+    }
+
+    // picks up whatever results have arrived, End() already does this every time
+    void Collect()
+    {
+        collect();
+    }
+
+    void Reset()
+    {
+        totalNs = 0.0;
+        samples = 0;
+    }
+
+private:
+    unsigned int startQueries[GPU_TIMER_QUERIES], endQueries[GPU_TIMER_QUERIES];
+    bool pending[GPU_TIMER_QUERIES] = {};
+    unsigned int index[GPU_TIMER_QUERIES] = {};
+    unsigned int issued = 0;
+    std::vector<std::pair<unsigned int, double>> results;
+    unsigned int current = 0;
+    double totalNs = 0.0;
+    unsigned int samples = 0;
+
+    void collect()
+    {
+        for (unsigned int i = 0; i < GPU_TIMER_QUERIES; i++)
+        {
+            if (!pending[i])
+                continue;
+            // the end timestamp lands after the start one
+            GLint available = 0;
+            glGetQueryObjectiv(endQueries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                continue;
+            GLuint64 start = 0, end = 0;
+            glGetQueryObjectui64v(startQueries[i], GL_QUERY_RESULT, &start);
+            glGetQueryObjectui64v(endQueries[i], GL_QUERY_RESULT, &end);
+            totalNs += (double)(end - start);
+            samples++;
+            if (KeepResults)
+                results.push_back(std::make_pair(index[i], (double)(end - start) / 1.0e6));
+            pending[i] = false;
+        }
+    }
+};
+#endif
@@ -0,0 +1,165 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Writes captured frames without pulling in an image library: 8-bit RGBA PNGs with stored (uncompressed)
+// deflate blocks, and uncompressed 32-bit float RGB OpenEXR files for HDR targets. Rows come in the
+// order glReadPixels/glGetTexImage return them, bottom first, and are flipped on the way out.
+namespace ImageWriter
+{
+    inline void putBigEndian(std::vector<unsigned char>& out, uint32_t value)
+    {
+        for (int i = 3; i >= 0; i--)
+            out.push_back((value >> (8 * i)) & 0xff);
+    }
+
+    template <typename T>
+    inline void putLittleEndian(std::vector<unsigned char>& out, T value)
+    {
+        const unsigned char* bytes = (const unsigned char*)&value;
+        out.insert(out.end(), bytes, bytes + sizeof(T));
+    }
+
+    inline uint32_t crc32(const unsigned char* data, size_t size, uint32_t crc = 0)
+    {
+        crc = ~crc;
+        for (size_t i = 0; i < size; i++)
+        {
+            crc ^= data[i];
+            for (int k = 0; k < 8; k++)
+                crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+        }
+        return ~crc;
+    }
+
+    inline void putChunk(std::vector<unsigned char>& out, const char* type, const std::vector<unsigned char>& data)
+    {
+        putBigEndian(out, (uint32_t)data.size());
+        size_t start = out.size();
+        out.insert(out.end(), type, type + 4);
+        out.insert(out.end(), data.begin(), data.end());
+        putBigEndian(out, crc32(&out[start], out.size() - start));
+    }
+
+    inline bool writeFile(const std::string& path, const std::vector<unsigned char>& bytes)
+    {
+        std::ofstream file(path.c_str(), std::ios::binary);
+        file.write((const char*)&bytes[0], bytes.size());
+        return file.good();
+    }
+
+    // rgba holds width * height * 4 bytes, bottom row first
+    inline bool WritePNG(const std::string& path, unsigned int width, unsigned int height, const std::vector<unsigned char>& rgba)
+    {
+        if (width == 0 || height == 0 || rgba.size() < (size_t)width * height * 4)
+            return false;
+        std::vector<unsigned char> png = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+        std::vector<unsigned char> header;
+        putBigEndian(header, width);
+        putBigEndian(header, height);
+        header.insert(header.end(), { 8, 6, 0, 0, 0 }); // 8 bits, RGBA, deflate, no filtering, no interlace
+        putChunk(png, "IHDR", header);
+
+        // scanlines top first, each behind a "no filter" byte
+        std::vector<unsigned char> raw;
+        for (unsigned int y = 0; y < height; y++)
+        {
+            raw.push_back(0);
+            const unsigned char* row = &rgba[(size_t)(height - 1 - y) * width * 4];
+            raw.insert(raw.end(), row, row + width * 4);
+        }
+        // a zlib stream of stored blocks, at most 65535 bytes each
+        std::vector<unsigned char> zlib = { 0x78, 0x01 };
+        uint32_t a = 1, b = 0;
+        for (size_t i = 0; i < raw.size(); i++)
+        {
+            a = (a + raw[i]) % 65521;
+            b = (b + a) % 65521;
+        }
+        for (size_t offset = 0; offset < raw.size(); offset += 65535)
+        {
+            uint16_t size = (uint16_t)std::min<size_t>(65535, raw.size() - offset);
+            zlib.push_back(offset + size == raw.size() ? 1 : 0);
+            putLittleEndian<uint16_t>(zlib, size);
+            putLittleEndian<uint16_t>(zlib, (uint16_t)~size);
+            zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + size);
+        }
+        putBigEndian(zlib, (b << 16) | a);
+        putChunk(png, "IDAT", zlib);
+        putChunk(png, "IEND", std::vector<unsigned char>());
+        return writeFile(path, png);
+    }
+
+    inline void putAttribute(std::vector<unsigned char>& out, const char* name, const char* type, const std::vector<unsigned char>& value)
+    {
+        out.insert(out.end(), name, name + std::char_traits<char>::length(name) + 1);
+        out.insert(out.end(), type, type + std::char_traits<char>::length(type) + 1);
+        putLittleEndian<int32_t>(out, (int32_t)value.size());
+        out.insert(out.end(), value.begin(), value.end());
+    }
+
+    // rgba holds width * height * 4 floats, bottom row first; alpha is dropped
+    inline bool WriteEXR(const std::string& path, unsigned int width, unsigned int height, const std::vector<float>& rgba)
+    {
+        if (width == 0 || height == 0 || rgba.size() < (size_t)width * height * 4)
+            return false;
+        std::vector<unsigned char> exr;
+        putLittleEndian<uint32_t>(exr, 20000630); // magic number
+        putLittleEndian<uint32_t>(exr, 2);        // version 2, single part scanline file
+
+        // channels are stored in alphabetical order
+        const char* channelNames[3] = { "B", "G", "R" };
+        const unsigned int channelOffsets[3] = { 2, 1, 0 };
+        std::vector<unsigned char> channels;
+        for (unsigned int c = 0; c < 3; c++)
+        {
+            channels.push_back(channelNames[c][0]);
+            channels.push_back(0);
+            putLittleEndian<int32_t>(channels, 2); // FLOAT
+            channels.insert(channels.end(), { 0, 0, 0, 0 }); // pLinear, reserved
+            putLittleEndian<int32_t>(channels, 1);
+            putLittleEndian<int32_t>(channels, 1);
+        }
+        channels.push_back(0);
+        std::vector<unsigned char> window;
+        putLittleEndian<int32_t>(window, 0);
+        putLittleEndian<int32_t>(window, 0);
+        putLittleEndian<int32_t>(window, width - 1);
+        putLittleEndian<int32_t>(window, height - 1);
+        std::vector<unsigned char> one, center;
+        putLittleEndian<float>(one, 1.0f);
+        putLittleEndian<float>(center, 0.0f);
+        putLittleEndian<float>(center, 0.0f);
+        putAttribute(exr, "channels", "chlist", channels);
+        putAttribute(exr, "compression", "compression", { 0 });
+        putAttribute(exr, "dataWindow", "box2i", window);
+        putAttribute(exr, "displayWindow", "box2i", window);
+        putAttribute(exr, "lineOrder", "lineOrder", { 0 });
+        putAttribute(exr, "pixelAspectRatio", "float", one);
+        putAttribute(exr, "screenWindowCenter", "v2f", center);
+        putAttribute(exr, "screenWindowWidth", "float", one);
+        exr.push_back(0);
+
+        // one scanline per block: the offset table, then y, the byte count and each channel's row
+        uint32_t lineBytes = width * 3 * sizeof(float);
+        uint64_t offset = exr.size() + (uint64_t)height * sizeof(uint64_t);
+        for (unsigned int y = 0; y < height; y++)
+            putLittleEndian<uint64_t>(exr, offset + (uint64_t)y * (8 + lineBytes));
+        for (unsigned int y = 0; y < height; y++)
+        {
+            putLittleEndian<int32_t>(exr, y);
+            putLittleEndian<uint32_t>(exr, lineBytes);
+            const float* row = &rgba[(size_t)(height - 1 - y) * width * 4];
+            for (unsigned int c = 0; c < 3; c++)
+                for (unsigned int x = 0; x < width; x++)
+                    putLittleEndian<float>(exr, row[x * 4 + channelOffsets[c]]);
+        }
+        return writeFile(path, exr);
+    }
+}
+#endif
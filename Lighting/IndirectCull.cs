@@ -0,0 +1,55 @@
+#version 430 core
+layout (local_size_x = 64) in;
+
+// matches DrawElementsIndirectCommand in IndirectDraw.h
+struct DrawCommand {
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    int baseVertex;
+    uint baseInstance;
+};
+
+// three per command: box centre, box extent, bounding sphere (centre and radius), all in world space
+layout (std430, binding = 0) readonly buffer Bounds {
+    vec4 bounds[];
+};
+layout (std430, binding = 1) readonly buffer Commands {
+    DrawCommand commands[];
+};
+layout (std430, binding = 2) writeonly buffer Culled {
+    DrawCommand culled[];
+};
+// the CPU's visibility of each command (frustum and occlusion culling), only read when masked
+layout (std430, binding = 3) readonly buffer Mask {
+    uint mask[];
+};
+
+uniform vec4 planes[6]; // left, right, bottom, top, near, far, pointing inwards
+uniform int commandCount;
+uniform int firstCulled; // where this view's commands start in culled
+uniform int masked;
+
+void main()
+{
+    int i = int(gl_GlobalInvocationID.x);
+    if (i >= commandCount)
+        return;
+
+    vec3 center = bounds[3 * i].xyz;
+    vec3 extent = bounds[3 * i + 1].xyz;
+    vec4 sphere = bounds[3 * i + 2];
+    // the same test as Frustum::CullBatch, outside if the box or the sphere is behind any plane
+    bool visible = masked == 0 || mask[i] != 0u;
+    for (int p = 0; p < 6; p++)
+    {
+        vec3 normal = planes[p].xyz;
+        if (dot(normal, center) + planes[p].w < -dot(abs(normal), extent) || dot(normal, sphere.xyz) + planes[p].w < -sphere.w)
+            visible = false;
+    }
+
+    // culled commands keep their place with no instances, so every material's range stays where it was
+    DrawCommand command = commands[i];
+    command.instanceCount = visible ? 1u : 0u;
+    culled[firstCulled + i] = command;
+}
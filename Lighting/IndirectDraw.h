@@ -0,0 +1,309 @@
+#ifndef INDIRECT_DRAW_H
+#define INDIRECT_DRAW_H
+
+#include <glad/glad.h>
+#include <glfw/glfw3.h>
+
+#include <glm/glm.hpp>
+
+#include "Frustum.h"
+#include "GLStats.h"
+#include "Mesh.h"
+#include "MeshInstancing.h"
+#include "Shader.h"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+// glad is generated for GL 3.3, the 4.3 entry points and enums are loaded by hand
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+#ifndef GL_SHADER_STORAGE_BUFFER
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#endif
+#ifndef GL_COMMAND_BARRIER_BIT
+#define GL_COMMAND_BARRIER_BIT 0x00000040
+#endif
+
+// Default indirect draw values
+const unsigned int INDIRECT_VIEWS = 64;      // culled command lists before one is overwritten, a few frames of cameras and shadow views
+const unsigned int INDIRECT_GROUP_SIZE = 64; // local_size_x of IndirectCull.cs
+
+// which of a model's commands a draw covers
+enum IndirectGroup {
+    INDIRECT_ALL,
+    INDIRECT_OPAQUE,
+    INDIRECT_ALPHA_TESTED
+};
+
+// the layout glMultiDrawElementsIndirect reads
+struct DrawElementsIndirectCommand {
+    GLuint Count;
+    GLuint InstanceCount;
+    GLuint FirstIndex;
+    GLint BaseVertex;
+    GLuint BaseInstance;
+};
+
+// GPU-driven drawing of a model's meshes on GL 4.3. Every mesh is copied into one shared vertex and
+// index buffer and gets one draw command, ordered opaque before cutout and then by material. Cull()
+// runs a compute shader that tests every command's bounds against a frustum and writes the list with
+// the hidden ones zeroed, which the passes then submit with glMultiDrawElementsIndirect: one call for
+// a depth only pass whatever the mesh count, and one per material where textures have to be bound.
+// The camera's cull can also take the CPU visibility of every mesh, so the occlusion culler's results
+// reach the indirect path too.
+class IndirectDraw
+{
+public:
+    unsigned int Commands() const
+    {
+        return commands.size();
+    }
+
+    unsigned int Batches() const
+    {
+        return batches.size();
+    }
+
+    // the context is 4.3+ and the entry points loaded
+    static bool Supported()
+    {
+        GLint major = 0, minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        return major * 10 + minor >= 43 && glfwGetProcAddress("glMultiDrawElementsIndirect") && glfwGetProcAddress("glDispatchCompute")
+            && glfwGetProcAddress("glMemoryBarrier");
+    }
+
+    IndirectDraw(std::vector<Mesh>& meshes, Shader& cullShader) : meshes(meshes), cullShader(cullShader)
+    {
+        multiDrawElementsIndirect = (MultiDrawElementsIndirectProc)glfwGetProcAddress("glMultiDrawElementsIndirect");
+        dispatchCompute = (DispatchComputeProc)glfwGetProcAddress("glDispatchCompute");
+        memoryBarrier = (MemoryBarrierProc)glfwGetProcAddress("glMemoryBarrier");
+
+        // opaque first so the depth prepass is one range, then grouped by textures
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            order.push_back(i);
+        std::stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) {
+            if (meshes[a].AlphaTested != meshes[b].AlphaTested)
+                return !meshes[a].AlphaTested;
+            return TextureIds(meshes[a]) < TextureIds(meshes[b]);
+        });
+
+        // one vertex and index buffer for the whole model, with each geometry once however many copies
+        // use it; a command's base instance picks its transform
+        std::vector<Vertex> vertices;
+        std::vector<unsigned int> indices;
+        std::vector<DrawElementsIndirectCommand> geometry(meshes.size());
+        for (unsigned int i = 0; i < meshes.size(); i++)
+        {
+            if (meshes[i].Source >= 0)
+                continue;
+            geometry[i] = { (GLuint)meshes[i].indices.size(), 1, (GLuint)indices.size(), (GLint)vertices.size(), 0 };
+            vertices.insert(vertices.end(), meshes[i].vertices.begin(), meshes[i].vertices.end());
+            indices.insert(indices.end(), meshes[i].indices.begin(), meshes[i].indices.end());
+        }
+        for (unsigned int c = 0; c < order.size(); c++)
+        {
+            const Mesh& mesh = meshes[order[c]];
+            commands.push_back(geometry[mesh.Source >= 0 ? mesh.Source : order[c]]);
+            commands.back().BaseInstance = c;
+            transforms.push_back(mesh.Transform);
+            if (c == 0 || mesh.AlphaTested != meshes[order[c - 1]].AlphaTested || TextureIds(mesh) != TextureIds(meshes[order[c - 1]]))
+                batches.push_back({ c, 0, order[c], mesh.AlphaTested });
+            batches.back().Count++;
+            if (!mesh.AlphaTested)
+                opaqueCommands = c + 1;
+        }
+        setupBuffers(vertices, indices);
+        std::cout << "Indirect draws: " << commands.size() << " commands in " << batches.size() << " material batches" << std::endl;
+    }
+
+    ~IndirectDraw()
+    {
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &EBO);
+        glDeleteBuffers(1, &instanceVBO);
+        glDeleteBuffers(1, &boundsBuffer);
+        glDeleteBuffers(1, &commandBuffer);
+        glDeleteBuffers(1, &culledBuffer);
+        glDeleteBuffers(1, &maskBuffer);
+    }
+
+    // the world-space bounds of every mesh, in mesh order, whenever they change
+    void UpdateBounds(const BoundsBatch& bounds)
+    {
+        if (bounds.Size() != order.size())
+            return;
+        std::vector<glm::vec4> data;
+        for (unsigned int c = 0; c < order.size(); c++)
+        {
+            unsigned int i = order[c];
+            data.push_back(glm::vec4(bounds.CenterX[i], bounds.CenterY[i], bounds.CenterZ[i], 0.0f));
+            data.push_back(glm::vec4(bounds.ExtentX[i], bounds.ExtentY[i], bounds.ExtentZ[i], 0.0f));
+            data.push_back(glm::vec4(bounds.SphereX[i], bounds.SphereY[i], bounds.SphereZ[i], bounds.Radius[i]));
+        }
+        GpuMemoryScope tag(GPU_MEMORY_GEOMETRY);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, boundsBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, data.size() * sizeof(glm::vec4), &data[0], GL_STATIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    // culls every command against the frustum into the next list, which the draws below use; with
+    // visible (per mesh, like DrawList::Visible) the meshes it clears are dropped as well
+    void Cull(const Frustum& frustum, const std::vector<unsigned char>* visible = NULL)
+    {
+        if (commands.empty())
+            return;
+        view = (view + 1) % INDIRECT_VIEWS;
+        bool masked = visible && visible->size() == meshes.size();
+        if (masked)
+        {
+            std::vector<GLuint> mask(commands.size());
+            for (unsigned int c = 0; c < order.size(); c++)
+                mask[c] = (*visible)[order[c]];
+            GpuMemoryScope tag(GPU_MEMORY_DYNAMIC);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, maskBuffer);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, mask.size() * sizeof(GLuint), &mask[0], GL_STREAM_DRAW);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        }
+
+        // called in the middle of passes, so put their program back afterwards
+        GLint program = 0;
+        glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+        cullShader.use();
+        for (unsigned int p = 0; p < 6; p++)
+            cullShader.setVec4("planes[" + std::to_string(p) + "]", frustum.Planes[p]);
+        cullShader.setInt("commandCount", commands.size());
+        cullShader.setInt("firstCulled", view * commands.size());
+        cullShader.setInt("masked", masked ? 1 : 0);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, boundsBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, commandBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, culledBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, maskBuffer);
+        dispatchCompute((commands.size() + INDIRECT_GROUP_SIZE - 1) / INDIRECT_GROUP_SIZE, 1, 1);
+        // the indirect draws read what the shader wrote
+        memoryBarrier(GL_COMMAND_BARRIER_BIT);
+        glUseProgram(program);
+    }
+
+    // the last culled list without textures, one call
+    void DrawGeometry(IndirectGroup group = INDIRECT_ALL)
+    {
+        unsigned int first = group == INDIRECT_ALPHA_TESTED ? opaqueCommands : 0;
+        unsigned int end = group == INDIRECT_OPAQUE ? opaqueCommands : commands.size();
+        glBindVertexArray(VAO);
+        submit(first, end - first);
+        glBindVertexArray(0);
+    }
+
+    // the last culled list with textures, one call per material
+    void Draw(Shader& shader, IndirectGroup group = INDIRECT_ALL)
+    {
+        glBindVertexArray(VAO);
+        for (unsigned int b = 0; b < batches.size(); b++)
+        {
+            if (group != INDIRECT_ALL && batches[b].AlphaTested != (group == INDIRECT_ALPHA_TESTED))
+                continue;
+            meshes[batches[b].MeshIndex].BindTextures(shader);
+            submit(batches[b].First, batches[b].Count);
+        }
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+private:
+    typedef void (APIENTRYP MultiDrawElementsIndirectProc)(GLenum mode, GLenum type, const void* indirect, GLsizei drawcount, GLsizei stride);
+    typedef void (APIENTRYP DispatchComputeProc)(GLuint x, GLuint y, GLuint z);
+    typedef void (APIENTRYP MemoryBarrierProc)(GLbitfield barriers);
+
+    // consecutive commands sharing a material
+    struct Batch {
+        unsigned int First, Count;
+        unsigned int MeshIndex; // whose textures the batch binds
+        bool AlphaTested;
+    };
+
+    std::vector<Mesh>& meshes;
+    Shader& cullShader;
+    std::vector<unsigned int> order; // mesh of each command
+    std::vector<DrawElementsIndirectCommand> commands;
+    std::vector<glm::mat4> transforms; // of each command's mesh
+    std::vector<Batch> batches;
+    unsigned int opaqueCommands = 0;
+    unsigned int view = 0;
+    unsigned int VAO = 0, VBO = 0, EBO = 0, instanceVBO = 0;
+    unsigned int boundsBuffer = 0, commandBuffer = 0, culledBuffer = 0;
+    unsigned int maskBuffer = 0; // the CPU visibility of each command, for a masked Cull()
+
+    MultiDrawElementsIndirectProc multiDrawElementsIndirect;
+    DispatchComputeProc dispatchCompute;
+    MemoryBarrierProc memoryBarrier;
+
+    void submit(unsigned int first, unsigned int count)
+    {
+        if (count == 0)
+            return;
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, culledBuffer);
+        GLintptr offset = (GLintptr)(view * commands.size() + first) * sizeof(DrawElementsIndirectCommand);
+        multiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)offset, count, 0);
+        GL_STATS_INDIRECT(count);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+
+    void setupBuffers(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices)
+    {
+        GpuMemoryScope tag(GPU_MEMORY_GEOMETRY);
+        if (commands.empty())
+            return;
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+        glGenBuffers(1, &instanceVBO);
+        glGenBuffers(1, &boundsBuffer);
+        glGenBuffers(1, &commandBuffer);
+        glGenBuffers(1, &culledBuffer);
+        glGenBuffers(1, &maskBuffer);
+
+        // the same attributes as Mesh::setupMesh
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+        glEnableVertexAttribArray(4);
+        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+        // the per-instance model matrix, fetched at each command's base instance
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, transforms.size() * sizeof(glm::mat4), &transforms[0], GL_STATIC_DRAW);
+        for (unsigned int i = 0; i < 4; i++)
+        {
+            glEnableVertexAttribArray(5 + i);
+            glVertexAttribPointer(5 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(i * sizeof(glm::vec4)));
+            glVertexAttribDivisor(5 + i, 1);
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), &commands[0], GL_STATIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, culledBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, INDIRECT_VIEWS * commands.size() * sizeof(DrawElementsIndirectCommand), NULL, GL_DYNAMIC_COPY);
+        // something has to be bound at binding 3 even when the cull isn't masked
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, maskBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, commands.size() * sizeof(GLuint), NULL, GL_STREAM_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+};
+#endif
@@ -0,0 +1,171 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Default job system values
+const unsigned int JOB_MAX_WORKERS = 7; // on top of the thread that submits
+
+// counts the jobs of a group still running, wait on it with JobSystem::Wait()
+struct JobCounter {
+    std::atomic<int> Pending{ 0 };
+};
+
+// A pool of worker threads, each with its own queue. A worker takes the newest job from its own queue
+// and, when that is empty, steals the oldest job from another queue, so a worker that splits its work
+// keeps the pieces cache-warm while idle workers take the large chunks. Threads waiting on a counter
+// run jobs meanwhile instead of blocking, which lets jobs wait on jobs they spawned.
+class JobSystem
+{
+public:
+    typedef std::function<void()> Job;
+
+    JobSystem(unsigned int workers = 0)
+    {
+        if (workers == 0)
+        {
+            unsigned int cores = std::thread::hardware_concurrency();
+            workers = std::min(JOB_MAX_WORKERS, cores > 1 ? cores - 1 : 1u);
+        }
+        queues = std::vector<Queue>(workers + 1); // the last one is fed by threads outside the pool
+        for (unsigned int i = 0; i < workers; i++)
+            threads.push_back(std::thread(&JobSystem::workerLoop, this, i));
+    }
+
+    ~JobSystem()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            running = false;
+        }
+        wake.notify_all();
+        for (unsigned int i = 0; i < threads.size(); i++)
+            threads[i].join();
+    }
+
+    unsigned int Workers() const
+    {
+        return threads.size();
+    }
+
+    void Run(Job job, JobCounter& counter)
+    {
+        counter.Pending++;
+        Queue& queue = queues[queueIndex()];
+        {
+            std::lock_guard<std::mutex> lock(queue.Mutex);
+            queue.Jobs.push_back({ job, &counter });
+        }
+        {
+            // under the sleep lock, or a worker could check for work just before this and then miss the wake up
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            queued++;
+        }
+        wake.notify_one();
+    }
+
+    // runs body(begin, end) over [0, count) in chunks of at most grain
+    void ParallelFor(unsigned int count, unsigned int grain, std::function<void(unsigned int, unsigned int)> body, JobCounter& counter)
+    {
+        for (unsigned int begin = 0; begin < count; begin += grain)
+        {
+            unsigned int end = std::min(count, begin + grain);
+            Run([body, begin, end]() { body(begin, end); }, counter);
+        }
+    }
+
+    // runs queued jobs until every job of the counter has finished
+    void Wait(JobCounter& counter)
+    {
+        unsigned int self = queueIndex();
+        while (counter.Pending > 0)
+        {
+            if (!runOne(self))
+                std::this_thread::yield();
+        }
+    }
+
+private:
+    struct Entry {
+        Job Work;
+        JobCounter* Counter;
+    };
+
+    struct Queue {
+        std::mutex Mutex;
+        std::deque<Entry> Jobs;
+    };
+
+    std::vector<Queue> queues;
+    std::vector<std::thread> threads;
+    std::atomic<int> queued{ 0 };
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool running = true;
+
+    static int& threadQueue()
+    {
+        thread_local int index = -1;
+        return index;
+    }
+
+    unsigned int queueIndex() const
+    {
+        return threadQueue() >= 0 ? threadQueue() : queues.size() - 1;
+    }
+
+    // own queue newest first, then the others oldest first
+    bool runOne(unsigned int self)
+    {
+        Entry entry;
+        bool found = false;
+        {
+            std::lock_guard<std::mutex> lock(queues[self].Mutex);
+            if (!queues[self].Jobs.empty())
+            {
+                entry = queues[self].Jobs.back();
+                queues[self].Jobs.pop_back();
+                found = true;
+            }
+        }
+        for (unsigned int i = 1; i < queues.size() && !found; i++)
+        {
+            Queue& victim = queues[(self + i) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.Mutex);
+            if (!victim.Jobs.empty())
+            {
+                entry = victim.Jobs.front();
+                victim.Jobs.pop_front();
+                found = true;
+            }
+        }
+        if (!found)
+            return false;
+        queued--;
+        entry.Work();
+        entry.Counter->Pending--;
+        return true;
+    }
+
+    void workerLoop(unsigned int index)
+    {
+        threadQueue() = index;
+        while (true)
+        {
+            if (runOne(index))
+                continue;
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wake.wait(lock, [this]() { return !running || queued > 0; });
+            if (!running)
+                return;
+        }
+    }
+};
+#endif
@@ -0,0 +1,299 @@
+#ifndef LIGHT_SYSTEM_H
+#define LIGHT_SYSTEM_H
+
+#include <glad/glad.h>
+
+#include "LightVolume.h"
+#include "RingBuffer.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LIGHT_SYSTEM_SSE
+#endif
+
+// glad's GL 3.3 header may leave it out
+#ifndef GL_MAX_TEXTURE_BUFFER_SIZE
+#define GL_MAX_TEXTURE_BUFFER_SIZE 0x8C2B
+#endif
+
+// Default light system values
+const float LIGHT_FLICKER_CHANCE = 0.1f; // of a flickering light picking a new brightness each frame
+
+// what a light does every frame, or'ed together
+enum LightFlags {
+    LIGHT_STATIC = 0,
+    LIGHT_FLICKER = 1, // jumps to a random brightness now and then, like a torch
+    LIGHT_ORBIT = 2,   // circles its centre in the XZ plane
+    LIGHT_PULSE = 4    // brightness follows a sine
+};
+
+// how a light is animated, see Add()
+struct LightAnimation {
+    unsigned int Flags = LIGHT_STATIC;
+    float FlickerAmount = 0.5f;  // the dimmest a flicker gets, as a fraction taken off the brightness
+    float OrbitRadius = 0.0f;
+    float OrbitSpeed = 0.0f;     // radians per second
+    float PulseAmount = 0.0f;    // fraction of the brightness the sine adds and takes away
+    float PulseSpeed = 0.0f;     // radians per second
+    float Phase = 0.0f;          // offsets the orbit and the pulse, so lights with the same speed don't move in step
+};
+
+// Every point light, stored as one array per component so the per-frame animation runs over four
+// lights at once with SSE. Animate() moves and dims the lights from the time alone (plus each
+// light's own random state for the flicker), so a replay animates the same frames every run, and
+// recomputes each light's radius from its new colour. Upload() then packs the lights that are still
+// bright enough into a single ring buffer allocation, which the light volumes read as instance data
+// and the full-screen lighting pass reads as a buffer texture.
+class LightSystem
+{
+public:
+    std::vector<float> PositionX, PositionY, PositionZ;
+    std::vector<float> ColorR, ColorG, ColorB;    // after this frame's flicker and pulse
+    std::vector<float> Radius;                    // where the light falls below LIGHT_CUTOFF, 0 when it never reaches it
+    std::vector<float> Linear, Quadratic;         // attenuation
+    std::vector<unsigned int> Flags;
+    std::vector<float> ShadowIndex;               // slot in the point shadow atlas, -1 for none
+
+    ~LightSystem()
+    {
+        if (lightData)
+            glDeleteTextures(1, &lightData);
+    }
+
+    unsigned int Size() const
+    {
+        return PositionX.size();
+    }
+
+    glm::vec3 Position(unsigned int i) const
+    {
+        return glm::vec3(PositionX[i], PositionY[i], PositionZ[i]);
+    }
+
+    // an orbiting light circles position, the others stay there; returns the light's index
+    unsigned int Add(const glm::vec3& position, const glm::vec3& color, float linear, float quadratic,
+        const LightAnimation& animation = LightAnimation(), int shadowIndex = -1)
+    {
+        unsigned int i = Size();
+        PositionX.push_back(position.x); PositionY.push_back(position.y); PositionZ.push_back(position.z);
+        centerX.push_back(position.x); centerZ.push_back(position.z);
+        baseR.push_back(color.r); baseG.push_back(color.g); baseB.push_back(color.b);
+        ColorR.push_back(color.r); ColorG.push_back(color.g); ColorB.push_back(color.b);
+        Radius.push_back(CalculateLightRadius(color, linear, quadratic));
+        Linear.push_back(linear); Quadratic.push_back(quadratic);
+        Flags.push_back(animation.Flags);
+        ShadowIndex.push_back((float)shadowIndex);
+        flicker.push_back(1.0f);
+        flickerAmount.push_back(animation.FlickerAmount);
+        orbitRadius.push_back(animation.OrbitRadius); orbitSpeed.push_back(animation.OrbitSpeed);
+        pulseAmount.push_back(animation.PulseAmount); pulseSpeed.push_back(animation.PulseSpeed);
+        phase.push_back(animation.Phase);
+        // xorshift needs a state other than 0
+        seed.push_back(hash(i + 1) | 1u);
+        return i;
+    }
+
+    // moves and dims every light for time (seconds), then refreshes its radius
+    void Animate(float time)
+    {
+        unsigned int count = Size();
+        unsigned int i = 0;
+#ifdef LIGHT_SYSTEM_SSE
+        const __m128 t = _mm_set1_ps(time), one = _mm_set1_ps(1.0f), zero = _mm_setzero_ps();
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128i flags = _mm_loadu_si128((const __m128i*)&Flags[i]);
+            __m128 offset = _mm_loadu_ps(&phase[i]);
+
+            // orbit
+            __m128 orbiting = hasFlag(flags, LIGHT_ORBIT);
+            __m128 angle = _mm_add_ps(_mm_mul_ps(t, _mm_loadu_ps(&orbitSpeed[i])), offset);
+            __m128 circle = _mm_loadu_ps(&orbitRadius[i]);
+            __m128 x = _mm_add_ps(_mm_loadu_ps(&centerX[i]), _mm_mul_ps(circle, sin4(_mm_add_ps(angle, _mm_set1_ps(HALF_PI)))));
+            __m128 z = _mm_add_ps(_mm_loadu_ps(&centerZ[i]), _mm_mul_ps(circle, sin4(angle)));
+            _mm_storeu_ps(&PositionX[i], select(orbiting, x, _mm_loadu_ps(&PositionX[i])));
+            _mm_storeu_ps(&PositionZ[i], select(orbiting, z, _mm_loadu_ps(&PositionZ[i])));
+
+            // flicker, two draws: whether to change and what to
+            __m128i state = _mm_loadu_si128((const __m128i*)&seed[i]);
+            __m128 chance = random4(state), level = random4(state);
+            _mm_storeu_si128((__m128i*)&seed[i], state);
+            __m128 flickering = _mm_and_ps(hasFlag(flags, LIGHT_FLICKER), _mm_cmplt_ps(chance, _mm_set1_ps(LIGHT_FLICKER_CHANCE)));
+            level = _mm_sub_ps(one, _mm_mul_ps(_mm_loadu_ps(&flickerAmount[i]), level));
+            __m128 dimmed = select(flickering, level, _mm_loadu_ps(&flicker[i]));
+            _mm_storeu_ps(&flicker[i], dimmed);
+
+            // pulse
+            __m128 pulse = _mm_add_ps(one, _mm_mul_ps(_mm_loadu_ps(&pulseAmount[i]),
+                sin4(_mm_add_ps(_mm_mul_ps(t, _mm_loadu_ps(&pulseSpeed[i])), offset))));
+            __m128 brightness = _mm_mul_ps(dimmed, select(hasFlag(flags, LIGHT_PULSE), pulse, one));
+
+            __m128 r = _mm_mul_ps(_mm_loadu_ps(&baseR[i]), brightness);
+            __m128 g = _mm_mul_ps(_mm_loadu_ps(&baseG[i]), brightness);
+            __m128 b = _mm_mul_ps(_mm_loadu_ps(&baseB[i]), brightness);
+            _mm_storeu_ps(&ColorR[i], r);
+            _mm_storeu_ps(&ColorG[i], g);
+            _mm_storeu_ps(&ColorB[i], b);
+
+            // radius, the same solve as CalculateLightRadius
+            __m128 linear = _mm_loadu_ps(&Linear[i]), quadratic = _mm_loadu_ps(&Quadratic[i]);
+            __m128 ratio = _mm_div_ps(_mm_max_ps(_mm_max_ps(r, g), b), _mm_set1_ps(LIGHT_CUTOFF));
+            __m128 root = _mm_sqrt_ps(_mm_max_ps(zero, _mm_sub_ps(_mm_mul_ps(linear, linear),
+                _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(4.0f), quadratic), _mm_sub_ps(one, ratio)))));
+            __m128 quadraticRadius = _mm_div_ps(_mm_sub_ps(root, linear), _mm_mul_ps(_mm_set1_ps(2.0f), quadratic));
+            __m128 linearRadius = select(_mm_cmpgt_ps(linear, zero), _mm_div_ps(_mm_sub_ps(ratio, one), linear), _mm_set1_ps(1e30f));
+            __m128 radius = select(_mm_cmpgt_ps(quadratic, zero), quadraticRadius, linearRadius);
+            _mm_storeu_ps(&Radius[i], _mm_and_ps(_mm_cmpgt_ps(ratio, one), radius));
+        }
+#endif
+        // whatever doesn't fill a group of four, or everything without SSE
+        for (; i < count; i++)
+        {
+            if (Flags[i] & LIGHT_ORBIT)
+            {
+                float angle = time * orbitSpeed[i] + phase[i];
+                PositionX[i] = centerX[i] + orbitRadius[i] * std::cos(angle);
+                PositionZ[i] = centerZ[i] + orbitRadius[i] * std::sin(angle);
+            }
+            float chance = random(seed[i]), level = random(seed[i]);
+            if ((Flags[i] & LIGHT_FLICKER) && chance < LIGHT_FLICKER_CHANCE)
+                flicker[i] = 1.0f - flickerAmount[i] * level;
+            float brightness = flicker[i];
+            if (Flags[i] & LIGHT_PULSE)
+                brightness *= 1.0f + pulseAmount[i] * std::sin(time * pulseSpeed[i] + phase[i]);
+            ColorR[i] = baseR[i] * brightness;
+            ColorG[i] = baseG[i] * brightness;
+            ColorB[i] = baseB[i] * brightness;
+            Radius[i] = CalculateLightRadius(glm::vec3(ColorR[i], ColorG[i], ColorB[i]), Linear[i], Quadratic[i]);
+        }
+    }
+
+    // packs every light with a radius into one allocation of ring, count is how many there are
+    RingBuffer::Allocation Upload(RingBuffer& ring, unsigned int& count) const
+    {
+        count = 0;
+        RingBuffer::Allocation allocation = ring.Allocate(Size() * sizeof(LightInstance), sizeof(LightInstance::PositionRadius));
+        if (!allocation.Pointer)
+            return allocation;
+        LightInstance* lights = (LightInstance*)allocation.Pointer;
+        for (unsigned int i = 0; i < Size(); i++)
+        {
+            if (Radius[i] <= 0.0f)
+                continue;
+            LightInstance& light = lights[count++];
+            light.PositionRadius = glm::vec4(PositionX[i], PositionY[i], PositionZ[i], Radius[i]);
+            light.Color = glm::vec3(ColorR[i], ColorG[i], ColorB[i]);
+            light.ShadowIndex = ShadowIndex[i];
+            light.Attenuation = glm::vec2(Linear[i], Quadratic[i]);
+            light.Padding = glm::vec2(0.0f);
+        }
+        allocation.Size = count * sizeof(LightInstance);
+        ring.Commit(allocation);
+        return allocation;
+    }
+
+    // whether the buffer texture over the whole ring stays within GL_MAX_TEXTURE_BUFFER_SIZE (only 65536
+    // texels guaranteed on GL 3.3); fetches past the limit read 0, so the lights there would vanish
+    static bool LightDataFits(const RingBuffer& ring, GLint& limit)
+    {
+        limit = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &limit);
+        return ring.Capacity() / (GLsizeiptr)sizeof(glm::vec4) <= limit;
+    }
+
+    // points a buffer texture at ring's buffer for the full-screen pass, three RGBA32F texels per light
+    // from texel allocation.Offset / 16
+    void BindLightData(const RingBuffer& ring, unsigned int unit)
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        if (!lightData)
+        {
+            glGenTextures(1, &lightData);
+            glBindTexture(GL_TEXTURE_BUFFER, lightData);
+            glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, ring.Buffer);
+        }
+        glBindTexture(GL_TEXTURE_BUFFER, lightData);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // a number in [0, 1) from a xorshift state, for placing lights
+    static float Random(unsigned int& state)
+    {
+        return random(state);
+    }
+
+private:
+    static constexpr float HALF_PI = 1.5707963f;
+
+    // the animation inputs, set once by Add()
+    std::vector<float> centerX, centerZ;
+    std::vector<float> baseR, baseG, baseB;
+    std::vector<float> flicker, flickerAmount;
+    std::vector<float> orbitRadius, orbitSpeed, pulseAmount, pulseSpeed, phase;
+    std::vector<unsigned int> seed;
+    unsigned int lightData = 0;
+
+    static unsigned int hash(unsigned int x)
+    {
+        x = (x ^ 61u) ^ (x >> 16);
+        x *= 9u;
+        x ^= x >> 4;
+        x *= 0x27d4eb2du;
+        return x ^ (x >> 15);
+    }
+
+    // xorshift32, the top 24 bits make the float
+    static float random(unsigned int& state)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return (float)(state >> 8) * (1.0f / 16777216.0f);
+    }
+
+#ifdef LIGHT_SYSTEM_SSE
+    // four lanes of random(), bit for bit
+    static __m128 random4(__m128i& state)
+    {
+        state = _mm_xor_si128(state, _mm_slli_epi32(state, 13));
+        state = _mm_xor_si128(state, _mm_srli_epi32(state, 17));
+        state = _mm_xor_si128(state, _mm_slli_epi32(state, 5));
+        return _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(state, 8)), _mm_set1_ps(1.0f / 16777216.0f));
+    }
+
+    // all bits set in the lanes whose flags have flag
+    static __m128 hasFlag(__m128i flags, unsigned int flag)
+    {
+        __m128i bit = _mm_set1_epi32(flag);
+        return _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(flags, bit), bit));
+    }
+
+    static __m128 select(__m128 mask, __m128 a, __m128 b)
+    {
+        return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    }
+
+    // sine to within about 1e-4: wrapped into [-pi, pi], folded into [-pi/2, pi/2], then a 7th order Taylor series
+    static __m128 sin4(__m128 x)
+    {
+        const __m128 pi = _mm_set1_ps(3.14159265f), halfPi = _mm_set1_ps(HALF_PI);
+        __m128 turns = _mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(0.15915494f))));
+        x = _mm_sub_ps(x, _mm_mul_ps(turns, _mm_set1_ps(6.28318531f)));
+        __m128 negative = _mm_and_ps(x, _mm_set1_ps(-0.0f));
+        __m128 folded = _mm_sub_ps(_mm_or_ps(pi, negative), x); // pi - x, or -pi - x below zero
+        x = select(_mm_cmpgt_ps(_mm_andnot_ps(_mm_set1_ps(-0.0f), x), halfPi), folded, x);
+        __m128 x2 = _mm_mul_ps(x, x);
+        __m128 p = _mm_add_ps(_mm_set1_ps(1.0f / 120.0f), _mm_mul_ps(x2, _mm_set1_ps(-1.0f / 5040.0f)));
+        p = _mm_add_ps(_mm_set1_ps(-1.0f / 6.0f), _mm_mul_ps(x2, p));
+        p = _mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(x2, p));
+        return _mm_mul_ps(x, p);
+    }
+#endif
+};
+#endif
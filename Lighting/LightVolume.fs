@@ -0,0 +1,43 @@
+#version 330 core
+out vec4 FragColor;
+
+flat in vec3 LightPosition;
+flat in vec3 LightColor;
+flat in vec3 LightAttenuation;
+flat in int ShadowIndex;
+
+#include "GBuffer.glsl"
+#include "PointShadow.glsl"
+
+uniform vec2 screenSize;
+uniform vec3 viewPos;
+
+void main() {
+	vec2 TexCoord = gl_FragCoord.xy / screenSize;
+	vec3 FragPos = GBufferPosition(TexCoord);
+
+	// the volume only bounds the light, skip the pixels inside it that are out of range
+	float distance = length(LightPosition - FragPos);
+	if (distance > LightAttenuation.z)
+		discard;
+
+	vec3 Normal = GBufferNormal(TexCoord);
+	vec3 Albedo = texture(gAlbedoSpec, TexCoord).rgb;
+	float Specular = texture(gAlbedoSpec, TexCoord).a;
+	vec3 viewDir = normalize(viewPos - FragPos);
+
+	//diffuse
+	vec3 lightDir = normalize(LightPosition - FragPos);
+	vec3 diffuse = max(dot(lightDir, Normal), 0.0) * Albedo * LightColor;
+	// specular
+	vec3 halfwayDir = normalize(lightDir + viewDir);
+	float spec = pow(max(dot(Normal, halfwayDir), 0.0), 16.0);
+	vec3 specular = LightColor * spec * Specular;
+	// attenuation
+	float attenuation = 1.0 / (1.0 + LightAttenuation.x * distance + LightAttenuation.y * distance * distance);
+
+	// shadow
+	float shadow = PointShadow(ShadowIndex, LightPosition, FragPos, Normal);
+
+	FragColor = vec4((diffuse + specular) * attenuation * (1.0 - shadow), 1.0);
+}
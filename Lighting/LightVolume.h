@@ -0,0 +1,163 @@
+#ifndef LIGHT_VOLUME_H
+#define LIGHT_VOLUME_H
+
+#include <glad/glad.h>
+
+#include "RingBuffer.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include <cmath>
+#include <vector>
+
+// Default light volume values
+const float LIGHT_CUTOFF = 5.0f / 256.0f;
+const unsigned int VOLUME_SEGMENTS = 12;
+const unsigned int VOLUME_RINGS = 8;
+
+// per-instance data streamed to the light volume shader, three vec4s so the full-screen pass can read
+// the same data as a buffer texture
+struct LightInstance {
+    glm::vec4 PositionRadius;
+    glm::vec3 Color;
+    float ShadowIndex;     // the light's slot in the point shadow atlas, -1 for none
+    glm::vec2 Attenuation; // linear, quadratic
+    glm::vec2 Padding;
+};
+
+// solves constant + linear * d + quadratic * d^2 = brightness / cutoff for d, i.e. the distance
+// at which the brightest channel of the light falls below the cutoff intensity.
+inline float CalculateLightRadius(const glm::vec3& color, float linear, float quadratic, float constant = 1.0f, float cutoff = LIGHT_CUTOFF)
+{
+    float maxBrightness = std::fmax(std::fmax(color.r, color.g), color.b);
+    if (maxBrightness <= cutoff)
+        return 0.0f;
+    if (quadratic <= 0.0f)
+        return (linear > 0.0f) ? (maxBrightness / cutoff - constant) / linear : 1e30f;
+    return (-linear + std::sqrt(linear * linear - 4.0f * quadratic * (constant - maxBrightness / cutoff))) / (2.0f * quadratic);
+}
+
+// A low-poly sphere rasterized once per point light, so only pixels inside a light's radius get shaded.
+class LightVolume
+{
+public:
+    unsigned int VAO;
+    unsigned int indexCount;
+
+    LightVolume()
+    {
+        setupSphere();
+    }
+
+    // streams this frame's lights through the ring buffer and points the instance attributes at them
+    void Update(const std::vector<LightInstance>& lights, RingBuffer& ring)
+    {
+        instanceCount = 0;
+        if (lights.empty())
+            return;
+        RingBuffer::Allocation allocation = ring.Upload(&lights[0], lights.size() * sizeof(LightInstance));
+        Update(allocation, lights.size(), ring);
+    }
+
+    // points the instance attributes at count lights already in the ring buffer
+    void Update(const RingBuffer::Allocation& lights, unsigned int count, const RingBuffer& ring)
+    {
+        instanceCount = 0;
+        if (!lights.Pointer || count == 0)
+            return;
+        instanceCount = count;
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, ring.Buffer);
+        setInstanceAttributes(lights.Offset);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // draws one sphere per light uploaded by Update()
+    void Draw()
+    {
+        glBindVertexArray(VAO);
+        glDrawElementsInstanced(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0, instanceCount);
+        glBindVertexArray(0);
+    }
+
+private:
+    unsigned int VBO, EBO;
+    unsigned int instanceCount = 0;
+
+    void setupSphere()
+    {
+        GpuMemoryScope tag(GPU_MEMORY_GEOMETRY);
+        // the faces of a tessellated sphere lie inside the true sphere, push the vertices out far enough
+        // that the polygon circumscribes it instead of cutting off the edge of the light.
+        float circumscribe = 1.0f / (std::cos(glm::pi<float>() / VOLUME_SEGMENTS) * std::cos(glm::pi<float>() / (2.0f * VOLUME_RINGS)));
+
+        std::vector<glm::vec3> vertices;
+        std::vector<unsigned int> indices;
+        for (unsigned int y = 0; y <= VOLUME_RINGS; y++)
+        {
+            float phi = glm::pi<float>() * (float)y / VOLUME_RINGS;
+            for (unsigned int x = 0; x <= VOLUME_SEGMENTS; x++)
+            {
+                float theta = 2.0f * glm::pi<float>() * (float)x / VOLUME_SEGMENTS;
+                vertices.push_back(circumscribe * glm::vec3(std::cos(theta) * std::sin(phi), std::cos(phi), std::sin(theta) * std::sin(phi)));
+            }
+        }
+        // counter-clockwise seen from outside, so culling front faces leaves the far side of the volume
+        for (unsigned int y = 0; y < VOLUME_RINGS; y++)
+        {
+            for (unsigned int x = 0; x < VOLUME_SEGMENTS; x++)
+            {
+                unsigned int i0 = y * (VOLUME_SEGMENTS + 1) + x;
+                unsigned int i1 = i0 + VOLUME_SEGMENTS + 1;
+                indices.push_back(i0);
+                indices.push_back(i0 + 1);
+                indices.push_back(i1);
+                indices.push_back(i1);
+                indices.push_back(i0 + 1);
+                indices.push_back(i1 + 1);
+            }
+        }
+        indexCount = indices.size();
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), &vertices[0], GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+
+        // vertex Positions
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+
+        // the instance attributes are pointed at the ring buffer by Update()
+        for (unsigned int i = 1; i <= 4; i++)
+        {
+            glEnableVertexAttribArray(i);
+            glVertexAttribDivisor(i, 1);
+        }
+
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // instance attributes read from the bound array buffer, starting at offset
+    void setInstanceAttributes(GLintptr offset)
+    {
+        // light position and radius
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(LightInstance), (void*)(offset + offsetof(LightInstance, PositionRadius)));
+        // light color
+        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(LightInstance), (void*)(offset + offsetof(LightInstance, Color)));
+        // attenuation
+        glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(LightInstance), (void*)(offset + offsetof(LightInstance, Attenuation)));
+        // point shadow slot
+        glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, sizeof(LightInstance), (void*)(offset + offsetof(LightInstance, ShadowIndex)));
+    }
+};
+#endif
@@ -0,0 +1,25 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec4 aPositionRadius;
+layout (location = 2) in vec3 aColor;
+layout (location = 3) in vec2 aAttenuation;
+layout (location = 4) in float aShadowIndex;
+
+flat out vec3 LightPosition;
+flat out vec3 LightColor;
+flat out vec3 LightAttenuation;
+flat out int ShadowIndex;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+	LightPosition = aPositionRadius.xyz;
+	LightColor = aColor;
+	LightAttenuation = vec3(aAttenuation, aPositionRadius.w);
+	ShadowIndex = int(aShadowIndex);
+
+	vec3 worldPos = aPositionRadius.xyz + aPos * aPositionRadius.w;
+	gl_Position = projection * view * vec4(worldPos, 1.0);
+}
@@ -29,6 +29,7 @@ struct Texture {
     unsigned int id;
     string type;
     string path;
+    bool cutout = false; // has texels with alpha below 0.5, which the G-Buffer pass discards
 };
 
 class Mesh {
@@ -38,20 +39,34 @@ public:
     vector<unsigned int> indices;
     vector<Texture>      textures;
     unsigned int VAO;
-
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    // object-space bounds, filled in by the model loader and used to cull the mesh
+    glm::vec3 AABBMin = glm::vec3(0.0f);
+    glm::vec3 AABBMax = glm::vec3(0.0f);
+    glm::vec3 BoundingCenter = glm::vec3(0.0f);
+    float BoundingRadius = 0.0f;
+    // the diffuse texture has cutouts, so the mesh needs a shader that discards
+    bool AlphaTested = false;
+    // a copy of another mesh's geometry keeps no vertices of its own and is drawn as an instance of
+    // Source with Transform, which takes Source's vertices onto this mesh's (identity when Source < 0)
+    int Source = -1;
+    glm::mat4 Transform = glm::mat4(1.0f);
+    unsigned int InstanceSlot = 0; // this mesh's transform in the model's instance buffer
+
+    // constructor, without gpu the mesh keeps its data on the CPU only (the software rasterizer)
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, bool gpu = true)
     {
         this->vertices = vertices;
         this->indices = indices;
         this->textures = textures;
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
+        // copies come without vertices and use their source's buffers
+        if (gpu && !vertices.empty())
+            setupMesh();
     }
 
-    // render the mesh
-    void Draw(Shader& shader)
+    // binds the mesh's textures to consecutive units and points the material samplers at them
+    void BindTextures(Shader& shader)
     {
         // bind appropriate textures
         unsigned int diffuseNr = 1;
@@ -79,23 +94,43 @@ public:
             // and finally bind the texture
             glBindTexture(GL_TEXTURE_2D, textures[i].id);
         }
+    }
 
-        // draw mesh
+    // points the per-instance model matrix (locations 5 to 8) at the model's instance buffer
+    void SetInstanceBuffer(unsigned int buffer)
+    {
+        instanceVBO = buffer;
         glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+        for (unsigned int i = 0; i < 4; i++)
+        {
+            glEnableVertexAttribArray(5 + i);
+            glVertexAttribDivisor(5 + i, 1);
+        }
         glBindVertexArray(0);
+    }
 
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+    // draws the geometry once per transform in slots [firstSlot, firstSlot + count) of the instance buffer
+    void DrawInstances(unsigned int firstSlot, unsigned int count)
+    {
+        glBindVertexArray(VAO);
+        // GL 3.3 has no base instance, so the attributes are moved to the first slot instead
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        for (unsigned int i = 0; i < 4; i++)
+            glVertexAttribPointer(5 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(firstSlot * sizeof(glm::mat4) + i * sizeof(glm::vec4)));
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glDrawElementsInstanced(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0, count);
+        // left bound, whatever draws next binds its own and the state cache drops a repeat of this one
     }
 
 private:
     // render data 
     unsigned int VBO, EBO;
+    unsigned int instanceVBO = 0;
 
     // initializes all the buffer objects/arrays
     void setupMesh()
     {
+        GpuMemoryScope tag(GPU_MEMORY_GEOMETRY);
         // create buffers/arrays
         glGenVertexArrays(1, &VAO);
         glGenBuffers(1, &VBO);
@@ -0,0 +1,120 @@
+#ifndef MESH_INSTANCING_H
+#define MESH_INSTANCING_H
+
+#include <glm/glm.hpp>
+
+#include "Mesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+// Default instancing values
+const float INSTANCE_POSITION_TOLERANCE = 1e-3f; // how far matching vertices may be apart, relative to the mesh radius
+const float INSTANCE_NORMAL_TOLERANCE = 1e-2f;
+const float INSTANCE_AXIS_DISTANCE = 0.25f;      // how far from the centroid, relative to the radius, an axis vertex must be
+
+// A frame attached to a mesh's own vertices: the origin at the centroid and the axes through two
+// vertices picked by their index. A copy of a mesh lists its vertices in the same order, so wherever
+// the copy was moved or turned its frame moves with it, and ToWorld(copy) * inverse(ToWorld(original))
+// takes the original onto the copy.
+struct RigidFrame {
+    glm::mat4 ToWorld = glm::mat4(1.0f);
+    float Radius = 0.0f;
+};
+
+inline RigidFrame ComputeRigidFrame(const std::vector<Vertex>& vertices)
+{
+    RigidFrame frame;
+    if (vertices.empty())
+        return frame;
+    glm::vec3 centroid(0.0f);
+    for (unsigned int i = 0; i < vertices.size(); i++)
+        centroid += vertices[i].Position;
+    centroid /= (float)vertices.size();
+    for (unsigned int i = 0; i < vertices.size(); i++)
+        frame.Radius = std::max(frame.Radius, glm::length(vertices[i].Position - centroid));
+
+    // the first vertex well away from the centroid gives x, the first one well off that axis gives y
+    float threshold = INSTANCE_AXIS_DISTANCE * frame.Radius;
+    glm::vec3 x(1.0f, 0.0f, 0.0f), y(0.0f, 1.0f, 0.0f);
+    unsigned int a = 0;
+    while (a < vertices.size() && glm::length(vertices[a].Position - centroid) < threshold)
+        a++;
+    if (a < vertices.size())
+    {
+        x = glm::normalize(vertices[a].Position - centroid);
+        // any perpendicular will do for a mesh that is a line
+        y = glm::normalize(glm::cross(x, std::fabs(x.y) < 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f)));
+        for (unsigned int b = a + 1; b < vertices.size(); b++)
+        {
+            glm::vec3 d = vertices[b].Position - centroid;
+            glm::vec3 offAxis = d - x * glm::dot(d, x);
+            if (glm::length(offAxis) >= threshold)
+            {
+                y = glm::normalize(offAxis);
+                break;
+            }
+        }
+    }
+    frame.ToWorld = glm::mat4(glm::vec4(x, 0.0f), glm::vec4(y, 0.0f), glm::vec4(glm::cross(x, y), 0.0f), glm::vec4(centroid, 1.0f));
+    return frame;
+}
+
+// hashes what copies share exactly however they were placed, the index buffer and the texture coordinates
+inline size_t GeometryKey(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices)
+{
+    // FNV-1a
+    size_t hash = 14695981039346656037ull;
+    auto add = [&hash](unsigned int value) {
+        for (unsigned int i = 0; i < 4; i++)
+        {
+            hash ^= (value >> (8 * i)) & 0xff;
+            hash *= 1099511628211ull;
+        }
+    };
+    add(vertices.size());
+    add(indices.size());
+    for (unsigned int i = 0; i < indices.size(); i++)
+        add(indices[i]);
+    for (unsigned int i = 0; i < vertices.size(); i++)
+    {
+        unsigned int bits[2];
+        std::memcpy(bits, &vertices[i].TexCoords, sizeof(bits));
+        add(bits[0]);
+        add(bits[1]);
+    }
+    return hash;
+}
+
+// the ids of a mesh's textures in binding order, meshes with equal ids can share a draw
+inline std::vector<unsigned int> TextureIds(const Mesh& mesh)
+{
+    std::vector<unsigned int> ids;
+    for (unsigned int i = 0; i < mesh.textures.size(); i++)
+        ids.push_back(mesh.textures[i].id);
+    return ids;
+}
+
+// true when transform takes every vertex of the original onto the copy's, within the tolerances
+inline bool IsRigidCopy(const Mesh& original, const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, const glm::mat4& transform, float radius)
+{
+    if (original.vertices.size() != vertices.size() || original.indices != indices)
+        return false;
+    float tolerance = INSTANCE_POSITION_TOLERANCE * std::max(radius, 1e-6f);
+    glm::mat3 rotation(transform);
+    for (unsigned int i = 0; i < vertices.size(); i++)
+    {
+        const Vertex& a = original.vertices[i];
+        const Vertex& b = vertices[i];
+        if (a.TexCoords != b.TexCoords)
+            return false;
+        if (glm::length(glm::vec3(transform * glm::vec4(a.Position, 1.0f)) - b.Position) > tolerance)
+            return false;
+        if (glm::length(rotation * a.Normal - b.Normal) > INSTANCE_NORMAL_TOLERANCE)
+            return false;
+    }
+    return true;
+}
+#endif
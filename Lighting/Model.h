@@ -10,9 +10,14 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+#include "BVH.h"
+#include "Frustum.h"
+#include "IndirectDraw.h"
 #include "Mesh.h"
+#include "MeshInstancing.h"
 #include "Shader.h"
 
+#include <algorithm>
 #include <string>
 #include <fstream>
 #include <sstream>
@@ -21,7 +26,14 @@
 #include <vector>
 using namespace std;
 
-unsigned int TextureFromFile(const char* path, const string& directory, bool gamma = false);
+unsigned int TextureFromFile(const char* path, const string& directory, bool gamma = false, bool* cutout = NULL);
+
+// the meshes of a model one pass draws, built off the GL thread and replayed on it
+struct DrawList {
+    std::vector<unsigned char> Visible;
+    std::vector<unsigned int> Opaque, AlphaTested; // mesh indices in draw order
+    unsigned int MeshesDrawn = 0;
+};
 
 class Model
 {
@@ -31,21 +43,225 @@ public:
     vector<Mesh>    meshes;
     string directory;
     bool gammaCorrection;
+    bool gpu; // false loads no buffers or textures, texture ids then only tell the textures apart
 
     // constructor, expects a filepath to a 3D model.
-    Model(string const& path, bool gamma = false) : gammaCorrection(gamma)
+    Model(string const& path, bool gamma = false, bool gpu = true) : gammaCorrection(gamma), gpu(gpu)
     {
         loadModel(path);
     }
 
+    // world-space bounds of every mesh under the transform last passed to UpdateBounds()
+    BoundsBatch WorldBounds;
+    BVH Tree; // over the same world-space boxes
+    std::vector<unsigned char> Visible; // result of the last DrawGeometry(frustum)
+    unsigned int MeshesDrawn = 0;       // by the last DrawGeometry(frustum), 0 when culled on the GPU
+    // GPU culled multi-draw path, only set on GL 4.3+ and before the first UpdateBounds()
+    IndirectDraw* Indirect = NULL;
+    bool IndirectEnabled = true;
+
+    bool DrawsIndirect() const
+    {
+        return Indirect && IndirectEnabled;
+    }
+
+    // the mesh whose buffers a mesh is drawn from, itself unless it is a copy
+    const Mesh& Geometry(unsigned int mesh) const
+    {
+        return meshes[geometryIndex(mesh)];
+    }
+
     // draws the model, and thus all its meshes
     void Draw(Shader& shader)
     {
+        drawRuns(&shader, bySlot);
+    }
+
+    // fills list.Visible with the meshes that may be inside the frustum, safe to call off the GL thread
+    unsigned int Cull(const Frustum& frustum, DrawList& list) const
+    {
+        list.MeshesDrawn = Tree.CullFrustum(frustum, list.Visible);
+        return list.MeshesDrawn;
+    }
+
+    // turns list.Visible into the draw order, opaque meshes apart from the cutouts and each group
+    // sorted by diffuse texture so neighbouring draws share bindings, then by instance slot so visible
+    // copies of one geometry end up next to each other, safe to call off the GL thread
+    void Sort(DrawList& list) const
+    {
+        list.Opaque.clear();
+        list.AlphaTested.clear();
         for (unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+            if (list.Visible[i])
+                (meshes[i].AlphaTested ? list.AlphaTested : list.Opaque).push_back(i);
+        auto order = [this](unsigned int a, unsigned int b) {
+            if (firstTexture(a) != firstTexture(b))
+                return firstTexture(a) < firstTexture(b);
+            return meshes[a].InstanceSlot < meshes[b].InstanceSlot;
+        };
+        std::sort(list.Opaque.begin(), list.Opaque.end(), order);
+        std::sort(list.AlphaTested.begin(), list.AlphaTested.end(), order);
+    }
+
+    // replays part of a draw list
+    void Draw(Shader& shader, const std::vector<unsigned int>& meshIndices)
+    {
+        drawRuns(&shader, meshIndices);
+    }
+
+    // the same without textures, for depth only passes
+    void DrawGeometry(const std::vector<unsigned int>& meshIndices)
+    {
+        drawRuns(NULL, meshIndices);
+    }
+
+    unsigned int AlphaTestedMeshes() const
+    {
+        unsigned int count = 0;
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            count += meshes[i].AlphaTested ? 1 : 0;
+        return count;
+    }
+
+    // the same without textures, for the shadow passes
+    void DrawGeometry(const Frustum& frustum)
+    {
+        if (DrawsIndirect())
+        {
+            Indirect->Cull(frustum);
+            Indirect->DrawGeometry();
+            MeshesDrawn = 0;
+            return;
+        }
+        MeshesDrawn = Tree.CullFrustum(frustum, Visible);
+        visibleSlots.clear();
+        for (unsigned int s = 0; s < bySlot.size(); s++)
+            if (Visible[bySlot[s]])
+                visibleSlots.push_back(bySlot[s]);
+        drawRuns(NULL, visibleSlots);
+    }
+
+    // moves the mesh bounds to world space, only does the work when the transform changed
+    void UpdateBounds(const glm::mat4& transform)
+    {
+        if (transform == boundsTransform && WorldBounds.Size() == meshes.size())
+            return;
+        boundsTransform = transform;
+        // the sphere radius grows with the largest axis scale
+        float scale = std::max(glm::length(glm::vec3(transform[0])), std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+        WorldBounds.Clear();
+        std::vector<glm::vec3> mins(meshes.size()), maxs(meshes.size());
+        for (unsigned int i = 0; i < meshes.size(); i++)
+        {
+            TransformAABB(transform, meshes[i].AABBMin, meshes[i].AABBMax, mins[i], maxs[i]);
+            WorldBounds.Add(mins[i], maxs[i], glm::vec3(transform * glm::vec4(meshes[i].BoundingCenter, 1.0f)), meshes[i].BoundingRadius * scale);
+        }
+        Tree.Build(mins, maxs);
+        if (Indirect)
+            Indirect->UpdateBounds(WorldBounds);
     }
 
 private:
+    glm::mat4 boundsTransform = glm::mat4(1.0f);
+    // instancing of repeated geometry
+    unsigned int instanceVBO = 0;
+    std::vector<unsigned int> bySlot;       // mesh in each instance slot
+    std::vector<unsigned int> visibleSlots; // scratch for DrawGeometry(frustum)
+    // only needed while loading
+    std::multimap<size_t, unsigned int> originals; // geometry key to the meshes that own their vertices
+    std::vector<RigidFrame> frames;                 // of every mesh loaded so far
+    size_t copiedBytes = 0;                         // vertex and index data the copies didn't need
+
+    unsigned int geometryIndex(unsigned int mesh) const
+    {
+        return meshes[mesh].Source >= 0 ? meshes[mesh].Source : mesh;
+    }
+
+    // whether next can go in the same instanced call as previous, same geometry in the following slot
+    // and, for a textured pass, the same textures
+    bool continuesRun(unsigned int previous, unsigned int next, bool textured) const
+    {
+        return meshes[next].InstanceSlot == meshes[previous].InstanceSlot + 1 && geometryIndex(next) == geometryIndex(previous)
+            && (!textured || TextureIds(meshes[next]) == TextureIds(meshes[previous]));
+    }
+
+    // draws the meshes in order, runs of neighbouring copies as one instanced call each
+    void drawRuns(Shader* shader, const std::vector<unsigned int>& meshIndices)
+    {
+        for (unsigned int begin = 0; begin < meshIndices.size(); )
+        {
+            unsigned int end = begin + 1;
+            while (end < meshIndices.size() && continuesRun(meshIndices[end - 1], meshIndices[end], shader != NULL))
+                end++;
+            if (shader)
+                meshes[meshIndices[begin]].BindTextures(*shader);
+            meshes[geometryIndex(meshIndices[begin])].DrawInstances(meshes[meshIndices[begin]].InstanceSlot, end - begin);
+            begin = end;
+        }
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // the index of an earlier mesh this one is a rigidly moved copy of, and the transform that moves it, or -1
+    int findOriginal(size_t key, const vector<Vertex>& vertices, const vector<unsigned int>& indices, const RigidFrame& frame, glm::mat4& transform) const
+    {
+        auto range = originals.equal_range(key);
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            transform = frame.ToWorld * glm::inverse(frames[it->second].ToWorld);
+            if (IsRigidCopy(meshes[it->second], vertices, indices, transform, frame.Radius))
+                return it->second;
+        }
+        return -1;
+    }
+
+    // gives every mesh a slot in the instance buffer, the copies of a geometry next to each other and
+    // grouped by textures, so drawing in slot order needs one call per geometry and material
+    void setupInstances()
+    {
+        GpuMemoryScope tag(GPU_MEMORY_GEOMETRY);
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            bySlot.push_back(i);
+        std::sort(bySlot.begin(), bySlot.end(), [this](unsigned int a, unsigned int b) {
+            if (geometryIndex(a) != geometryIndex(b))
+                return geometryIndex(a) < geometryIndex(b);
+            if (TextureIds(meshes[a]) != TextureIds(meshes[b]))
+                return TextureIds(meshes[a]) < TextureIds(meshes[b]);
+            return a < b;
+        });
+        std::vector<glm::mat4> transforms;
+        for (unsigned int s = 0; s < bySlot.size(); s++)
+        {
+            meshes[bySlot[s]].InstanceSlot = s;
+            transforms.push_back(meshes[bySlot[s]].Transform);
+        }
+        if (gpu && !transforms.empty())
+        {
+            glGenBuffers(1, &instanceVBO);
+            glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+            glBufferData(GL_ARRAY_BUFFER, transforms.size() * sizeof(glm::mat4), &transforms[0], GL_STATIC_DRAW);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+        unsigned int copies = 0, draws = 0;
+        for (unsigned int s = 0; s < bySlot.size(); s++)
+        {
+            if (meshes[bySlot[s]].Source >= 0)
+                copies++;
+            else if (gpu)
+                meshes[bySlot[s]].SetInstanceBuffer(instanceVBO);
+            if (s == 0 || !continuesRun(bySlot[s - 1], bySlot[s], true))
+                draws++;
+        }
+        std::cout << "Instancing: " << copies << " of " << meshes.size() << " meshes are copies, " << copiedBytes / 1024
+            << " KB of vertex and index data saved, " << meshes.size() << " -> " << draws << " draw calls for the whole model" << std::endl;
+        originals.clear();
+        frames.clear();
+    }
+
+    unsigned int firstTexture(unsigned int mesh) const
+    {
+        return meshes[mesh].textures.empty() ? 0 : meshes[mesh].textures[0].id;
+    }
+
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
     void loadModel(string const& path)
     {
@@ -63,6 +279,7 @@ private:
 
         // process ASSIMP's root node recursively
         processNode(scene->mRootNode, scene);
+        setupInstances();
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
@@ -91,6 +308,8 @@ private:
         vector<unsigned int> indices;
         vector<Texture> textures;
 
+        glm::vec3 boundsMin = glm::vec3(1e30f), boundsMax = glm::vec3(-1e30f);
+
         // walk through each of the mesh's vertices
         for (unsigned int i = 0; i < mesh->mNumVertices; i++)
         {
@@ -133,7 +352,14 @@ private:
                 vertex.TexCoords = glm::vec2(0.0f, 0.0f);
 
             vertices.push_back(vertex);
+            boundsMin = glm::min(boundsMin, vertex.Position);
+            boundsMax = glm::max(boundsMax, vertex.Position);
         }
+        // the sphere is centred on the box but only as large as the furthest vertex, which is often tighter than the box's corner
+        glm::vec3 boundsCenter = (boundsMin + boundsMax) * 0.5f;
+        float boundsRadius = 0.0f;
+        for (unsigned int i = 0; i < vertices.size(); i++)
+            boundsRadius = std::max(boundsRadius, glm::length(vertices[i].Position - boundsCenter));
         // now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
         for (unsigned int i = 0; i < mesh->mNumFaces; i++)
         {
@@ -164,8 +390,32 @@ private:
         std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
         textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
 
+        // a rigidly moved copy of an earlier mesh only keeps its own bounds and textures and is drawn
+        // from the original's buffers, processNode adds the result at index meshes.size()
+        RigidFrame frame = ComputeRigidFrame(vertices);
+        size_t key = GeometryKey(vertices, indices);
+        glm::mat4 copyTransform;
+        int source = findOriginal(key, vertices, indices, frame, copyTransform);
+        frames.push_back(frame);
+        if (source < 0)
+            originals.insert(std::make_pair(key, (unsigned int)meshes.size()));
+        else
+            copiedBytes += vertices.size() * sizeof(Vertex) + indices.size() * sizeof(unsigned int);
+
         // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        Mesh result(source < 0 ? vertices : vector<Vertex>(), source < 0 ? indices : vector<unsigned int>(), textures, gpu);
+        if (source >= 0)
+        {
+            result.Source = source;
+            result.Transform = copyTransform;
+        }
+        result.AABBMin = boundsMin;
+        result.AABBMax = boundsMax;
+        result.BoundingCenter = boundsCenter;
+        result.BoundingRadius = boundsRadius;
+        for (unsigned int i = 0; i < diffuseMaps.size(); i++)
+            result.AlphaTested = result.AlphaTested || diffuseMaps[i].cutout;
+        return result;
     }
 
     // checks all material textures of a given type and loads the textures if they're not loaded yet.
@@ -191,7 +441,7 @@ private:
             if (!skip)
             {   // if texture hasn't been loaded already, load it
                 Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
+                texture.id = gpu ? TextureFromFile(str.C_Str(), this->directory, false, &texture.cutout) : textures_loaded.size() + 1;
                 texture.type = typeName;
                 texture.path = str.C_Str();
                 textures.push_back(texture);
@@ -203,8 +453,9 @@ private:
 };
 
 
-unsigned int TextureFromFile(const char* path, const string& directory, bool gamma)
+unsigned int TextureFromFile(const char* path, const string& directory, bool gamma, bool* cutout)
 {
+    GpuMemoryScope tag(GPU_MEMORY_MATERIAL);
     string filename = string(path);
     bool isDiffuse = (filename == "diffuse.jpg") ? true : false;
     filename = directory + '/' + filename;
@@ -230,6 +481,12 @@ unsigned int TextureFromFile(const char* path, const string& directory, bool gam
             format = GL_RGBA;
             outformat = (isDiffuse) ? GL_SRGB_ALPHA : GL_RGBA;
         }
+        // an alpha channel alone doesn't need alpha testing, only texels the G-Buffer pass would discard do
+        if (cutout) {
+            *cutout = false;
+            for (int i = 0; nrComponents == 4 && i < width * height && !*cutout; i++)
+                *cutout = data[i * 4 + 3] < 128;
+        }
 
         glBindTexture(GL_TEXTURE_2D, textureID);
         glTexImage2D(GL_TEXTURE_2D, 0, outformat, width, height, 0, format, GL_UNSIGNED_BYTE, data);
@@ -0,0 +1,274 @@
+#ifndef OCCLUSION_CULLER_H
+#define OCCLUSION_CULLER_H
+
+#include <glm/glm.hpp>
+
+#include "JobSystem.h"
+#include "Model.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define OCCLUSION_SSE
+#endif
+
+// Default occlusion culling values
+const unsigned int OCC_WIDTH = 320;             // depth buffer, a multiple of the tile size and of 4
+const unsigned int OCC_HEIGHT = 192;
+const unsigned int OCC_TILE = 8;                // pixels per side of a hierarchical depth tile
+const unsigned int OCC_TRIANGLE_BUDGET = 40000; // occluder triangles rasterized per frame
+const float OCC_MIN_OCCLUDER_PIXELS = 256.0f;   // screen area below which a mesh isn't worth rasterizing
+const unsigned int OCC_BAND_TILES = 4;         // tile rows per rasterizer job
+
+// CPU occlusion culling. The meshes covering the most of the screen are rasterized as occluders into
+// a small depth buffer, four pixels at a time, with the screen split into bands run as jobs.
+// Every 8x8 tile also keeps its farthest depth, so most tests are settled per tile. A mesh whose box
+// is behind the occluders at every pixel it covers is dropped from the draw list.
+// Nothing here touches OpenGL.
+class OcclusionCuller
+{
+public:
+    std::vector<float> Depth;   // NDC depth of the nearest occluder, 1 where there is none
+    std::vector<float> TileMax; // farthest depth of each tile
+    unsigned int OccludersDrawn = 0, TrianglesRasterized = 0, MeshesOccluded = 0; // by the last Cull()
+
+    OcclusionCuller()
+    {
+        Depth.resize(OCC_WIDTH * OCC_HEIGHT);
+        TileMax.resize((OCC_WIDTH / OCC_TILE) * (OCC_HEIGHT / OCC_TILE));
+    }
+
+    // clears list.Visible for the visible meshes hidden behind the occluders, counted in MeshesOccluded
+    void Cull(const Model& model, const glm::mat4& transform, const glm::mat4& viewProjection, DrawList& list, JobSystem& jobs)
+    {
+        std::fill(Depth.begin(), Depth.end(), 1.0f);
+        std::fill(TileMax.begin(), TileMax.end(), 1.0f);
+        OccludersDrawn = TrianglesRasterized = MeshesOccluded = 0;
+        triangles.clear();
+
+        const BoundsBatch& bounds = model.WorldBounds;
+        std::vector<ScreenBox> boxes(bounds.Size());
+        for (unsigned int i = 0; i < bounds.Size(); i++)
+        {
+            if (!list.Visible[i])
+                continue;
+            glm::vec3 center(bounds.CenterX[i], bounds.CenterY[i], bounds.CenterZ[i]);
+            glm::vec3 extent(bounds.ExtentX[i], bounds.ExtentY[i], bounds.ExtentZ[i]);
+            boxes[i] = projectBox(center - extent, center + extent, viewProjection);
+        }
+
+        // occluders, largest on screen first until the triangle budget runs out. Cutouts are left out, their
+        // transparent texels don't hide anything, but they are still tested like every other mesh
+        std::vector<unsigned int> candidates;
+        for (unsigned int i = 0; i < boxes.size(); i++)
+            if (list.Visible[i] && !model.meshes[i].AlphaTested && boxes[i].Valid && boxes[i].Area() >= OCC_MIN_OCCLUDER_PIXELS)
+                candidates.push_back(i);
+        std::sort(candidates.begin(), candidates.end(), [&](unsigned int a, unsigned int b) { return boxes[a].Area() > boxes[b].Area(); });
+        glm::mat4 objectToClip = viewProjection * transform;
+        for (unsigned int c = 0; c < candidates.size(); c++)
+        {
+            // copies are rasterized from their original's vertices
+            const Mesh& mesh = model.Geometry(candidates[c]);
+            if (TrianglesRasterized + mesh.indices.size() / 3 > OCC_TRIANGLE_BUDGET)
+                continue;
+            setupTriangles(mesh, objectToClip * model.meshes[candidates[c]].Transform);
+            TrianglesRasterized += mesh.indices.size() / 3;
+            OccludersDrawn++;
+        }
+
+        // every job owns a band of tile rows, so no two write the same pixel
+        JobCounter bands;
+        jobs.ParallelFor(OCC_HEIGHT / OCC_TILE, OCC_BAND_TILES, [this](unsigned int begin, unsigned int end) {
+            rasterizeBand(begin * OCC_TILE, end * OCC_TILE);
+        }, bands);
+        jobs.Wait(bands);
+
+        for (unsigned int i = 0; i < boxes.size(); i++)
+        {
+            if (list.Visible[i] && boxes[i].Valid && occluded(boxes[i]))
+            {
+                list.Visible[i] = 0;
+                MeshesOccluded++;
+            }
+        }
+        list.MeshesDrawn -= MeshesOccluded;
+    }
+
+private:
+    // screen-space rectangle of a box and its nearest depth, invalid if the box crosses the near plane
+    struct ScreenBox {
+        float MinX = 0.0f, MinY = 0.0f, MaxX = 0.0f, MaxY = 0.0f, NearZ = 0.0f;
+        bool Valid = false;
+
+        float Area() const
+        {
+            return (std::min(MaxX, (float)OCC_WIDTH) - std::max(MinX, 0.0f)) * (std::min(MaxY, (float)OCC_HEIGHT) - std::max(MinY, 0.0f));
+        }
+    };
+
+    struct Triangle {
+        float X[3], Y[3], Z[3];
+    };
+
+    std::vector<Triangle> triangles;
+
+    static ScreenBox projectBox(const glm::vec3& min, const glm::vec3& max, const glm::mat4& viewProjection)
+    {
+        ScreenBox box;
+        box.MinX = box.MinY = box.NearZ = 1e30f;
+        box.MaxX = box.MaxY = -1e30f;
+        for (unsigned int c = 0; c < 8; c++)
+        {
+            glm::vec4 clip = viewProjection * glm::vec4(c & 1 ? max.x : min.x, c & 2 ? max.y : min.y, c & 4 ? max.z : min.z, 1.0f);
+            // a corner behind the camera, the box can't be projected conservatively
+            if (clip.w <= 1e-4f)
+                return ScreenBox();
+            float x = (clip.x / clip.w * 0.5f + 0.5f) * OCC_WIDTH;
+            float y = (clip.y / clip.w * 0.5f + 0.5f) * OCC_HEIGHT;
+            box.MinX = std::min(box.MinX, x);
+            box.MaxX = std::max(box.MaxX, x);
+            box.MinY = std::min(box.MinY, y);
+            box.MaxY = std::max(box.MaxY, y);
+            box.NearZ = std::min(box.NearZ, clip.z / clip.w * 0.5f + 0.5f);
+        }
+        box.Valid = box.MaxX >= 0.0f && box.MinX < OCC_WIDTH && box.MaxY >= 0.0f && box.MinY < OCC_HEIGHT;
+        return box;
+    }
+
+    void setupTriangles(const Mesh& mesh, const glm::mat4& objectToClip)
+    {
+        for (unsigned int i = 0; i + 2 < mesh.indices.size(); i += 3)
+        {
+            Triangle triangle;
+            bool behind = false;
+            for (unsigned int v = 0; v < 3; v++)
+            {
+                glm::vec4 clip = objectToClip * glm::vec4(mesh.vertices[mesh.indices[i + v]].Position, 1.0f);
+                // dropping a triangle that crosses the near plane only makes the occluders smaller
+                if (clip.w <= 1e-4f)
+                {
+                    behind = true;
+                    break;
+                }
+                triangle.X[v] = (clip.x / clip.w * 0.5f + 0.5f) * OCC_WIDTH;
+                triangle.Y[v] = (clip.y / clip.w * 0.5f + 0.5f) * OCC_HEIGHT;
+                triangle.Z[v] = clip.z / clip.w * 0.5f + 0.5f;
+            }
+            if (!behind)
+                triangles.push_back(triangle);
+        }
+    }
+
+    // rasterizes every occluder triangle into rows [rowBegin, rowEnd), then updates those tiles
+    void rasterizeBand(unsigned int rowBegin, unsigned int rowEnd)
+    {
+        for (unsigned int t = 0; t < triangles.size(); t++)
+        {
+            Triangle tri = triangles[t];
+            float area = (tri.X[1] - tri.X[0]) * (tri.Y[2] - tri.Y[0]) - (tri.X[2] - tri.X[0]) * (tri.Y[1] - tri.Y[0]);
+            if (std::fabs(area) < 1e-6f)
+                continue;
+            // counter-clockwise, so inside is where all three edge functions are positive
+            if (area < 0.0f)
+            {
+                std::swap(tri.X[1], tri.X[2]);
+                std::swap(tri.Y[1], tri.Y[2]);
+                std::swap(tri.Z[1], tri.Z[2]);
+                area = -area;
+            }
+            int minX = std::max(0, (int)std::floor(std::min(tri.X[0], std::min(tri.X[1], tri.X[2]))));
+            int maxX = std::min((int)OCC_WIDTH - 1, (int)std::ceil(std::max(tri.X[0], std::max(tri.X[1], tri.X[2]))));
+            int minY = std::max((int)rowBegin, (int)std::floor(std::min(tri.Y[0], std::min(tri.Y[1], tri.Y[2]))));
+            int maxY = std::min((int)rowEnd - 1, (int)std::ceil(std::max(tri.Y[0], std::max(tri.Y[1], tri.Y[2]))));
+            if (minX > maxX || minY > maxY)
+                continue;
+            minX &= ~3;
+
+            // edge i runs from vertex i to vertex i+1: E = A x + B y + C
+            float A[3], B[3], C[3];
+            for (unsigned int e = 0; e < 3; e++)
+            {
+                unsigned int n = (e + 1) % 3;
+                A[e] = tri.Y[e] - tri.Y[n];
+                B[e] = tri.X[n] - tri.X[e];
+                C[e] = tri.X[e] * tri.Y[n] - tri.X[n] * tri.Y[e];
+            }
+            // depth as a plane in screen space, from the barycentric weights
+            float zA = (A[1] * tri.Z[0] + A[2] * tri.Z[1] + A[0] * tri.Z[2]) / area;
+            float zB = (B[1] * tri.Z[0] + B[2] * tri.Z[1] + B[0] * tri.Z[2]) / area;
+            float zC = (C[1] * tri.Z[0] + C[2] * tri.Z[1] + C[0] * tri.Z[2]) / area;
+
+            for (int y = minY; y <= maxY; y++)
+            {
+                float py = y + 0.5f;
+                float* row = &Depth[y * OCC_WIDTH];
+#ifdef OCCLUSION_SSE
+                __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+                __m128 zero = _mm_setzero_ps();
+                for (int x = minX; x <= maxX; x += 4)
+                {
+                    __m128 px = _mm_add_ps(_mm_set1_ps((float)x), offsets);
+                    __m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(A[0]), px), _mm_set1_ps(B[0] * py + C[0])), zero);
+                    inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(A[1]), px), _mm_set1_ps(B[1] * py + C[1])), zero));
+                    inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(A[2]), px), _mm_set1_ps(B[2] * py + C[2])), zero));
+                    if (_mm_movemask_ps(inside) == 0)
+                        continue;
+                    __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(zA), px), _mm_set1_ps(zB * py + zC));
+                    __m128 old = _mm_loadu_ps(row + x);
+                    __m128 nearest = _mm_min_ps(old, z);
+                    _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, old)));
+                }
+#else
+                for (int x = minX; x <= maxX; x++)
+                {
+                    float px = x + 0.5f;
+                    if (A[0] * px + B[0] * py + C[0] < 0.0f || A[1] * px + B[1] * py + C[1] < 0.0f || A[2] * px + B[2] * py + C[2] < 0.0f)
+                        continue;
+                    row[x] = std::min(row[x], zA * px + zB * py + zC);
+                }
+#endif
+            }
+        }
+
+        // farthest depth of each tile in the band
+        for (unsigned int ty = rowBegin / OCC_TILE; ty < rowEnd / OCC_TILE; ty++)
+        {
+            for (unsigned int tx = 0; tx < OCC_WIDTH / OCC_TILE; tx++)
+            {
+                float farthest = 0.0f;
+                for (unsigned int y = ty * OCC_TILE; y < (ty + 1) * OCC_TILE; y++)
+                    for (unsigned int x = tx * OCC_TILE; x < (tx + 1) * OCC_TILE; x++)
+                        farthest = std::max(farthest, Depth[y * OCC_WIDTH + x]);
+                TileMax[ty * (OCC_WIDTH / OCC_TILE) + tx] = farthest;
+            }
+        }
+    }
+
+    // true if every pixel under the box holds an occluder nearer than the box
+    bool occluded(const ScreenBox& box) const
+    {
+        // a pixel of margin, the box is tested against whole pixels
+        int minX = std::max(0, (int)std::floor(box.MinX) - 1), maxX = std::min((int)OCC_WIDTH - 1, (int)std::ceil(box.MaxX) + 1);
+        int minY = std::max(0, (int)std::floor(box.MinY) - 1), maxY = std::min((int)OCC_HEIGHT - 1, (int)std::ceil(box.MaxY) + 1);
+        for (int ty = minY / OCC_TILE; ty <= maxY / (int)OCC_TILE; ty++)
+        {
+            for (int tx = minX / OCC_TILE; tx <= maxX / (int)OCC_TILE; tx++)
+            {
+                // the whole tile is nearer than the box
+                if (TileMax[ty * (OCC_WIDTH / OCC_TILE) + tx] < box.NearZ)
+                    continue;
+                int x0 = std::max(minX, tx * (int)OCC_TILE), x1 = std::min(maxX, (tx + 1) * (int)OCC_TILE - 1);
+                int y0 = std::max(minY, ty * (int)OCC_TILE), y1 = std::min(maxY, (ty + 1) * (int)OCC_TILE - 1);
+                for (int y = y0; y <= y1; y++)
+                    for (int x = x0; x <= x1; x++)
+                        if (Depth[y * OCC_WIDTH + x] >= box.NearZ)
+                            return false;
+            }
+        }
+        return true;
+    }
+};
+#endif
@@ -4,7 +4,8 @@ out vec4 FragColor;
 in vec2 TexCoord;
 
 uniform sampler2D screenTexture;
-//uniform sampler2D bloomTexture;
+uniform sampler2D bloomTexture;
+uniform float bloomStrength;
 //uniform float exposure;
 
 const float offset = 1.0 / 300.0;
@@ -13,9 +14,9 @@ vec3 ApplyKernel(float kernel[9]);
 
 void main() {
     vec3 HDRcol = vec3(texture(screenTexture, TexCoord));
-    //vec3 Bloom = vec3(texture(bloomTexture, TexCoord));
+    vec3 Bloom = vec3(texture(bloomTexture, TexCoord));
 
-    //HDRcol += Bloom;
+    HDRcol += Bloom * bloomStrength;
 
     //Tone Mapping
     //vec3 mapped = vec3(1.0) - exp(-HDRcol* exposure);
@@ -1,8 +1,13 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
+layout (location = 5) in mat4 aInstance;
 
 uniform mat4 model;
+uniform mat4 shadowMatrix;
+
+out vec4 FragPos;
 
 void main () {
-	gl_Position = model * vec4(aPos, 1.0);
-}
\ No newline at end of file
+	FragPos = model * aInstance * vec4(aPos, 1.0);
+	gl_Position = shadowMatrix * FragPos;
+}
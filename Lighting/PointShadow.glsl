@@ -0,0 +1,50 @@
+// Point light shadows shared by the lighting shaders, #include "PointShadow.glsl" after the #version line.
+// Each light's six cube faces are tiles of pointShadowAtlas holding distance / pointShadowFar, see PointShadowAtlas.h.
+
+const int NR_SHADOW_LIGHTS = 8;
+uniform sampler2DShadow pointShadowAtlas;
+uniform vec4 pointShadowRects[NR_SHADOW_LIGHTS * 6]; // empty when the face hasn't been rendered
+uniform float pointShadowFar[NR_SHADOW_LIGHTS];
+
+// cube face orientations, the same as PointShadowAtlas.h
+const vec3 faceForward[6] = vec3[](vec3(1, 0, 0), vec3(-1, 0, 0), vec3(0, 1, 0), vec3(0, -1, 0), vec3(0, 0, 1), vec3(0, 0, -1));
+const vec3 faceUp[6] = vec3[](vec3(0, -1, 0), vec3(0, -1, 0), vec3(0, 0, 1), vec3(0, 0, -1), vec3(0, -1, 0), vec3(0, -1, 0));
+
+float PointShadow(int light, vec3 lightPos, vec3 fragPos, vec3 normal) {
+	//lights without a slot in the atlas cast no shadow
+	if (light < 0 || light >= NR_SHADOW_LIGHTS)
+		return 0.0;
+	float shadowFar = pointShadowFar[light];
+	vec3 toFrag = fragPos - lightPos;
+	float distance = length(toFrag);
+	if (shadowFar <= 0.0 || distance >= shadowFar)
+		return 0.0;
+
+	//offset along the normal by about a texel of the face, the tiles are at most 512 wide
+	toFrag += normal * (2.0 * distance / 512.0);
+
+	vec3 a = abs(toFrag);
+	int face;
+	if (a.x >= a.y && a.x >= a.z)
+		face = toFrag.x > 0.0 ? 0 : 1;
+	else if (a.y >= a.z)
+		face = toFrag.y > 0.0 ? 2 : 3;
+	else
+		face = toFrag.z > 0.0 ? 4 : 5;
+	vec4 rect = pointShadowRects[light * 6 + face];
+	if (rect.z == 0.0)
+		return 0.0;
+
+	//the same projection as the face's lookAt and 90 degree perspective
+	vec3 forward = faceForward[face];
+	vec3 right = normalize(cross(forward, faceUp[face]));
+	vec3 up = cross(right, forward);
+	vec2 uv = vec2(dot(right, toFrag), dot(up, toFrag)) / dot(forward, toFrag) * 0.5 + 0.5;
+
+	//one bilinear hardware compare, kept inside the tile
+	vec2 texel = 1.0 / vec2(textureSize(pointShadowAtlas, 0));
+	vec2 atlasCoord = clamp(rect.xy + uv * rect.zw, rect.xy + texel * 0.5, rect.xy + rect.zw - texel * 0.5);
+	float currentDepth = length(toFrag) / shadowFar - 0.002;
+	float shadow = 1.0 - texture(pointShadowAtlas, vec3(atlasCoord, currentDepth));
+	return shadow;
+}
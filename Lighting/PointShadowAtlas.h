@@ -0,0 +1,364 @@
+#ifndef POINT_SHADOW_ATLAS_H
+#define POINT_SHADOW_ATLAS_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "Frustum.h"
+#include "Model.h"
+#include "Shader.h"
+#include "ShadowCaster.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Default point shadow values
+const unsigned int POINT_SHADOW_ATLAS_SIZE = 2048;
+const unsigned int POINT_SHADOW_MAX_FACE = 512;
+const unsigned int POINT_SHADOW_MIN_FACE = 128;
+const unsigned int POINT_SHADOW_FACE_BUDGET = 8; // stale faces re-rendered per frame, not counting faces of new tiles
+const float POINT_SHADOW_NEAR = 0.05f;
+
+// cube face orientations, PointShadow.glsl uses the same ones to find a face's tile
+const glm::vec3 POINT_SHADOW_FACE_FORWARD[6] = {
+    glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f),
+    glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+    glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f)
+};
+const glm::vec3 POINT_SHADOW_FACE_UP[6] = {
+    glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+    glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f),
+    glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)
+};
+
+// a shadow casting point light, Radius is where its shadow map ends
+struct PointShadowLight {
+    glm::vec3 Position;
+    float Radius;
+};
+
+// Shadows for every point light, with the six faces of each light's cube packed as tiles into one
+// depth atlas instead of a cubemap per light. The face size follows how much of the screen a light
+// covers, and only up to POINT_SHADOW_FACE_BUDGET stale faces are re-rendered per frame, most
+// important first. A light that just got new tiles has all six faces rendered in that frame, so it
+// never goes unshadowed while it waits for the budget. Each face only draws the meshes whose bounds
+// intersect its frustum.
+class PointShadowAtlas
+{
+public:
+    unsigned int FBO;
+    unsigned int DepthAtlas;
+    unsigned int FacesRendered = 0; // by the last Render()
+    unsigned int MeshesDrawn = 0;
+
+    PointShadowAtlas(unsigned int maxLights) : lights(maxLights)
+    {
+        GpuMemoryScope tag(GPU_MEMORY_SHADOW);
+        glGenFramebuffers(1, &FBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+
+        // linear distance to the light over its radius, 16 bits are plenty for that
+        glGenTextures(1, &DepthAtlas);
+        glBindTexture(GL_TEXTURE_2D, DepthAtlas);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT16, POINT_SHADOW_ATLAS_SIZE, POINT_SHADOW_ATLAS_SIZE, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        // sampled through sampler2DShadow, so every fetch is a bilinear hardware compare
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, DepthAtlas, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::FRAMEBUFFER::Point shadow atlas is not complete" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        freeTiles[0].push_back({ 0, 0, POINT_SHADOW_ATLAS_SIZE });
+    }
+
+    // call when the shadow casters changed, every face goes stale
+    void MarkDirty()
+    {
+        for (unsigned int i = 0; i < lights.size(); i++)
+            for (unsigned int f = 0; f < 6; f++)
+                lights[i].FaceDirty[f] = true;
+    }
+
+    // picks each light's face size from its screen coverage and marks the faces of moved lights stale
+    void Update(const std::vector<PointShadowLight>& pointLights, const glm::mat4& viewProjection, const glm::vec3& viewPos, float tanHalfFov)
+    {
+        Frustum cameraFrustum(viewProjection);
+        std::vector<unsigned int> order;
+        for (unsigned int i = 0; i < lights.size(); i++)
+        {
+            LightSlot& slot = lights[i];
+            const PointShadowLight& light = i < pointLights.size() ? pointLights[i] : PointShadowLight{ glm::vec3(0.0f), 0.0f };
+            if (light.Position != slot.Light.Position || light.Radius != slot.Light.Radius)
+            {
+                slot.Light = light;
+                for (unsigned int f = 0; f < 6; f++)
+                {
+                    glm::mat4 faceView = glm::lookAt(light.Position, light.Position + POINT_SHADOW_FACE_FORWARD[f], POINT_SHADOW_FACE_UP[f]);
+                    glm::mat4 faceProjection = glm::perspective(glm::radians(90.0f), 1.0f, POINT_SHADOW_NEAR, std::fmax(light.Radius, 2.0f * POINT_SHADOW_NEAR));
+                    slot.FaceMatrices[f] = faceProjection * faceView;
+                    slot.FaceDirty[f] = true;
+                }
+            }
+
+            // projected radius as a fraction of half the screen height
+            float distance = glm::length(light.Position - viewPos);
+            if (light.Radius <= 0.0f || !cameraFrustum.IntersectsSphere(light.Position, light.Radius))
+                slot.Importance = 0.0f;
+            else if (distance <= light.Radius)
+                slot.Importance = 1.0f;
+            else
+                slot.Importance = std::fmin(1.0f, light.Radius / (distance * tanHalfFov));
+
+            // a face no pixel on screen can sample matters much less
+            for (unsigned int f = 0; f < 6; f++)
+            {
+                glm::vec3 right = glm::normalize(glm::cross(POINT_SHADOW_FACE_FORWARD[f], POINT_SHADOW_FACE_UP[f]));
+                glm::vec3 up = glm::cross(right, POINT_SHADOW_FACE_FORWARD[f]);
+                glm::vec3 faceMin = light.Position, faceMax = light.Position;
+                for (unsigned int c = 0; c < 4; c++)
+                {
+                    glm::vec3 corner = light.Position + light.Radius * (POINT_SHADOW_FACE_FORWARD[f] + ((c & 1) ? right : -right) + ((c & 2) ? up : -up));
+                    faceMin = glm::min(faceMin, corner);
+                    faceMax = glm::max(faceMax, corner);
+                }
+                slot.FaceVisible[f] = slot.Importance > 0.0f && cameraFrustum.IntersectsAABB(faceMin, faceMax);
+            }
+            order.push_back(i);
+        }
+
+        // the most important lights get first pick of the atlas space
+        std::sort(order.begin(), order.end(), [this](unsigned int a, unsigned int b) { return lights[a].Importance > lights[b].Importance; });
+        for (unsigned int i = 0; i < order.size(); i++)
+        {
+            LightSlot& slot = lights[order[i]];
+            unsigned int size = slot.Light.Radius > 0.0f ? faceSizeFor(slot.Importance, slot.FaceSize) : 0;
+            if (size != slot.FaceSize)
+                reallocate(slot, size);
+        }
+    }
+
+    // renders the faces of new tiles and re-renders the most important other stale faces, at most
+    // POINT_SHADOW_FACE_BUDGET of them
+    void Render(const std::vector<ShadowCaster>& casters, Shader& depthShader)
+    {
+        FacesRendered = 0;
+        MeshesDrawn = 0;
+
+        // faces that were never rendered leave the light without shadows, so they go first and all of them
+        // are rendered whatever the budget
+        std::vector<std::pair<float, unsigned int>> stale;
+        unsigned int invalid = 0;
+        for (unsigned int i = 0; i < lights.size(); i++)
+        {
+            LightSlot& slot = lights[i];
+            if (slot.FaceSize == 0)
+                continue;
+            for (unsigned int f = 0; f < 6; f++)
+            {
+                if (!slot.FaceDirty[f])
+                    continue;
+                float score = (slot.FaceValid[f] ? 0.0f : 100.0f) + slot.Importance * (slot.FaceVisible[f] ? 1.0f : 0.1f) + 0.01f * slot.FaceAge[f];
+                stale.push_back(std::make_pair(score, i * 6 + f));
+                invalid += slot.FaceValid[f] ? 0 : 1;
+                slot.FaceAge[f]++;
+            }
+        }
+        if (stale.empty())
+            return;
+        unsigned int count = std::min((unsigned int)stale.size(), std::max(POINT_SHADOW_FACE_BUDGET, invalid));
+        std::partial_sort(stale.begin(), stale.begin() + count, stale.end(),
+            [](const std::pair<float, unsigned int>& a, const std::pair<float, unsigned int>& b) { return a.first > b.first; });
+
+        depthShader.use();
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glEnable(GL_SCISSOR_TEST);
+        for (unsigned int s = 0; s < count; s++)
+        {
+            LightSlot& slot = lights[stale[s].second / 6];
+            unsigned int f = stale[s].second % 6;
+            renderFace(slot, f, casters, depthShader);
+            slot.FaceDirty[f] = false;
+            slot.FaceValid[f] = true;
+            slot.FaceAge[f] = 0;
+            FacesRendered++;
+        }
+        glDisable(GL_SCISSOR_TEST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // binds the atlas to the given texture unit and uploads every face's tile, see PointShadow.glsl
+    void SetUniforms(Shader& shader, unsigned int unit)
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D, DepthAtlas);
+        glActiveTexture(GL_TEXTURE0);
+        shader.setInt("pointShadowAtlas", unit);
+        for (unsigned int i = 0; i < lights.size(); i++)
+        {
+            const LightSlot& slot = lights[i];
+            shader.setFloat("pointShadowFar[" + std::to_string(i) + "]", slot.Light.Radius);
+            for (unsigned int f = 0; f < 6; f++)
+            {
+                // an empty rect means the face has no valid shadow yet
+                glm::vec4 rect = glm::vec4(0.0f);
+                if (slot.FaceSize > 0 && slot.FaceValid[f])
+                    rect = glm::vec4(slot.Faces[f].X, slot.Faces[f].Y, slot.Faces[f].Size, slot.Faces[f].Size) / (float)POINT_SHADOW_ATLAS_SIZE;
+                shader.setVec4("pointShadowRects[" + std::to_string(i * 6 + f) + "]", rect);
+            }
+        }
+    }
+
+private:
+    static const unsigned int TILE_LEVELS = 5; // 2048 down to 128
+
+    struct Tile {
+        unsigned int X, Y, Size;
+    };
+
+    struct LightSlot {
+        PointShadowLight Light = { glm::vec3(0.0f), 0.0f };
+        float Importance = 0.0f;
+        unsigned int FaceSize = 0; // 0 when the light has no tiles
+        Tile Faces[6];
+        glm::mat4 FaceMatrices[6];
+        bool FaceValid[6] = { false, false, false, false, false, false };
+        bool FaceDirty[6] = { true, true, true, true, true, true };
+        bool FaceVisible[6] = { false, false, false, false, false, false };
+        unsigned int FaceAge[6] = { 0, 0, 0, 0, 0, 0 };
+    };
+
+    std::vector<LightSlot> lights;
+    // quadtree allocator, free tiles by level with level 0 the whole atlas
+    std::vector<Tile> freeTiles[TILE_LEVELS];
+
+    static unsigned int levelOf(unsigned int size)
+    {
+        unsigned int level = 0;
+        while ((POINT_SHADOW_ATLAS_SIZE >> level) > size)
+            level++;
+        return level;
+    }
+
+    // grows straight away, but only shrinks once the light is clearly below the threshold so it doesn't flip every frame
+    static unsigned int faceSizeFor(float importance, unsigned int current)
+    {
+        unsigned int size = importance >= 0.5f ? 512 : importance >= 0.15f ? 256 : 128;
+        float currentThreshold = current == 512 ? 0.5f : current == 256 ? 0.15f : 0.0f;
+        if (size < current && importance > 0.8f * currentThreshold)
+            return current;
+        return size;
+    }
+
+    bool allocate(unsigned int size, Tile& tile)
+    {
+        unsigned int level = levelOf(size);
+        int l = level;
+        while (l >= 0 && freeTiles[l].empty())
+            l--;
+        if (l < 0)
+            return false;
+        tile = freeTiles[l].back();
+        freeTiles[l].pop_back();
+        // split down to the requested size, keeping the other three quarters free
+        while ((unsigned int)l < level)
+        {
+            unsigned int half = tile.Size / 2;
+            freeTiles[l + 1].push_back({ tile.X + half, tile.Y, half });
+            freeTiles[l + 1].push_back({ tile.X, tile.Y + half, half });
+            freeTiles[l + 1].push_back({ tile.X + half, tile.Y + half, half });
+            tile.Size = half;
+            l++;
+        }
+        return true;
+    }
+
+    void release(Tile tile)
+    {
+        unsigned int level = levelOf(tile.Size);
+        // merge back into the parent once all four quarters are free
+        while (level > 0)
+        {
+            unsigned int parentSize = tile.Size * 2;
+            unsigned int px = tile.X - tile.X % parentSize, py = tile.Y - tile.Y % parentSize;
+            std::vector<unsigned int> siblings;
+            for (unsigned int t = 0; t < freeTiles[level].size(); t++)
+            {
+                const Tile& free = freeTiles[level][t];
+                if (free.X - free.X % parentSize == px && free.Y - free.Y % parentSize == py)
+                    siblings.push_back(t);
+            }
+            if (siblings.size() != 3)
+                break;
+            for (int t = 2; t >= 0; t--)
+                freeTiles[level].erase(freeTiles[level].begin() + siblings[t]);
+            tile = { px, py, parentSize };
+            level--;
+        }
+        freeTiles[level].push_back(tile);
+    }
+
+    // moves a light's six faces to tiles of the new size, smaller if the atlas is full
+    void reallocate(LightSlot& slot, unsigned int size)
+    {
+        if (slot.FaceSize > 0)
+            for (unsigned int f = 0; f < 6; f++)
+                release(slot.Faces[f]);
+        slot.FaceSize = 0;
+
+        for (; size >= POINT_SHADOW_MIN_FACE; size /= 2)
+        {
+            unsigned int f = 0;
+            for (; f < 6; f++)
+                if (!allocate(size, slot.Faces[f]))
+                    break;
+            if (f == 6)
+            {
+                slot.FaceSize = size;
+                break;
+            }
+            for (unsigned int r = 0; r < f; r++)
+                release(slot.Faces[r]);
+        }
+        for (unsigned int f = 0; f < 6; f++)
+        {
+            slot.FaceValid[f] = false;
+            slot.FaceDirty[f] = true;
+        }
+    }
+
+    void renderFace(const LightSlot& slot, unsigned int f, const std::vector<ShadowCaster>& casters, Shader& depthShader)
+    {
+        const Tile& tile = slot.Faces[f];
+        glViewport(tile.X, tile.Y, tile.Size, tile.Size);
+        glScissor(tile.X, tile.Y, tile.Size, tile.Size);
+        glClear(GL_DEPTH_BUFFER_BIT);
+
+        depthShader.setMat4("shadowMatrix", slot.FaceMatrices[f]);
+        depthShader.setVec3("lightPos", slot.Light.Position);
+        depthShader.setFloat("far_plane", slot.Light.Radius);
+
+        Frustum faceFrustum(slot.FaceMatrices[f]);
+        for (unsigned int c = 0; c < casters.size(); c++)
+        {
+            depthShader.setMat4("model", casters[c].ModelMatrix);
+            casters[c].Caster->UpdateBounds(casters[c].ModelMatrix);
+            casters[c].Caster->DrawGeometry(faceFrustum);
+            MeshesDrawn += casters[c].Caster->MeshesDrawn;
+        }
+    }
+};
+#endif
@@ -0,0 +1,241 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <glad/glad.h>
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+// Default profiler values
+const unsigned int PROFILER_FRAMES = 4;                 // frames of queries in flight before a frame's queries are reused
+const unsigned int PROFILER_TRACE_EVENTS = 1u << 20;    // events kept for the trace file, later ones are dropped
+
+// Nested CPU and GPU timings of named scopes (the shadow passes, every render graph pass). Each scope
+// takes a pair of GL_TIMESTAMP queries from its frame's pool; a frame's results are read when its
+// pool comes round again PROFILER_FRAMES frames later, and a frame whose last query still isn't
+// available is dropped rather than waited on. The CPU time of a scope is the time spent recording
+// its commands, the GPU time the time the GPU spent executing them.
+//
+// Averages are kept per scope name for Report(), and with Tracing every scope also becomes an event
+// for a Chrome trace (chrome://tracing, Perfetto) with the GPU on its own row. Scopes may only be
+// opened on the thread that owns the GL context.
+class Profiler
+{
+public:
+    bool Enabled = true;
+    bool Tracing = false;
+    unsigned int FramesDropped = 0; // frames whose queries weren't back in time
+
+    Profiler()
+    {
+        // maps GPU timestamps onto the CPU clock for the trace
+        GLint64 gpuNow = 0;
+        glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+        gpuBaseNs = gpuNow;
+        cpuBase = std::chrono::steady_clock::now();
+    }
+
+    ~Profiler()
+    {
+        for (unsigned int f = 0; f < PROFILER_FRAMES; f++)
+            if (!frames[f].Queries.empty())
+                glDeleteQueries(frames[f].Queries.size(), &frames[f].Queries[0]);
+    }
+
+    void BeginFrame()
+    {
+        Frame& frame = frames[current % PROFILER_FRAMES];
+        resolve(frame);
+        frame.Scopes.clear();
+        frame.Used = 0;
+        open.clear();
+        // latched for the whole frame so every Begin() meets its End()
+        active = Enabled;
+    }
+
+    void EndFrame()
+    {
+        current++;
+    }
+
+    void Begin(const std::string& name)
+    {
+        if (!active)
+            return;
+        Frame& frame = frames[current % PROFILER_FRAMES];
+        Scope scope;
+        scope.Name = name;
+        scope.Depth = open.size();
+        scope.Query = frame.Used;
+        frame.Used += 2;
+        while (frame.Queries.size() < frame.Used)
+        {
+            GLuint query;
+            glGenQueries(1, &query);
+            frame.Queries.push_back(query);
+        }
+        scope.CpuStart = microseconds();
+        glQueryCounter(frame.Queries[scope.Query], GL_TIMESTAMP);
+        frame.LastQuery = scope.Query;
+        open.push_back(frame.Scopes.size());
+        frame.Scopes.push_back(scope);
+    }
+
+    void End()
+    {
+        if (!active || open.empty())
+            return;
+        Frame& frame = frames[current % PROFILER_FRAMES];
+        Scope& scope = frame.Scopes[open.back()];
+        open.pop_back();
+        scope.CpuEnd = microseconds();
+        glQueryCounter(frame.Queries[scope.Query + 1], GL_TIMESTAMP);
+        frame.LastQuery = scope.Query + 1;
+    }
+
+    // average milliseconds per frame of every scope since the last report, nested scopes indented
+    void Report(std::ostream& out)
+    {
+        if (resolvedFrames == 0)
+            return;
+        out << "Profile (" << resolvedFrames << " frames, CPU / GPU ms):" << std::endl;
+        for (unsigned int i = 0; i < order.size(); i++)
+        {
+            Totals& totals = stats[order[i]];
+            out << "  " << std::string(2 * totals.Depth, ' ') << order[i] << ": " << totals.CpuMs / resolvedFrames
+                << " / " << totals.GpuMs / resolvedFrames << std::endl;
+            totals.CpuMs = totals.GpuMs = 0.0;
+        }
+        resolvedFrames = 0;
+    }
+
+    bool WriteTrace(const std::string& path) const
+    {
+        std::ofstream file(path.c_str());
+        file << "{\"traceEvents\":[" << std::endl;
+        file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}}," << std::endl;
+        file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}";
+        for (unsigned int i = 0; i < events.size(); i++)
+        {
+            const TraceEvent& event = events[i];
+            file << "," << std::endl << "{\"name\":\"" << escape(event.Name) << "\",\"cat\":\"" << (event.Gpu ? "gpu" : "cpu")
+                << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << (event.Gpu ? 2 : 1) << ",\"ts\":" << event.Start
+                << ",\"dur\":" << event.Duration << ",\"args\":{\"frame\":" << event.Frame << "}}";
+        }
+        file << std::endl << "]}" << std::endl;
+        return file.good();
+    }
+
+private:
+    struct Scope {
+        std::string Name;
+        unsigned int Depth;
+        unsigned int Query; // start query, the end query follows it
+        double CpuStart = 0.0, CpuEnd = 0.0; // microseconds since construction
+    };
+    struct Frame {
+        std::vector<GLuint> Queries;
+        std::vector<Scope> Scopes;
+        unsigned int Used = 0;
+        unsigned int LastQuery = 0; // the latest query issued, once it is available so are all the others
+        unsigned int Index = 0;
+    };
+    struct Totals {
+        double CpuMs = 0.0, GpuMs = 0.0;
+        unsigned int Depth = 0;
+    };
+    struct TraceEvent {
+        std::string Name;
+        bool Gpu;
+        double Start, Duration; // microseconds
+        unsigned int Frame;
+    };
+
+    Frame frames[PROFILER_FRAMES];
+    unsigned int current = 0;
+    bool active = false;
+    std::vector<unsigned int> open; // scopes begun and not yet ended, innermost last
+    std::map<std::string, Totals> stats;
+    std::vector<std::string> order; // scope names in the order they first appeared
+    unsigned int resolvedFrames = 0;
+    std::vector<TraceEvent> events;
+    GLint64 gpuBaseNs;
+    std::chrono::steady_clock::time_point cpuBase;
+
+    double microseconds() const
+    {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - cpuBase).count();
+    }
+
+    void resolve(Frame& frame)
+    {
+        if (frame.Scopes.empty())
+        {
+            frame.Index = current;
+            return;
+        }
+        GLint available = 0;
+        glGetQueryObjectiv(frame.Queries[frame.LastQuery], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+        {
+            FramesDropped++;
+            frame.Index = current;
+            return;
+        }
+        for (unsigned int i = 0; i < frame.Scopes.size(); i++)
+        {
+            const Scope& scope = frame.Scopes[i];
+            GLuint64 start = 0, end = 0;
+            glGetQueryObjectui64v(frame.Queries[scope.Query], GL_QUERY_RESULT, &start);
+            glGetQueryObjectui64v(frame.Queries[scope.Query + 1], GL_QUERY_RESULT, &end);
+            if (stats.find(scope.Name) == stats.end())
+                order.push_back(scope.Name);
+            Totals& totals = stats[scope.Name];
+            totals.CpuMs += (scope.CpuEnd - scope.CpuStart) / 1000.0;
+            totals.GpuMs += (double)(end - start) / 1.0e6;
+            totals.Depth = scope.Depth;
+            if (Tracing && events.size() + 2 <= PROFILER_TRACE_EVENTS)
+            {
+                events.push_back({ scope.Name, false, scope.CpuStart, scope.CpuEnd - scope.CpuStart, frame.Index });
+                events.push_back({ scope.Name, true, (double)((GLint64)start - gpuBaseNs) / 1000.0, (double)(end - start) / 1000.0, frame.Index });
+            }
+        }
+        resolvedFrames++;
+        frame.Index = current;
+    }
+
+    static std::string escape(const std::string& text)
+    {
+        std::string escaped;
+        for (unsigned int i = 0; i < text.size(); i++)
+        {
+            if (text[i] == '"' || text[i] == '\\')
+                escaped += '\\';
+            escaped += text[i];
+        }
+        return escaped;
+    }
+};
+
+// profiles the enclosing block
+class ProfileScope
+{
+public:
+    ProfileScope(Profiler& profiler, const std::string& name) : profiler(profiler)
+    {
+        profiler.Begin(name);
+    }
+
+    ~ProfileScope()
+    {
+        profiler.End();
+    }
+
+private:
+    Profiler& profiler;
+};
+#endif
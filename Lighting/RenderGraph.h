@@ -0,0 +1,337 @@
+#ifndef RENDER_GRAPH_H
+#define RENDER_GRAPH_H
+
+#include <glad/glad.h>
+
+#include "GpuMemory.h"
+#include "Profiler.h"
+
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// size, format and filtering of a transient texture
+struct RGTextureDesc {
+    unsigned int Width, Height;
+    GLint InternalFormat;
+    GLenum Format, Type;
+    GLint Filter;
+
+    // the filter is only sampler state, so it doesn't stop two resources sharing a texture
+    bool SameStorage(const RGTextureDesc& other) const
+    {
+        return Width == other.Width && Height == other.Height && InternalFormat == other.InternalFormat
+            && Format == other.Format && Type == other.Type;
+    }
+};
+
+inline bool IsDepthFormat(GLint internalFormat)
+{
+    return internalFormat == GL_DEPTH_COMPONENT || internalFormat == GL_DEPTH_COMPONENT16 || internalFormat == GL_DEPTH_COMPONENT24
+        || internalFormat == GL_DEPTH_COMPONENT32F || internalFormat == GL_DEPTH24_STENCIL8;
+}
+
+// A frame described as passes that declare the textures they sample (reads) and render into
+// (attachments). Compile() culls the passes nothing depends on and gives transient textures whose
+// lifetimes don't overlap the same GL texture. Textures are only created the first time a pass that
+// uses them executes, and the plan is printed whenever it changes.
+//
+// The graph is rebuilt every frame with Reset(), the texture pool and framebuffers persist.
+class RenderGraph
+{
+public:
+    typedef int Resource;
+
+    unsigned long long AliasedBytes = 0;   // transient memory of the current plan
+    unsigned long long UnaliasedBytes = 0; // the same resources with a texture each
+
+    ~RenderGraph()
+    {
+        for (unsigned int i = 0; i < pool.size(); i++)
+            releaseTexture(i);
+    }
+
+    void Reset()
+    {
+        resources.clear();
+        passes.clear();
+    }
+
+    // category is what the texture's memory is charged to when this resource is the one creating it
+    Resource CreateTexture(const std::string& name, const RGTextureDesc& desc, GpuMemoryCategory category = GPU_MEMORY_POST)
+    {
+        resources.push_back({ name, desc, -1, category });
+        return resources.size() - 1;
+    }
+
+    // a pass with no attachments draws to the default framebuffer, sideEffect keeps it from being culled
+    void AddPass(const std::string& name, const std::vector<Resource>& reads, const std::vector<Resource>& attachments,
+        std::function<void()> execute, bool sideEffect = false)
+    {
+        passes.push_back({ name, reads, attachments, execute, sideEffect, false });
+    }
+
+    // the GL texture behind a resource, only valid while the graph executes
+    unsigned int GetTexture(Resource resource)
+    {
+        int physical = resources[resource].Physical;
+        if (physical < 0)
+            return 0;
+        if (pool[physical].Texture == 0)
+            createTexture(physical);
+        // an aliased texture keeps the filtering of whoever used it before
+        if (pool[physical].Filter != resources[resource].Desc.Filter)
+        {
+            pool[physical].Filter = resources[resource].Desc.Filter;
+            glBindTexture(GL_TEXTURE_2D, pool[physical].Texture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, pool[physical].Filter);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, pool[physical].Filter);
+        }
+        return pool[physical].Texture;
+    }
+
+    void Compile()
+    {
+        // walk backwards keeping the set of resources a later live pass still needs
+        std::vector<bool> needed(resources.size(), false);
+        for (int p = passes.size() - 1; p >= 0; p--)
+        {
+            Pass& pass = passes[p];
+            pass.Alive = pass.SideEffect;
+            for (unsigned int a = 0; a < pass.Attachments.size(); a++)
+                pass.Alive = pass.Alive || needed[pass.Attachments[a]];
+            if (!pass.Alive)
+                continue;
+            for (unsigned int a = 0; a < pass.Attachments.size(); a++)
+                needed[pass.Attachments[a]] = false;
+            for (unsigned int r = 0; r < pass.Reads.size(); r++)
+                needed[pass.Reads[r]] = true;
+        }
+
+        // first and last live pass touching each resource
+        std::vector<int> first(resources.size(), -1), last(resources.size(), -1);
+        for (unsigned int p = 0; p < passes.size(); p++)
+        {
+            if (!passes[p].Alive)
+                continue;
+            std::vector<Resource> used = passes[p].Reads;
+            used.insert(used.end(), passes[p].Attachments.begin(), passes[p].Attachments.end());
+            for (unsigned int u = 0; u < used.size(); u++)
+            {
+                if (first[used[u]] < 0)
+                    first[used[u]] = p;
+                last[used[u]] = p;
+            }
+        }
+
+        // greedy aliasing in order of first use, reusing a pooled texture once its last user is done
+        std::vector<int> busyUntil(pool.size(), -1);
+        std::vector<bool> poolUsed(pool.size(), false);
+        AliasedBytes = UnaliasedBytes = 0;
+        for (unsigned int p = 0; p < passes.size(); p++)
+        {
+            for (unsigned int r = 0; r < resources.size(); r++)
+            {
+                if (first[r] != (int)p)
+                    continue;
+                ResourceEntry& resource = resources[r];
+                resource.Physical = -1;
+                // prefer the texture this resource had last frame so the framebuffers stay valid
+                for (unsigned int t = 0; t < pool.size() && resource.Physical < 0; t++)
+                    if (pool[t].Desc.SameStorage(resource.Desc) && busyUntil[t] < (int)p && pool[t].LastOwner == resource.Name)
+                        resource.Physical = t;
+                for (unsigned int t = 0; t < pool.size() && resource.Physical < 0; t++)
+                    if (pool[t].Desc.SameStorage(resource.Desc) && busyUntil[t] < (int)p)
+                        resource.Physical = t;
+                if (resource.Physical < 0)
+                {
+                    pool.push_back({ resource.Desc, 0, resource.Desc.Filter, "", resource.Category });
+                    busyUntil.push_back(-1);
+                    poolUsed.push_back(false);
+                    resource.Physical = pool.size() - 1;
+                }
+                busyUntil[resource.Physical] = last[r];
+                pool[resource.Physical].LastOwner = resource.Name;
+                if (!poolUsed[resource.Physical])
+                    AliasedBytes += textureBytes(resource.Desc);
+                poolUsed[resource.Physical] = true;
+                UnaliasedBytes += textureBytes(resource.Desc);
+            }
+        }
+
+        // textures the plan no longer needs go back to the driver
+        for (unsigned int t = 0; t < pool.size(); t++)
+            if (!poolUsed[t])
+                releaseTexture(t);
+
+        std::string plan = describe(first, last);
+        if (plan != lastPlan)
+        {
+            std::cout << plan;
+            lastPlan = plan;
+        }
+    }
+
+    // with a profiler every live pass is timed as a scope of its own
+    void Execute(Profiler* profiler = NULL)
+    {
+        for (unsigned int p = 0; p < passes.size(); p++)
+        {
+            Pass& pass = passes[p];
+            if (!pass.Alive)
+                continue;
+            if (pass.Attachments.empty())
+            {
+                glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            }
+            else
+            {
+                glBindFramebuffer(GL_FRAMEBUFFER, framebufferFor(pass));
+                const RGTextureDesc& desc = resources[pass.Attachments[0]].Desc;
+                glViewport(0, 0, desc.Width, desc.Height);
+            }
+            if (profiler)
+                profiler->Begin(pass.Name);
+            pass.Execute();
+            if (profiler)
+                profiler->End();
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+private:
+    struct ResourceEntry {
+        std::string Name;
+        RGTextureDesc Desc;
+        int Physical; // index into the pool
+        GpuMemoryCategory Category;
+    };
+
+    struct Pass {
+        std::string Name;
+        std::vector<Resource> Reads;
+        std::vector<Resource> Attachments;
+        std::function<void()> Execute;
+        bool SideEffect;
+        bool Alive;
+    };
+
+    struct PooledTexture {
+        RGTextureDesc Desc;
+        unsigned int Texture; // 0 until a pass needs it
+        GLint Filter;         // current filtering, follows the resource using it
+        std::string LastOwner;
+        GpuMemoryCategory Category;
+    };
+
+    std::vector<ResourceEntry> resources;
+    std::vector<Pass> passes;
+    std::vector<PooledTexture> pool;
+    std::map<std::vector<unsigned int>, unsigned int> framebuffers; // keyed by attached textures
+    std::string lastPlan;
+
+    static unsigned long long textureBytes(const RGTextureDesc& desc)
+    {
+        return (unsigned long long)desc.Width * desc.Height * TextureFormatBytes(desc.InternalFormat);
+    }
+
+    void createTexture(unsigned int t)
+    {
+        const RGTextureDesc& desc = pool[t].Desc;
+        GpuMemoryScope tag(pool[t].Category);
+        glGenTextures(1, &pool[t].Texture);
+        glBindTexture(GL_TEXTURE_2D, pool[t].Texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, desc.InternalFormat, desc.Width, desc.Height, 0, desc.Format, desc.Type, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, pool[t].Filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, pool[t].Filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    void releaseTexture(unsigned int t)
+    {
+        if (pool[t].Texture == 0)
+            return;
+        // drop every framebuffer the texture is attached to
+        for (std::map<std::vector<unsigned int>, unsigned int>::iterator it = framebuffers.begin(); it != framebuffers.end();)
+        {
+            bool attached = false;
+            for (unsigned int i = 0; i < it->first.size(); i++)
+                attached = attached || it->first[i] == pool[t].Texture;
+            if (attached)
+            {
+                glDeleteFramebuffers(1, &it->second);
+                it = framebuffers.erase(it);
+            }
+            else
+                ++it;
+        }
+        glDeleteTextures(1, &pool[t].Texture);
+        pool[t].Texture = 0;
+    }
+
+    unsigned int framebufferFor(const Pass& pass)
+    {
+        std::vector<unsigned int> key;
+        for (unsigned int a = 0; a < pass.Attachments.size(); a++)
+            key.push_back(GetTexture(pass.Attachments[a]));
+        std::map<std::vector<unsigned int>, unsigned int>::iterator found = framebuffers.find(key);
+        if (found != framebuffers.end())
+            return found->second;
+
+        unsigned int fbo;
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        std::vector<unsigned int> drawBuffers;
+        for (unsigned int a = 0; a < pass.Attachments.size(); a++)
+        {
+            if (IsDepthFormat(resources[pass.Attachments[a]].Desc.InternalFormat))
+            {
+                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, key[a], 0);
+                continue;
+            }
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + drawBuffers.size(), GL_TEXTURE_2D, key[a], 0);
+            drawBuffers.push_back(GL_COLOR_ATTACHMENT0 + drawBuffers.size());
+        }
+        if (drawBuffers.empty())
+            glDrawBuffer(GL_NONE);
+        else
+            glDrawBuffers(drawBuffers.size(), &drawBuffers[0]);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::FRAMEBUFFER::Render graph pass " << pass.Name << " is not complete" << std::endl;
+        framebuffers[key] = fbo;
+        return fbo;
+    }
+
+    std::string describe(const std::vector<int>& first, const std::vector<int>& last) const
+    {
+        std::ostringstream out;
+        unsigned int culled = 0;
+        for (unsigned int p = 0; p < passes.size(); p++)
+            culled += passes[p].Alive ? 0 : 1;
+        out << "Render graph: " << passes.size() - culled << " passes, " << culled << " culled" << std::endl;
+        for (unsigned int p = 0; p < passes.size(); p++)
+            out << "  pass " << std::setw(2) << p << " " << (passes[p].Alive ? "" : "(culled) ") << passes[p].Name << std::endl;
+        for (unsigned int r = 0; r < resources.size(); r++)
+        {
+            const RGTextureDesc& desc = resources[r].Desc;
+            out << "  " << std::left << std::setw(16) << resources[r].Name << std::right << " " << desc.Width << "x" << desc.Height;
+            if (first[r] < 0)
+            {
+                out << " unused" << std::endl;
+                continue;
+            }
+            out << " " << std::fixed << std::setprecision(1) << textureBytes(desc) / (1024.0 * 1024.0) << " MiB, passes "
+                << first[r] << "-" << last[r] << ", texture " << resources[r].Physical << std::endl;
+        }
+        out << "  transient VRAM: " << std::fixed << std::setprecision(1) << AliasedBytes / (1024.0 * 1024.0) << " MiB ("
+            << UnaliasedBytes / (1024.0 * 1024.0) << " MiB without aliasing)" << std::endl;
+        return out.str();
+    }
+};
+#endif
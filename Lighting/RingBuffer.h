@@ -0,0 +1,204 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <glad/glad.h>
+#include <glfw/glfw3.h>
+
+#include "GpuMemory.h"
+
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// glad is generated for GL 3.3, the buffer storage entry point and flags are loaded by hand
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+// Default ring buffer values
+const unsigned int RING_FRAMES = 3;                  // frames the CPU may run ahead of the GPU
+const GLsizeiptr RING_FRAME_SIZE = 256 * 1024;       // bytes each frame can allocate
+const GLuint64 RING_FENCE_TIMEOUT = 1000000000;      // 1 second in nanoseconds
+
+// A per-frame allocator for dynamic data (instance data, uniform blocks). On GL 4.4 or with
+// ARB_buffer_storage the buffer is mapped once, persistently and coherently, and split into one region
+// per frame in flight; a fence at the end of each frame tells when the GPU is done with a region, so
+// writing is a memcpy with no driver synchronization. Without it the buffer holds a single region that
+// is orphaned at the start of every frame, and each allocation is uploaded with glBufferSubData.
+class RingBuffer
+{
+public:
+    struct Allocation {
+        void* Pointer = NULL; // write the data here, NULL when the frame's region is full
+        GLintptr Offset = 0;  // where it lands in Buffer
+        GLsizeiptr Size = 0;
+    };
+
+    unsigned int Buffer = 0;
+    bool Persistent = false;
+    GLint UniformAlignment = 256;
+    unsigned int Stalls = 0; // frames that had to wait on the GPU, should stay 0
+
+    RingBuffer(GLsizeiptr frameSize = RING_FRAME_SIZE) : frameSize(frameSize)
+    {
+        GpuMemoryScope tag(GPU_MEMORY_DYNAMIC);
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &UniformAlignment);
+        glGenBuffers(1, &Buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, Buffer);
+        BufferStorageProc bufferStorage = loadBufferStorage();
+        if (bufferStorage)
+        {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            bufferStorage(GL_COPY_WRITE_BUFFER, frameSize * RING_FRAMES, NULL, flags);
+            GpuMemory::Storage(GL_COPY_WRITE_BUFFER, frameSize * RING_FRAMES);
+            mapped = (char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, frameSize * RING_FRAMES, flags);
+            Persistent = mapped != NULL;
+        }
+        if (!Persistent)
+        {
+            glBufferData(GL_COPY_WRITE_BUFFER, frameSize, NULL, GL_STREAM_DRAW);
+            staging.resize(frameSize);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        std::cout << "Ring buffer: " << (Persistent ? "persistently mapped" : "orphaned") << ", " << frameSize / 1024 << " KB per frame" << std::endl;
+    }
+
+    // bytes behind Buffer, every frame's region when persistent
+    GLsizeiptr Capacity() const
+    {
+        return Persistent ? frameSize * RING_FRAMES : frameSize;
+    }
+
+    ~RingBuffer()
+    {
+        for (unsigned int i = 0; i < RING_FRAMES; i++)
+            if (fences[i])
+                glDeleteSync(fences[i]);
+        if (Persistent)
+        {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, Buffer);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+        glDeleteBuffers(1, &Buffer);
+    }
+
+    // moves on to the next region, only waits if the GPU is still RING_FRAMES frames behind
+    void BeginFrame()
+    {
+        if (Persistent)
+        {
+            region = (region + 1) % RING_FRAMES;
+            if (fences[region])
+            {
+                GLenum result = glClientWaitSync(fences[region], 0, 0);
+                if (result == GL_TIMEOUT_EXPIRED)
+                {
+                    Stalls++;
+                    while (result == GL_TIMEOUT_EXPIRED)
+                        result = glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, RING_FENCE_TIMEOUT);
+                }
+                glDeleteSync(fences[region]);
+                fences[region] = 0;
+            }
+        }
+        else
+        {
+            // the draws of earlier frames keep the old storage
+            glBindBuffer(GL_COPY_WRITE_BUFFER, Buffer);
+            glBufferData(GL_COPY_WRITE_BUFFER, frameSize, NULL, GL_STREAM_DRAW);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+        head = 0;
+    }
+
+    // call after the frame's last command that reads the buffer
+    void EndFrame()
+    {
+        if (Persistent)
+            fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    // alignment must be a power of two, pass UniformAlignment for uniform blocks
+    Allocation Allocate(GLsizeiptr size, GLsizeiptr alignment = 16)
+    {
+        Allocation allocation;
+        GLsizeiptr start = (head + alignment - 1) & ~(alignment - 1);
+        if (start + size > frameSize)
+        {
+            if (!overflowReported)
+                std::cout << "Ring buffer: a frame needs more than " << frameSize / 1024 << " KB" << std::endl;
+            overflowReported = true;
+            return allocation;
+        }
+        head = start + size;
+        allocation.Offset = (Persistent ? region * frameSize : 0) + start;
+        allocation.Pointer = Persistent ? mapped + allocation.Offset : &staging[start];
+        allocation.Size = size;
+        return allocation;
+    }
+
+    // makes an allocation's data visible to the GPU, a no-op when the buffer is coherently mapped
+    void Commit(const Allocation& allocation)
+    {
+        if (!allocation.Pointer)
+            return;
+        if (Persistent)
+        {
+            GL_STATS_UPLOAD(allocation.Size);
+            return;
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, Buffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.Offset, allocation.Size, allocation.Pointer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    // copies data in and commits it
+    Allocation Upload(const void* data, GLsizeiptr size, GLsizeiptr alignment = 16)
+    {
+        Allocation allocation = Allocate(size, alignment);
+        if (allocation.Pointer)
+        {
+            std::memcpy(allocation.Pointer, data, size);
+            Commit(allocation);
+        }
+        return allocation;
+    }
+
+private:
+    typedef void (APIENTRYP BufferStorageProc)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+
+    GLsizeiptr frameSize;
+    GLsizeiptr head = 0;
+    unsigned int region = 0;
+    GLsync fences[RING_FRAMES] = {};
+    char* mapped = NULL;
+    std::vector<char> staging;
+    bool overflowReported = false;
+
+    static bool hasExtension(const char* name)
+    {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; i++)
+            if (std::strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), name) == 0)
+                return true;
+        return false;
+    }
+
+    // NULL unless the context is 4.4+ or has ARB_buffer_storage
+    static BufferStorageProc loadBufferStorage()
+    {
+        GLint major = 0, minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        if (major * 10 + minor < 44 && !hasExtension("GL_ARB_buffer_storage"))
+            return NULL;
+        // the extension uses the core name
+        return (BufferStorageProc)glfwGetProcAddress("glBufferStorage");
+    }
+};
+#endif
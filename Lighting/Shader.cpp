@@ -1,68 +1,49 @@
 #include "Shader.h"
 
-Shader::Shader(const char* vertexPath, const char* fragmentPath) {
-	std::string vertexCode;
-	std::string fragmentCode;
-	std::ifstream vShaderFile;
-	std::ifstream fShaderFile;
-
-	vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-	fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+// glad is generated for GL 3.3
+#ifndef GL_COMPUTE_SHADER
+#define GL_COMPUTE_SHADER 0x91B9
+#endif
 
-	try {
-		vShaderFile.open(vertexPath);
-		fShaderFile.open(fragmentPath);
-		std::stringstream vShaderStream, fShaderStream;
+Shader::Shader(const char* vertexPath, const char* fragmentPath) : Shader(vertexPath, fragmentPath, NULL, std::vector<std::string>()) {
+}
 
-		vShaderStream << vShaderFile.rdbuf();  //read buffer of
-		fShaderStream << fShaderFile.rdbuf();  //vertex and fragment shader files
+Shader::Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath) : Shader(vertexPath, fragmentPath, geometryPath, std::vector<std::string>()) {
+}
 
-		vShaderFile.close();
-		fShaderFile.close();
+Shader::Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath, const std::vector<std::string>& defines) {
+	std::string vertexCode;
+	std::string fragmentCode;
+	std::string geometryCode;
 
-		vertexCode = vShaderStream.str();
-		fragmentCode = fShaderStream.str();
+	try {
+		vertexCode = preprocess(readFile(vertexPath), defines);
+		fragmentCode = preprocess(readFile(fragmentPath), defines);
+		if (geometryPath != NULL)
+			geometryCode = preprocess(readFile(geometryPath), defines);
 	}
 	catch (std::ifstream::failure e) {
 		std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ" << std::endl;
 	}
 
-	const char* vShaderCode = vertexCode.c_str();
-	//std::cout << version + parameters + fragmentCode << std::endl;
-	const char* fShaderCode = fragmentCode.c_str();
-
-	unsigned int vertex, fragment;
+	unsigned int vertex, fragment, geometry = 0;
 	int success;
 	char infoLog[512];
 
 	// vertex Shader
-	vertex = glCreateShader(GL_VERTEX_SHADER);
-	glShaderSource(vertex, 1, &vShaderCode, NULL);
-	glCompileShader(vertex);
-	// print compile errors if any
-	glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
-	if (!success)
-	{
-		glGetShaderInfoLog(vertex, 512, NULL, infoLog);
-		std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
-	};
-
+	vertex = compile(GL_VERTEX_SHADER, vertexCode.c_str(), "VERTEX");
 	// fragment Shader
-	fragment = glCreateShader(GL_FRAGMENT_SHADER);
-	glShaderSource(fragment, 1, &fShaderCode, NULL);
-	glCompileShader(fragment);
-	// print compile errors if any
-	glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
-	if (!success)
-	{
-		glGetShaderInfoLog(fragment, 512, NULL, infoLog);
-		std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
-	};
+	fragment = compile(GL_FRAGMENT_SHADER, fragmentCode.c_str(), "FRAGMENT");
+	//geomtry Shader
+	if (geometryPath != NULL)
+		geometry = compile(GL_GEOMETRY_SHADER, geometryCode.c_str(), "GEOMETRY");
 
 	//shader program
 	ID = glCreateProgram();
 	glAttachShader(ID, vertex);
 	glAttachShader(ID, fragment);
+	if (geometryPath != NULL)
+		glAttachShader(ID, geometry);
 	glLinkProgram(ID);
 
 	glGetProgramiv(ID, GL_LINK_STATUS, &success);
@@ -74,91 +55,27 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath) {
 
 	glDeleteShader(vertex);
 	glDeleteShader(fragment);
+	if (geometryPath != NULL)
+		glDeleteShader(geometry);
 }
 
-Shader::Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath) {
-	std::string vertexCode;
-	std::string fragmentCode;
-	std::string geometryCode;
-	std::ifstream vShaderFile;
-	std::ifstream fShaderFile;
-	std::ifstream gShaderFile;
-
-	vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-	fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-	gShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-
+Shader::Shader(const char* computePath) {
+	std::string computeCode;
 	try {
-		vShaderFile.open(vertexPath);
-		fShaderFile.open(fragmentPath);
-		gShaderFile.open(geometryPath);
-		std::stringstream vShaderStream, fShaderStream, gShaderStream;
-
-		vShaderStream << vShaderFile.rdbuf();  //read buffer of
-		fShaderStream << fShaderFile.rdbuf();  //vertex and fragment shader files
-		gShaderStream << gShaderFile.rdbuf();  // read buffer of geometry shader file
-
-		vShaderFile.close();
-		fShaderFile.close();
-		gShaderFile.close();
-
-		vertexCode = vShaderStream.str();
-		fragmentCode = fShaderStream.str();
-		geometryCode = gShaderStream.str();
+		computeCode = preprocess(readFile(computePath), std::vector<std::string>());
 	}
 	catch (std::ifstream::failure e) {
 		std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ" << std::endl;
 	}
 
-	const char* vShaderCode = vertexCode.c_str();
-	const char* fShaderCode = fragmentCode.c_str();
-	const char* gShaderCode = geometryCode.c_str();
-
-	unsigned int vertex, fragment, geometry;
 	int success;
 	char infoLog[512];
 
-	// vertex Shader
-	vertex = glCreateShader(GL_VERTEX_SHADER);
-	glShaderSource(vertex, 1, &vShaderCode, NULL);
-	glCompileShader(vertex);
-	// print compile errors if any
-	glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
-	if (!success)
-	{
-		glGetShaderInfoLog(vertex, 512, NULL, infoLog);
-		std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
-	};
-
-	// fragment Shader
-	fragment = glCreateShader(GL_FRAGMENT_SHADER);
-	glShaderSource(fragment, 1, &fShaderCode, NULL);
-	glCompileShader(fragment);
-	// print compile errors if any
-	glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
-	if (!success)
-	{
-		glGetShaderInfoLog(fragment, 512, NULL, infoLog);
-		std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
-	};
-
-	//geomtry Shader
-	geometry = glCreateShader(GL_GEOMETRY_SHADER);
-	glShaderSource(geometry, 1, &gShaderCode, NULL);
-	glCompileShader(geometry);
-	// print compile errors if any
-	glGetShaderiv(geometry, GL_COMPILE_STATUS, &success);
-	if (!success)
-	{
-		glGetShaderInfoLog(geometry, 512, NULL, infoLog);
-		std::cout << "ERROR::SHADER::GEOMETRY::COMPILATION_FAILED\n" << infoLog << std::endl;
-	};
+	unsigned int compute = compile(GL_COMPUTE_SHADER, computeCode.c_str(), "COMPUTE");
 
 	//shader program
 	ID = glCreateProgram();
-	glAttachShader(ID, vertex);
-	glAttachShader(ID, fragment);
-	glAttachShader(ID, geometry);
+	glAttachShader(ID, compute);
 	glLinkProgram(ID);
 
 	glGetProgramiv(ID, GL_LINK_STATUS, &success);
@@ -168,9 +85,59 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath, const char* geo
 		std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
 	}
 
-	glDeleteShader(vertex);
-	glDeleteShader(fragment);
-	glDeleteShader(geometry);
+	glDeleteShader(compute);
+}
+
+std::string Shader::readFile(const char* path) {
+	std::ifstream shaderFile;
+	shaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+	shaderFile.open(path);
+	std::stringstream shaderStream;
+	shaderStream << shaderFile.rdbuf();  //read buffer of the shader file
+	shaderFile.close();
+	return shaderStream.str();
+}
+
+// injects the defines after the #version line and pastes in any #include "file" (relative to the working directory, like the shaders themselves)
+std::string Shader::preprocess(const std::string& code, const std::vector<std::string>& defines) {
+	std::stringstream in(code);
+	std::string result, line;
+	bool versionSeen = false;
+	while (std::getline(in, line)) {
+		if (line.compare(0, 8, "#include") == 0) {
+			size_t first = line.find('"');
+			size_t last = line.find_last_of('"');
+			if (first != std::string::npos && last > first) {
+				std::string included = line.substr(first + 1, last - first - 1);
+				result += preprocess(readFile(included.c_str()), std::vector<std::string>()) + "\n";
+				continue;
+			}
+		}
+		result += line + "\n";
+		if (!versionSeen && line.compare(0, 8, "#version") == 0) {
+			versionSeen = true;
+			for (unsigned int i = 0; i < defines.size(); i++)
+				result += "#define " + defines[i] + "\n";
+		}
+	}
+	return result;
+}
+
+unsigned int Shader::compile(GLenum type, const char* code, const char* name) {
+	int success;
+	char infoLog[512];
+
+	unsigned int shader = glCreateShader(type);
+	glShaderSource(shader, 1, &code, NULL);
+	glCompileShader(shader);
+	// print compile errors if any
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+	if (!success)
+	{
+		glGetShaderInfoLog(shader, 512, NULL, infoLog);
+		std::cout << "ERROR::SHADER::" << name << "::COMPILATION_FAILED\n" << infoLog << std::endl;
+	};
+	return shader;
 }
 
 void Shader::use() {
@@ -189,6 +156,16 @@ void Shader::setFloat(const std::string& name, float value) const {
 	glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
 }
 
+void Shader::setVec2(const std::string& name, float x, float y) const
+{
+	glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+}
+
+void Shader::setVec4(const std::string& name, const glm::vec4& value) const
+{
+	glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+}
+
 void Shader::setMat4(const std::string& name, const glm::mat4& mat) const
 {
 	glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
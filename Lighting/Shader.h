@@ -3,6 +3,7 @@
 #define _CRT_SECURE_NO_WARNINGS
 
 #include <glad/glad.h>
+#include "GLState.h"
 #include <glm/glm.hpp>
 #include <vector>
 
@@ -17,13 +18,24 @@ public:
 
 	Shader(const char* vertexPath, const char* fragmentPath);
 	Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath);
+	// geometryPath may be NULL, every name in defines is #defined right after the #version line
+	Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath, const std::vector<std::string>& defines);
+	// a compute program, needs a GL 4.3 context
+	explicit Shader(const char* computePath);
 	void use(); //activate shader
 	void setBool(const std::string &name, bool value) const;
 	void setInt(const std::string &name, int value) const;
 	void setFloat(const std::string &name, float value) const;
+	void setVec2(const std::string& name, float x, float y) const;
+	void setVec4(const std::string& name, const glm::vec4& value) const;
 	void setMat4(const std::string& name, const glm::mat4& mat) const;
 	void setVec3(const std::string& name, float x, float y, float z) const;
 	void setVec3(const std::string& name, const glm::vec3& value) const;
+
+private:
+	static std::string readFile(const char* path);
+	static std::string preprocess(const std::string& code, const std::vector<std::string>& defines);
+	static unsigned int compile(GLenum type, const char* code, const char* name);
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,24 @@
+#version 330 core
+out vec2 FragMoments;
+
+in vec2 TexCoord;
+
+// separable gaussian over one cascade tile of the moments, taps are clamped to the tile
+uniform sampler2D image;
+uniform vec4 rect;
+uniform vec2 direction;
+uniform float weight[5] = float[] (0.227027, 0.1945946, 0.1216216, 0.054054, 0.016216);
+
+void main() {
+	vec2 texel = 1.0 / vec2(textureSize(image, 0));
+	vec2 minCoord = rect.xy + texel * 0.5;
+	vec2 maxCoord = rect.xy + rect.zw - texel * 0.5;
+	vec2 coord = rect.xy + TexCoord * rect.zw;
+
+	vec2 result = textureLod(image, coord, 0.0).rg * weight[0];
+	for (int i = 1; i < 5; i++) {
+		result += textureLod(image, clamp(coord + direction * float(i), minCoord, maxCoord), 0.0).rg * weight[i];
+		result += textureLod(image, clamp(coord - direction * float(i), minCoord, maxCoord), 0.0).rg * weight[i];
+	}
+	FragMoments = result;
+}
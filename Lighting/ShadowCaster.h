@@ -0,0 +1,13 @@
+#ifndef SHADOW_CASTER_H
+#define SHADOW_CASTER_H
+
+#include <glm/glm.hpp>
+
+#include "Model.h"
+
+// a model drawn into the shadow maps with its model matrix
+struct ShadowCaster {
+    Model* Caster;
+    glm::mat4 ModelMatrix;
+};
+#endif
@@ -0,0 +1,26 @@
+#version 330 core
+out vec2 FragMoments;
+
+in vec2 TexCoord;
+
+// raw depth of the shadow atlas, one cascade tile at a time
+uniform sampler2D depthAtlas;
+uniform vec4 rect;
+uniform int shadowFilter; // 1 VSM, 2 ESM
+
+const float ESM_EXPONENT = 80.0;
+
+void main() {
+	// the moments are half resolution, so every texel covers 2x2 depth texels
+	vec2 texel = 1.0 / vec2(textureSize(depthAtlas, 0));
+	vec2 coord = rect.xy + TexCoord * rect.zw;
+	vec2 moments = vec2(0.0);
+	for (int i = 0; i < 4; i++) {
+		float depth = texture(depthAtlas, coord + (vec2(i % 2, i / 2) - 0.5) * texel).r;
+		if (shadowFilter == 1)
+			moments += vec2(depth, depth * depth);
+		else
+			moments.x += exp(ESM_EXPONENT * depth);
+	}
+	FragMoments = moments * 0.25;
+}
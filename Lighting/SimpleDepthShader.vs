@@ -1,9 +1,10 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
+layout (location = 5) in mat4 aInstance;
 
 uniform mat4 lightSpaceMatrix;
 uniform mat4 model;
 
 void main() {
-	gl_Position = lightSpaceMatrix * model * vec4(aPos, 1.0f);
+	gl_Position = lightSpaceMatrix * model * aInstance * vec4(aPos, 1.0f);
 }
\ No newline at end of file
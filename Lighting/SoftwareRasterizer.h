@@ -0,0 +1,636 @@
+#ifndef SOFTWARE_RASTERIZER_H
+#define SOFTWARE_RASTERIZER_H
+
+#include <glm/glm.hpp>
+
+#include "stb_image.h"
+#include "Frustum.h"
+#include "JobSystem.h"
+#include "Model.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SOFTWARE_SSE
+#endif
+
+// Default software rasterizer values
+const unsigned int SOFT_TILE = 32;           // pixels per side of a binning tile, a multiple of 4
+const unsigned int SOFT_MESHES_PER_JOB = 8;  // meshes each geometry job transforms and bins
+const unsigned int SOFT_TILES_PER_JOB = 2;   // tiles each raster job fills and resolves
+const float SOFT_ALPHA_CUTOFF = 0.5f;        // the ALPHA_TEST discard of G-Buffer.fs
+const float SOFT_AMBIENT = 0.1f;             // of Shade(), which has no indirect light
+const float SOFT_GAMMA = 2.2f;               // decodes sRGB textures, encodes Shade()'s linear output for 8-bit images
+
+// An RGBA8 texture and its box filtered mip chain, sampled trilinearly with repeat wrapping like the
+// textures TextureFromFile creates. sRGB textures are decoded after filtering rather than before.
+struct SoftwareTexture {
+    struct Level {
+        unsigned int Width = 0, Height = 0;
+        std::vector<unsigned char> Texels;
+    };
+
+    std::vector<Level> Levels;
+    bool Cutout = false; // has texels with alpha below 0.5
+    bool SRGB = false;
+
+    bool Load(const std::string& filename, bool srgb)
+    {
+        int width, height, components;
+        unsigned char* data = stbi_load(filename.c_str(), &width, &height, &components, 4);
+        if (!data)
+            return false;
+        Level base;
+        base.Width = width;
+        base.Height = height;
+        base.Texels.assign(data, data + (size_t)width * height * 4);
+        stbi_image_free(data);
+        SRGB = srgb;
+        for (size_t i = 3; components == 4 && i < base.Texels.size() && !Cutout; i += 4)
+            Cutout = base.Texels[i] < 128;
+        Levels.push_back(base);
+        while (Levels.back().Width > 1 || Levels.back().Height > 1)
+            Levels.push_back(halve(Levels.back()));
+        return true;
+    }
+
+    glm::vec4 Sample(const glm::vec2& uv, float lod) const
+    {
+        lod = std::min(std::max(lod, 0.0f), (float)(Levels.size() - 1));
+        unsigned int level = (unsigned int)lod;
+        float blend = lod - level;
+        glm::vec4 color = bilinear(Levels[level], uv);
+        if (blend > 0.0f && level + 1 < Levels.size())
+            color = color + (bilinear(Levels[level + 1], uv) - color) * blend;
+        if (SRGB)
+            color = glm::vec4(std::pow(color.r, SOFT_GAMMA), std::pow(color.g, SOFT_GAMMA), std::pow(color.b, SOFT_GAMMA), color.a);
+        return color;
+    }
+
+    // the mip level GL picks for these screen-space texture coordinate derivatives
+    float Lod(const glm::vec2& ddx, const glm::vec2& ddy) const
+    {
+        float width = (float)Levels[0].Width, height = (float)Levels[0].Height;
+        float x = ddx.x * ddx.x * width * width + ddx.y * ddx.y * height * height;
+        float y = ddy.x * ddy.x * width * width + ddy.y * ddy.y * height * height;
+        return 0.5f * std::log2(std::max(std::max(x, y), 1e-12f));
+    }
+
+private:
+    static Level halve(const Level& above)
+    {
+        Level level;
+        level.Width = std::max(1u, above.Width / 2);
+        level.Height = std::max(1u, above.Height / 2);
+        level.Texels.resize((size_t)level.Width * level.Height * 4);
+        for (unsigned int y = 0; y < level.Height; y++)
+        {
+            unsigned int y0 = std::min(y * 2, above.Height - 1), y1 = std::min(y * 2 + 1, above.Height - 1);
+            for (unsigned int x = 0; x < level.Width; x++)
+            {
+                unsigned int x0 = std::min(x * 2, above.Width - 1), x1 = std::min(x * 2 + 1, above.Width - 1);
+                for (unsigned int c = 0; c < 4; c++)
+                {
+                    unsigned int sum = above.Texels[((size_t)y0 * above.Width + x0) * 4 + c] + above.Texels[((size_t)y0 * above.Width + x1) * 4 + c]
+                        + above.Texels[((size_t)y1 * above.Width + x0) * 4 + c] + above.Texels[((size_t)y1 * above.Width + x1) * 4 + c];
+                    level.Texels[((size_t)y * level.Width + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+                }
+            }
+        }
+        return level;
+    }
+
+    static int wrap(int i, int size)
+    {
+        i %= size;
+        return i < 0 ? i + size : i;
+    }
+
+    static glm::vec4 texel(const Level& level, int x, int y)
+    {
+        const unsigned char* t = &level.Texels[((size_t)y * level.Width + x) * 4];
+        return glm::vec4(t[0], t[1], t[2], t[3]);
+    }
+
+    static glm::vec4 bilinear(const Level& level, const glm::vec2& uv)
+    {
+        float x = uv.x * level.Width - 0.5f, y = uv.y * level.Height - 0.5f;
+        float fx = std::floor(x), fy = std::floor(y);
+        float tx = x - fx, ty = y - fy;
+        int x0 = wrap((int)fx, level.Width), y0 = wrap((int)fy, level.Height);
+        int x1 = x0 + 1 < (int)level.Width ? x0 + 1 : 0, y1 = y0 + 1 < (int)level.Height ? y0 + 1 : 0;
+        glm::vec4 top = texel(level, x0, y0) + (texel(level, x1, y0) - texel(level, x0, y0)) * tx;
+        glm::vec4 bottom = texel(level, x0, y1) + (texel(level, x1, y1) - texel(level, x0, y1)) * tx;
+        return (top + (bottom - top) * ty) * (1.0f / 255.0f);
+    }
+};
+
+// The classic layout of the G-Buffer.fs targets in memory, rows bottom to top like GL's.
+struct SoftwareGBuffer {
+    unsigned int Width = 0, Height = 0;
+    std::vector<glm::vec3> Position;   // gPosition, world space
+    std::vector<glm::vec3> Normal;     // gNormal, normal mapped
+    std::vector<glm::vec4> AlbedoSpec; // gAlbedoSpec, diffuse colour and specular intensity
+    std::vector<float> Depth;          // window depth, 1 where nothing was drawn
+
+    void Resize(unsigned int width, unsigned int height)
+    {
+        Width = width;
+        Height = height;
+        Position.resize((size_t)width * height);
+        Normal.resize((size_t)width * height);
+        AlbedoSpec.resize((size_t)width * height);
+        Depth.resize((size_t)width * height);
+    }
+};
+
+// Renders a Model into a SoftwareGBuffer on the CPU, for hosts without a GPU. A frame runs in two
+// parallel stages over the job system:
+//  - geometry: the meshes left by the frustum cull are split into groups, each job transforms its
+//    group like G-Buffer.vs, clips the triangles against the near plane, sets up their edge and
+//    attribute planes and bins them into the screen tiles they overlap
+//  - raster: each job owns whole tiles, depth tests the tile's triangles four pixels at a time into a
+//    tile-sized depth and triangle buffer, then shades the surviving triangle of every pixel once,
+//    with perspective-correct attributes and a mip level from their screen-space derivatives
+// Groups are binned in mesh order, so the GL_LESS depth test settles ties the same way on any number
+// of threads. Nothing here touches OpenGL, the model has to be loaded without gpu.
+class SoftwareRasterizer
+{
+public:
+    unsigned int MeshesDrawn = 0, TrianglesDrawn = 0; // by the last Render(), after clipping
+
+    SoftwareRasterizer(JobSystem& jobs) : jobs(jobs)
+    {
+    }
+
+    // decodes every texture of the model and its mip chain, in parallel
+    void LoadTextures(const Model& model)
+    {
+        // the map is only filled in here, so the jobs never insert into it
+        std::vector<std::pair<const Texture*, SoftwareTexture*>> pending;
+        for (unsigned int i = 0; i < model.textures_loaded.size(); i++)
+        {
+            const Texture& texture = model.textures_loaded[i];
+            if (textures.find(texture.id) == textures.end())
+                pending.push_back(std::make_pair(&texture, &textures[texture.id]));
+        }
+        JobCounter loads;
+        jobs.ParallelFor(pending.size(), 1, [&](unsigned int begin, unsigned int end) {
+            for (unsigned int i = begin; i < end; i++)
+            {
+                // the same sRGB rule as TextureFromFile
+                const Texture& texture = *pending[i].first;
+                if (!pending[i].second->Load(model.directory + '/' + texture.path, texture.path == "diffuse.jpg"))
+                    std::cout << "Texture failed to load at path: " << texture.path << std::endl;
+            }
+        }, loads);
+        jobs.Wait(loads);
+
+        // G-Buffer.fs samples the first texture of each kind
+        materials.assign(model.meshes.size(), Material());
+        for (unsigned int m = 0; m < model.meshes.size(); m++)
+        {
+            Material& material = materials[m];
+            for (unsigned int t = 0; t < model.meshes[m].textures.size(); t++)
+            {
+                const Texture& texture = model.meshes[m].textures[t];
+                const SoftwareTexture* loaded = &textures[texture.id];
+                if (loaded->Levels.empty())
+                    continue;
+                if (texture.type == "texture_diffuse" && !material.Diffuse)
+                    material.Diffuse = loaded;
+                else if (texture.type == "texture_specular" && !material.Specular)
+                    material.Specular = loaded;
+                else if (texture.type == "texture_normal" && !material.Normal)
+                    material.Normal = loaded;
+            }
+            material.AlphaTested = material.Diffuse && material.Diffuse->Cutout;
+        }
+    }
+
+    void Render(Model& model, const glm::mat4& transform, const glm::mat4& view, const glm::mat4& projection, SoftwareGBuffer& gBuffer)
+    {
+        glm::mat4 viewProjection = projection * view;
+        model.UpdateBounds(transform);
+        MeshesDrawn = model.Cull(Frustum(viewProjection), drawList);
+        visible.clear();
+        for (unsigned int i = 0; i < drawList.Visible.size(); i++)
+            if (drawList.Visible[i])
+                visible.push_back(i);
+        if (materials.size() != model.meshes.size())
+            materials.resize(model.meshes.size());
+
+        width = gBuffer.Width;
+        height = gBuffer.Height;
+        tilesX = (width + SOFT_TILE - 1) / SOFT_TILE;
+        unsigned int tiles = tilesX * ((height + SOFT_TILE - 1) / SOFT_TILE);
+        unsigned int groups = (visible.size() + SOFT_MESHES_PER_JOB - 1) / SOFT_MESHES_PER_JOB;
+        if (bins.size() < groups)
+            bins.resize(groups);
+        for (unsigned int b = 0; b < groups; b++)
+        {
+            bins[b].Triangles.clear();
+            bins[b].Tiles.resize(tiles);
+            for (unsigned int t = 0; t < tiles; t++)
+                bins[b].Tiles[t].clear();
+        }
+        usedBins = groups;
+
+        JobCounter geometry;
+        jobs.ParallelFor(visible.size(), SOFT_MESHES_PER_JOB, [&](unsigned int begin, unsigned int end) {
+            Bin& bin = bins[begin / SOFT_MESHES_PER_JOB];
+            for (unsigned int i = begin; i < end; i++)
+                setupMesh(model, visible[i], transform, viewProjection, bin);
+        }, geometry);
+        jobs.Wait(geometry);
+        TrianglesDrawn = 0;
+        for (unsigned int b = 0; b < usedBins; b++)
+            TrianglesDrawn += bins[b].Triangles.size();
+
+        JobCounter raster;
+        jobs.ParallelFor(tiles, SOFT_TILES_PER_JOB, [&](unsigned int begin, unsigned int end) {
+            for (unsigned int t = begin; t < end; t++)
+                rasterizeTile(t, gBuffer);
+        }, raster);
+        jobs.Wait(raster);
+    }
+
+    // a quick look at the G-Buffer without the lighting pass: the diffuse colour lit by the sun and a
+    // flat ambient, as RGBA floats for ImageWriter
+    void Shade(const SoftwareGBuffer& gBuffer, const glm::vec3& lightDir, std::vector<float>& rgba)
+    {
+        rgba.assign((size_t)gBuffer.Width * gBuffer.Height * 4, 0.0f);
+        JobCounter rows;
+        jobs.ParallelFor(gBuffer.Height, SOFT_TILE, [&](unsigned int begin, unsigned int end) {
+            for (size_t pixel = (size_t)begin * gBuffer.Width; pixel < (size_t)end * gBuffer.Width; pixel++)
+            {
+                rgba[pixel * 4 + 3] = 1.0f;
+                if (gBuffer.Depth[pixel] >= 1.0f)
+                    continue;
+                glm::vec3 color = glm::vec3(gBuffer.AlbedoSpec[pixel]) * (SOFT_AMBIENT + std::max(glm::dot(gBuffer.Normal[pixel], -lightDir), 0.0f));
+                rgba[pixel * 4] = color.r;
+                rgba[pixel * 4 + 1] = color.g;
+                rgba[pixel * 4 + 2] = color.b;
+            }
+        }, rows);
+        jobs.Wait(rows);
+    }
+
+private:
+    // attributes interpolated across a triangle, in the order of G-Buffer.vs's outputs
+    static const unsigned int ATTR_POSITION = 0, ATTR_UV = 3, ATTR_TANGENT = 5, ATTR_BITANGENT = 8, ATTR_NORMAL = 11, ATTRIBUTES = 14;
+
+    struct Material {
+        const SoftwareTexture* Diffuse = NULL;
+        const SoftwareTexture* Specular = NULL;
+        const SoftwareTexture* Normal = NULL;
+        bool AlphaTested = false;
+    };
+
+    // a * x + b * y + c, with x and y relative to the triangle's first vertex to keep float precision
+    struct Plane {
+        float A, B, C;
+
+        float At(float x, float y) const
+        {
+            return A * x + B * y + C;
+        }
+    };
+
+    struct ClipVertex {
+        glm::vec4 Clip;
+        float Attributes[ATTRIBUTES];
+    };
+
+    struct Triangle {
+        float OriginX, OriginY;               // screen position of the first vertex
+        float EdgeA[3], EdgeB[3], EdgeC[3];   // inside where all three are positive
+        Plane Z, InvW;
+        Plane Attributes[ATTRIBUTES];         // each divided by w, for perspective correction
+        int MinX, MinY, MaxX, MaxY;           // pixel bounds, on screen
+        const Material* Surface;
+    };
+
+    // the triangles of one geometry job and, per tile, the ones overlapping it
+    struct Bin {
+        std::vector<Triangle> Triangles;
+        std::vector<std::vector<unsigned int>> Tiles;
+    };
+
+    JobSystem& jobs;
+    std::map<unsigned int, SoftwareTexture> textures; // by Texture::id
+    std::vector<Material> materials;                  // of every mesh
+    DrawList drawList;
+    std::vector<unsigned int> visible;
+    std::vector<Bin> bins;
+    unsigned int usedBins = 0;
+    unsigned int width = 0, height = 0, tilesX = 0;
+
+    static glm::vec3 safeNormalize(const glm::vec3& v)
+    {
+        float length = glm::length(v);
+        return length > 0.0f ? v / length : v;
+    }
+
+    void setupMesh(const Model& model, unsigned int m, const glm::mat4& transform, const glm::mat4& viewProjection, Bin& bin) const
+    {
+        // copies are drawn from their original's vertices
+        const Mesh& geometry = model.Geometry(m);
+        glm::mat4 world = transform * model.meshes[m].Transform;
+        std::vector<ClipVertex> vertices(geometry.vertices.size());
+        for (unsigned int v = 0; v < vertices.size(); v++)
+        {
+            const Vertex& vertex = geometry.vertices[v];
+            ClipVertex& out = vertices[v];
+            glm::vec4 worldPos = world * glm::vec4(vertex.Position, 1.0f);
+            glm::vec3 T = safeNormalize(glm::vec3(world * glm::vec4(vertex.Tangent, 0.0f)));
+            glm::vec3 B = safeNormalize(glm::vec3(world * glm::vec4(vertex.Bitangent, 0.0f)));
+            glm::vec3 N = safeNormalize(glm::vec3(world * glm::vec4(vertex.Normal, 0.0f)));
+            out.Clip = viewProjection * worldPos;
+            for (unsigned int c = 0; c < 3; c++)
+            {
+                out.Attributes[ATTR_POSITION + c] = worldPos[c];
+                out.Attributes[ATTR_TANGENT + c] = T[c];
+                out.Attributes[ATTR_BITANGENT + c] = B[c];
+                out.Attributes[ATTR_NORMAL + c] = N[c];
+            }
+            out.Attributes[ATTR_UV] = vertex.TexCoords.x;
+            out.Attributes[ATTR_UV + 1] = vertex.TexCoords.y;
+        }
+
+        const Material* surface = &materials[m];
+        for (unsigned int i = 0; i + 2 < geometry.indices.size(); i += 3)
+        {
+            const ClipVertex* corners[3] = { &vertices[geometry.indices[i]], &vertices[geometry.indices[i + 1]], &vertices[geometry.indices[i + 2]] };
+            // all three outside the same side or far plane
+            bool outside = false;
+            for (unsigned int p = 0; p < 5 && !outside; p++)
+            {
+                outside = true;
+                for (unsigned int v = 0; v < 3 && outside; v++)
+                {
+                    const glm::vec4& clip = corners[v]->Clip;
+                    float value = p == 4 ? clip.z : clip[p / 2];
+                    outside = (p & 1) || p == 4 ? value > clip.w : value < -clip.w;
+                }
+            }
+            if (outside)
+                continue;
+            if (corners[0]->Clip.z >= -corners[0]->Clip.w && corners[1]->Clip.z >= -corners[1]->Clip.w && corners[2]->Clip.z >= -corners[2]->Clip.w)
+            {
+                setupTriangle(*corners[0], *corners[1], *corners[2], surface, bin);
+                continue;
+            }
+            // crosses the near plane: clipped to a polygon of up to four vertices and drawn as a fan
+            ClipVertex polygon[4];
+            unsigned int count = 0;
+            for (unsigned int e = 0; e < 3; e++)
+            {
+                const ClipVertex& a = *corners[e];
+                const ClipVertex& b = *corners[(e + 1) % 3];
+                float da = a.Clip.z + a.Clip.w, db = b.Clip.z + b.Clip.w;
+                if (da >= 0.0f)
+                    polygon[count++] = a;
+                if ((da >= 0.0f) != (db >= 0.0f))
+                    polygon[count++] = lerp(a, b, da / (da - db));
+            }
+            for (unsigned int v = 1; v + 1 < count; v++)
+                setupTriangle(polygon[0], polygon[v], polygon[v + 1], surface, bin);
+        }
+    }
+
+    static ClipVertex lerp(const ClipVertex& a, const ClipVertex& b, float t)
+    {
+        ClipVertex result;
+        result.Clip = a.Clip + (b.Clip - a.Clip) * t;
+        for (unsigned int c = 0; c < ATTRIBUTES; c++)
+            result.Attributes[c] = a.Attributes[c] + (b.Attributes[c] - a.Attributes[c]) * t;
+        return result;
+    }
+
+    void setupTriangle(const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2, const Material* surface, Bin& bin) const
+    {
+        const ClipVertex* corners[3] = { &v0, &v1, &v2 };
+        float X[3], Y[3], Z[3], invW[3];
+        for (unsigned int v = 0; v < 3; v++)
+        {
+            invW[v] = 1.0f / corners[v]->Clip.w;
+            X[v] = (corners[v]->Clip.x * invW[v] * 0.5f + 0.5f) * width;
+            Y[v] = (corners[v]->Clip.y * invW[v] * 0.5f + 0.5f) * height;
+            Z[v] = corners[v]->Clip.z * invW[v] * 0.5f + 0.5f;
+        }
+        float area = (X[1] - X[0]) * (Y[2] - Y[0]) - (X[2] - X[0]) * (Y[1] - Y[0]);
+        // also drops the NaNs of a degenerate vertex
+        if (!(std::fabs(area) > 1e-8f))
+            return;
+        // counter-clockwise, so inside is where all three edge functions are positive
+        if (area < 0.0f)
+        {
+            std::swap(corners[1], corners[2]);
+            std::swap(X[1], X[2]);
+            std::swap(Y[1], Y[2]);
+            std::swap(Z[1], Z[2]);
+            std::swap(invW[1], invW[2]);
+            area = -area;
+        }
+
+        Triangle tri;
+        tri.MinX = std::max(0, (int)std::floor(std::min(X[0], std::min(X[1], X[2]))));
+        tri.MaxX = std::min((int)width - 1, (int)std::ceil(std::max(X[0], std::max(X[1], X[2]))));
+        tri.MinY = std::max(0, (int)std::floor(std::min(Y[0], std::min(Y[1], Y[2]))));
+        tri.MaxY = std::min((int)height - 1, (int)std::ceil(std::max(Y[0], std::max(Y[1], Y[2]))));
+        if (tri.MinX > tri.MaxX || tri.MinY > tri.MaxY)
+            return;
+        tri.OriginX = X[0];
+        tri.OriginY = Y[0];
+        tri.Surface = surface;
+        // edge i runs from vertex i to vertex i+1: E = A x + B y + C, relative to vertex 0
+        for (unsigned int e = 0; e < 3; e++)
+        {
+            unsigned int n = (e + 1) % 3;
+            tri.EdgeA[e] = Y[e] - Y[n];
+            tri.EdgeB[e] = X[n] - X[e];
+            tri.EdgeC[e] = (X[e] - X[0]) * (Y[n] - Y[0]) - (X[n] - X[0]) * (Y[e] - Y[0]);
+        }
+        // values as planes in screen space, from the barycentric weights
+        auto plane = [&](float q0, float q1, float q2) {
+            Plane p;
+            p.A = (tri.EdgeA[1] * q0 + tri.EdgeA[2] * q1 + tri.EdgeA[0] * q2) / area;
+            p.B = (tri.EdgeB[1] * q0 + tri.EdgeB[2] * q1 + tri.EdgeB[0] * q2) / area;
+            p.C = q0;
+            return p;
+        };
+        tri.Z = plane(Z[0], Z[1], Z[2]);
+        tri.InvW = plane(invW[0], invW[1], invW[2]);
+        for (unsigned int c = 0; c < ATTRIBUTES; c++)
+            tri.Attributes[c] = plane(corners[0]->Attributes[c] * invW[0], corners[1]->Attributes[c] * invW[1], corners[2]->Attributes[c] * invW[2]);
+
+        unsigned int index = bin.Triangles.size();
+        bin.Triangles.push_back(tri);
+        for (int ty = tri.MinY / (int)SOFT_TILE; ty <= tri.MaxY / (int)SOFT_TILE; ty++)
+            for (int tx = tri.MinX / (int)SOFT_TILE; tx <= tri.MaxX / (int)SOFT_TILE; tx++)
+                bin.Tiles[ty * tilesX + tx].push_back(index);
+    }
+
+    // the attributes at a pixel centre relative to the triangle's origin, divided back by w
+    static float interpolate(const Triangle& tri, float x, float y, float* attributes, unsigned int first, unsigned int count)
+    {
+        float w = 1.0f / tri.InvW.At(x, y);
+        for (unsigned int c = first; c < first + count; c++)
+            attributes[c] = tri.Attributes[c].At(x, y) * w;
+        return w;
+    }
+
+    // screen-space derivatives of the texture coordinates at a pixel, for the mip level
+    static void uvDerivatives(const Triangle& tri, const glm::vec2& uv, float w, glm::vec2& ddx, glm::vec2& ddy)
+    {
+        ddx = glm::vec2(tri.Attributes[ATTR_UV].A - uv.x * tri.InvW.A, tri.Attributes[ATTR_UV + 1].A - uv.y * tri.InvW.A) * w;
+        ddy = glm::vec2(tri.Attributes[ATTR_UV].B - uv.x * tri.InvW.B, tri.Attributes[ATTR_UV + 1].B - uv.y * tri.InvW.B) * w;
+    }
+
+    // whether G-Buffer.fs would keep the fragment at the pixel centre
+    static bool alphaTest(const Triangle& tri, float x, float y)
+    {
+        float attributes[ATTRIBUTES];
+        float w = interpolate(tri, x, y, attributes, ATTR_UV, 2);
+        glm::vec2 uv(attributes[ATTR_UV], attributes[ATTR_UV + 1]), ddx, ddy;
+        uvDerivatives(tri, uv, w, ddx, ddy);
+        const SoftwareTexture& diffuse = *tri.Surface->Diffuse;
+        return diffuse.Sample(uv, diffuse.Lod(ddx, ddy)).a >= SOFT_ALPHA_CUTOFF;
+    }
+
+    void rasterizeTile(unsigned int tile, SoftwareGBuffer& gBuffer) const
+    {
+        int x0 = (tile % tilesX) * SOFT_TILE, y0 = (tile / tilesX) * SOFT_TILE;
+        int x1 = std::min(x0 + (int)SOFT_TILE, (int)width), y1 = std::min(y0 + (int)SOFT_TILE, (int)height);
+        float depth[SOFT_TILE * SOFT_TILE];
+        const Triangle* nearest[SOFT_TILE * SOFT_TILE];
+        std::fill(depth, depth + SOFT_TILE * SOFT_TILE, 1.0f);
+        std::fill(nearest, nearest + SOFT_TILE * SOFT_TILE, (const Triangle*)NULL);
+
+        for (unsigned int b = 0; b < usedBins; b++)
+        {
+            const std::vector<unsigned int>& list = bins[b].Tiles[tile];
+            for (unsigned int i = 0; i < list.size(); i++)
+                rasterize(bins[b].Triangles[list[i]], x0, y0, x1, y1, depth, nearest);
+        }
+
+        for (int y = y0; y < y1; y++)
+        {
+            for (int x = x0; x < x1; x++)
+            {
+                unsigned int local = (y - y0) * SOFT_TILE + (x - x0);
+                size_t pixel = (size_t)y * width + x;
+                gBuffer.Depth[pixel] = depth[local];
+                if (nearest[local])
+                {
+                    resolve(*nearest[local], x + 0.5f, y + 0.5f, gBuffer, pixel);
+                }
+                else
+                {
+                    gBuffer.Position[pixel] = glm::vec3(0.0f);
+                    gBuffer.Normal[pixel] = glm::vec3(0.0f);
+                    gBuffer.AlbedoSpec[pixel] = glm::vec4(0.0f);
+                }
+            }
+        }
+    }
+
+    // depth tests a triangle into the tile [x0, x1) x [y0, y1), keeping the nearest triangle per pixel
+    static void rasterize(const Triangle& tri, int x0, int y0, int x1, int y1, float* depth, const Triangle** nearest)
+    {
+        int minX = std::max(tri.MinX, x0), maxX = std::min(tri.MaxX, x1 - 1);
+        int minY = std::max(tri.MinY, y0), maxY = std::min(tri.MaxY, y1 - 1);
+        if (minX > maxX || minY > maxY)
+            return;
+        // groups of four from the tile's left edge, the tile buffers are whole tiles wide
+        minX = x0 + ((minX - x0) & ~3);
+        bool alphaTested = tri.Surface->AlphaTested;
+
+        for (int y = minY; y <= maxY; y++)
+        {
+            float py = y + 0.5f - tri.OriginY;
+            float* depthRow = depth + (y - y0) * SOFT_TILE - x0;
+            const Triangle** nearestRow = nearest + (y - y0) * SOFT_TILE - x0;
+#ifdef SOFTWARE_SSE
+            __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+            __m128 zero = _mm_setzero_ps();
+            __m128 edgeRow[3];
+            for (unsigned int e = 0; e < 3; e++)
+                edgeRow[e] = _mm_set1_ps(tri.EdgeB[e] * py + tri.EdgeC[e]);
+            __m128 zRow = _mm_set1_ps(tri.Z.B * py + tri.Z.C);
+            for (int x = minX; x <= maxX; x += 4)
+            {
+                __m128 px = _mm_add_ps(_mm_set1_ps(x - tri.OriginX), offsets);
+                __m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(tri.EdgeA[0]), px), edgeRow[0]), zero);
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(tri.EdgeA[1]), px), edgeRow[1]), zero));
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(tri.EdgeA[2]), px), edgeRow[2]), zero));
+                __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(tri.Z.A), px), zRow);
+                int mask = _mm_movemask_ps(_mm_and_ps(inside, _mm_cmplt_ps(z, _mm_loadu_ps(depthRow + x))));
+                if (mask == 0)
+                    continue;
+                float zs[4];
+                _mm_storeu_ps(zs, z);
+                for (int lane = 0; lane < 4; lane++)
+                {
+                    if (!(mask & (1 << lane)) || (alphaTested && !alphaTest(tri, x + lane + 0.5f - tri.OriginX, py)))
+                        continue;
+                    depthRow[x + lane] = zs[lane];
+                    nearestRow[x + lane] = &tri;
+                }
+            }
+#else
+            for (int x = minX; x <= maxX; x++)
+            {
+                float px = x + 0.5f - tri.OriginX;
+                if (tri.EdgeA[0] * px + tri.EdgeB[0] * py + tri.EdgeC[0] < 0.0f || tri.EdgeA[1] * px + tri.EdgeB[1] * py + tri.EdgeC[1] < 0.0f
+                    || tri.EdgeA[2] * px + tri.EdgeB[2] * py + tri.EdgeC[2] < 0.0f)
+                    continue;
+                float z = tri.Z.At(px, py);
+                if (!(z < depthRow[x]) || (alphaTested && !alphaTest(tri, px, py)))
+                    continue;
+                depthRow[x] = z;
+                nearestRow[x] = &tri;
+            }
+#endif
+        }
+    }
+
+    // what G-Buffer.fs writes for the triangle at a pixel centre
+    static void resolve(const Triangle& tri, float x, float y, SoftwareGBuffer& gBuffer, size_t pixel)
+    {
+        float attributes[ATTRIBUTES];
+        float w = interpolate(tri, x - tri.OriginX, y - tri.OriginY, attributes, 0, ATTRIBUTES);
+        glm::vec2 uv(attributes[ATTR_UV], attributes[ATTR_UV + 1]), ddx, ddy;
+        uvDerivatives(tri, uv, w, ddx, ddy);
+        glm::vec3 T(attributes[ATTR_TANGENT], attributes[ATTR_TANGENT + 1], attributes[ATTR_TANGENT + 2]);
+        glm::vec3 B(attributes[ATTR_BITANGENT], attributes[ATTR_BITANGENT + 1], attributes[ATTR_BITANGENT + 2]);
+        glm::vec3 N(attributes[ATTR_NORMAL], attributes[ATTR_NORMAL + 1], attributes[ATTR_NORMAL + 2]);
+        const Material& surface = *tri.Surface;
+
+        glm::vec3 normal = N;
+        if (surface.Normal)
+        {
+            glm::vec3 texel = glm::vec3(surface.Normal->Sample(uv, surface.Normal->Lod(ddx, ddy))) * 2.0f - glm::vec3(1.0f);
+            texel = safeNormalize(texel);
+            // checking for mirroring in normal map
+            if (glm::dot(glm::cross(T, B), N) < 0.0f)
+                T = -T;
+            normal = T * texel.x + B * texel.y + N * texel.z;
+        }
+        glm::vec4 albedo = surface.Diffuse ? surface.Diffuse->Sample(uv, surface.Diffuse->Lod(ddx, ddy)) : glm::vec4(1.0f);
+        float specular = surface.Specular ? surface.Specular->Sample(uv, surface.Specular->Lod(ddx, ddy)).r : 0.0f;
+
+        gBuffer.Position[pixel] = glm::vec3(attributes[ATTR_POSITION], attributes[ATTR_POSITION + 1], attributes[ATTR_POSITION + 2]);
+        gBuffer.Normal[pixel] = safeNormalize(normal);
+        gBuffer.AlbedoSpec[pixel] = glm::vec4(glm::vec3(albedo), specular);
+    }
+};
+#endif
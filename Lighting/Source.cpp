@@ -1,26 +1,47 @@
 #include <glad/glad.h>
+#include "GLState.h"
 #include <glfw/glfw3.h>
 #include <iostream>
+#include <memory>
 #include "Shader.h"
 #include "Camera.h"
 #include <glm/glm.hpp>
 #include "stb_image.h"
 #include "Model.h"
+#include "LightVolume.h"
+#include "LightSystem.h"
+#include "RenderGraph.h"
+#include "GBuffer.h"
+#include "CascadedShadowMap.h"
+#include "PointShadowAtlas.h"
+#include "Bloom.h"
+#include "GpuTimer.h"
+#include "DynamicResolution.h"
+#include "BVHBenchmark.h"
+#include "OcclusionCuller.h"
+#include "JobSystem.h"
+#include "RingBuffer.h"
+#include "IndirectDraw.h"
+#include "FrameTimings.h"
+#include "ImageWriter.h"
+#include "CameraPath.h"
+#include "SoftwareRasterizer.h"
+#include "Profiler.h"
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void processInput(GLFWwindow* window);
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
 unsigned int LoadTexture(const char* path, const string& directory);
-void createFrameBuffer(unsigned int* fbo, unsigned int* texColorBuffer, unsigned int* rbo, GLint Format, bool MultiSample);
-void createFrameBuffer(unsigned int* fbo, unsigned int* texColorBuffer, const char* format);
 unsigned int loadCubeMap(vector<std::string> texture_faces);
 
 // settings
 const unsigned int SCR_WIDTH = 1024;
 const unsigned int SCR_HEIGHT = 768;
-const unsigned int SHADOW_SIZE = 16384;
-const unsigned int POINT_SHADOW_SIZE = 256;
+const unsigned int SHADOW_SIZE = 4096; // cascade atlas, 2x2 cascades of 2048
+const float NEAR_PLANE = 0.1f;
+const float FAR_PLANE = 200.0f;
 
 // camera
 Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
@@ -36,28 +57,194 @@ float lastFrame = 0.0f;
 //glm::vec3 lightSourcePos = glm::vec3(0.5f, 0.0f, 2.0f);
 
 float SpotLightInnerCutOff = 10.0f, SpotLightOuterCutOff = 12.5f;
-const int NR_POINT_LIGHTS = 1;
 
 glm::vec3 lightPos = glm::vec3(-1.0f, 15.0f, 3.0f);
 
-int main() {
+// deferred point lights are shaded through their light volumes instead of a full-screen pass (toggle with L)
+bool useLightVolumes = true;
+// the full-screen path reads the lights through a buffer texture, off when it would be over the GL limit
+bool fullScreenLightsFit = true;
+// G-Buffer layout, compact rebuilds position from depth and packs normals into RG16 (toggle with G)
+bool compactGBuffer = true;
+bool gBufferLayoutChanged = false;
+// swing the sun around the scene, which invalidates the cached shadow cascades every frame (toggle with O)
+bool animateSun = false;
+// directional shadow filtering, PCF, VSM or ESM (cycle with V)
+ShadowFilter shadowFilter = SHADOW_FILTER_PCF;
+// bloom through the downsample/upsample chain, or the full resolution Gaussian ping-pong (toggle with B)
+bool mipChainBloom = true;
+// render the G-Buffer and lighting at a scale chosen from the GPU frame time (toggle with R)
+bool dynamicResolutionEnabled = true;
+// lay down depth first so the G-Buffer pass only shades visible pixels (toggle with P)
+bool depthPrepass = true;
+// drop the meshes hidden behind the largest occluders before the G-Buffer pass (toggle with C)
+bool occlusionCulling = true;
+// cull on the GPU and submit each pass with multi-draw indirect, needs GL 4.3 (toggle with I)
+bool indirectDraws = true;
+// the window's framebuffer, the internal targets are upscaled to it
+unsigned int windowWidth = SCR_WIDTH, windowHeight = SCR_HEIGHT;
+// render a fixed number of frames offscreen without a display, time them and exit (--headless)
+bool headless = false;
+// print the per-pass CPU/GPU profile every second (toggle with T)
+bool profilerSummary = false;
+
+// terminates GLFW when main returns, declared before the GL objects so their destructors still have a context
+struct GLFWSession {
+	~GLFWSession() { glfwTerminate(); }
+};
+
+int main(int argc, char** argv) {
+	//COMMAND LINE
+	bool bvhBenchmark = false; //time the scene BVH and exit
+	bool software = false; //rasterize the G-Buffer on the CPU without a GL context, for hosts without a GPU
+	unsigned int benchmarkFrames = 300; //frames a headless run renders, a replay renders its whole path
+	std::string capturePath; //the last headless frame, .exr for the HDR lighting target, otherwise a .png of the output
+	std::string timingsPath; //per-frame CSV of a headless run or a replay
+	std::string recordPath, replayPath; //camera path written on exit, or flown through on a fixed timestep
+	std::string tracePath; //Chrome trace of every profiled scope, written on exit
+	std::string glStatsPath; //per-frame GL call counts, debug builds only
+	unsigned int extraLights = 0; //animated point lights scattered through the scene on top of the torches
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--bvh-benchmark")
+			bvhBenchmark = true;
+		else if (arg == "--software")
+			software = true;
+		else if (arg == "--headless")
+			headless = true;
+		else if (arg == "--frames" && i + 1 < argc)
+			benchmarkFrames = std::max(1, atoi(argv[++i]));
+		else if (arg == "--capture" && i + 1 < argc)
+			capturePath = argv[++i];
+		else if (arg == "--timings" && i + 1 < argc)
+			timingsPath = argv[++i];
+		else if (arg == "--record" && i + 1 < argc)
+			recordPath = argv[++i];
+		else if (arg == "--replay" && i + 1 < argc)
+			replayPath = argv[++i];
+		else if (arg == "--trace" && i + 1 < argc)
+			tracePath = argv[++i];
+		else if (arg == "--gl-stats" && i + 1 < argc)
+			glStatsPath = argv[++i];
+		else if (arg == "--lights" && i + 1 < argc)
+			extraLights = std::max(0, atoi(argv[++i]));
+		else if (arg == "--vram-budget" && i + 1 < argc)
+			GpuMemory::BudgetBytes() = (unsigned long long)std::max(1, atoi(argv[++i])) << 20; //MB before the GPU memory warning
+	}
+
+	//CAMERA PATH
+	CameraPath cameraPath;
+	bool replaying = !replayPath.empty();
+	if (replaying) {
+		if (!cameraPath.Load(replayPath)) {
+			std::cout << "FAILED TO LOAD CAMERA PATH " << replayPath << std::endl;
+			return -1;
+		}
+		benchmarkFrames = cameraPath.Frames();
+	}
+	//headless runs and replays step a fixed clock for a set number of frames and report their timings
+	bool benchmark = headless || replaying;
+
+	//SOFTWARE RENDERER
+	//runs like a headless benchmark, but the G-Buffer of every frame is rasterized on all the cores
+	if (software) {
+		Model sponza("Sponza-Master/sponza.obj", false, false);
+		JobSystem softwareJobs(std::max(2u, std::thread::hardware_concurrency()) - 1);
+		SoftwareRasterizer rasterizer(softwareJobs);
+		rasterizer.LoadTextures(sponza);
+		SoftwareGBuffer softwareGBuffer;
+		softwareGBuffer.Resize(SCR_WIDTH, SCR_HEIGHT);
+		std::cout << "Software rasterizer: " << softwareJobs.Workers() + 1 << " threads, " << SCR_WIDTH << "x" << SCR_HEIGHT << std::endl;
+
+		glm::mat4 model = glm::scale(glm::mat4(1.0f), glm::vec3(0.005f, 0.005f, 0.005f));
+		float aspect = (float)SCR_WIDTH / (float)SCR_HEIGHT;
+		FrameTimings softwareTimings(false);
+		unsigned long long triangles = 0;
+		for (unsigned int frame = 0; frame < benchmarkFrames; frame++) {
+			if (replaying)
+				cameraPath.Apply(frame * CAMERA_PATH_STEP, camera);
+			softwareTimings.BeginFrame();
+			rasterizer.Render(sponza, model, camera.GetViewMatrix(), camera.GetProjectionMatrix(aspect, NEAR_PLANE, FAR_PLANE), softwareGBuffer);
+			softwareTimings.EndFrame();
+			triangles += rasterizer.TrianglesDrawn;
+		}
+		std::cout << "Triangles per frame: " << triangles / benchmarkFrames << ", meshes in the last frame: " << rasterizer.MeshesDrawn << std::endl;
+		softwareTimings.Report(std::cout);
+		softwareTimings.Histogram(std::cout);
+		if (!timingsPath.empty() && !softwareTimings.WriteCSV(timingsPath))
+			std::cout << "FAILED TO WRITE " << timingsPath << std::endl;
+
+		//the last frame lit by the sun alone, .exr as linear floats, otherwise a gamma encoded .png
+		if (!capturePath.empty()) {
+			std::vector<float> shaded;
+			rasterizer.Shade(softwareGBuffer, glm::normalize(glm::vec3(0.0f, 0.0f, 0.0f) - lightPos), shaded);
+			bool written;
+			if (capturePath.size() > 4 && capturePath.compare(capturePath.size() - 4, 4, ".exr") == 0) {
+				written = ImageWriter::WriteEXR(capturePath, SCR_WIDTH, SCR_HEIGHT, shaded);
+			}
+			else {
+				std::vector<unsigned char> pixels(shaded.size());
+				for (size_t i = 0; i < shaded.size(); i++)
+					pixels[i] = (unsigned char)(std::pow(std::min(std::max(shaded[i], 0.0f), 1.0f), i % 4 == 3 ? 1.0f : 1.0f / SOFT_GAMMA) * 255.0f + 0.5f);
+				written = ImageWriter::WritePNG(capturePath, SCR_WIDTH, SCR_HEIGHT, pixels);
+			}
+			std::cout << (written ? "Captured " : "FAILED TO WRITE ") << capturePath << std::endl;
+		}
+		return 0;
+	}
+
 	//INITIALIZING GLFW
+#ifdef GLFW_PLATFORM_NULL
+	//a headless run needs no display, GLFW's null platform creates the context through EGL or OSMesa
+	if (headless)
+		glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+	if (!glfwInit() && headless) {
+		glfwInitHint(GLFW_PLATFORM, GLFW_ANY_PLATFORM);
+		glfwInit();
+	}
+#else
 	glfwInit();
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+#endif
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 	glfwWindowHint(GLFW_SAMPLES, 4);
+	if (headless)
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	//GL 4.3 for the indirect draws, or the 3.3 path without them
+	auto createWindow = []() {
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+		GLFWwindow* created = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Tutorial", NULL, NULL);
+		if (created == NULL) {
+			glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+			glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+			created = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Tutorial", NULL, NULL);
+		}
+		return created;
+	};
 
-	GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Tutorial", NULL, NULL);
+	GLFWwindow* window = createWindow();
+#ifdef GLFW_OSMESA_CONTEXT_API
+	//without a native context, surfaceless EGL (a GPU driver or Mesa's llvmpipe), then OSMesa
+	if (window == NULL && headless) {
+		glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+		window = createWindow();
+	}
+	if (window == NULL && headless) {
+		glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+		window = createWindow();
+	}
+#endif
 	if (window == NULL) {
 		std::cout << "FAILED TO CREATE WINDOW\n";
 		glfwTerminate();
 		return -1;
 	}
+	GLFWSession glfwSession;
 	glfwMakeContextCurrent(window);
 	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 	glfwSetCursorPosCallback(window, mouse_callback);
 	glfwSetScrollCallback(window, scroll_callback);
+	glfwSetKeyCallback(window, key_callback);
 
 	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
 	{
@@ -65,7 +252,8 @@ int main() {
 		return -1;
 	}
 
-	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+	if (!headless)
+		glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
 	//SHADER INITIALISATION
 	//Shader LightingShader("objectShader.vs", "FinalObjectShader.fs", parameter.c_str());
@@ -77,12 +265,29 @@ int main() {
 	Shader BackgroundShader("back.vs", "back.fs");
 	Shader PPShader("PP.vs", "PP.fs");
 	Shader BloomShader("PP.vs", "GaussianBlur.fs");
+	Shader BloomThresholdShader("PP.vs", "BloomThreshold.fs");
+	Shader BloomDownsampleShader("PP.vs", "BloomDownsample.fs");
+	Shader BloomUpsampleShader("PP.vs", "BloomUpsample.fs");
 	Shader SimpleDepthShader("SimpleDepthShader.vs", "SimpleDepthShader.fs");
+	Shader ShadowMomentsShader("PP.vs", "ShadowMoments.fs");
+	Shader ShadowBlurShader("PP.vs", "ShadowBlur.fs");
 	Shader SkyBoxShader("SkyBox.vs", "SkyBox.fs");
 	Shader ReflectionShader("Reflection.vs", "Refraction.fs");
-	Shader PointDepthShader("PointDepthShader.vs", "PointDepthShader.fs", "PointDepthShader.gs");
+	Shader PointDepthShader("PointDepthShader.vs", "PointDepthShader.fs");
 	Shader GBufferShader("G-Buffer.vs", "G-Buffer.fs");
+	//cutout meshes get their own variant so only they lose early depth testing to discard
+	std::vector<std::string> alphaTestDefines = { "ALPHA_TEST" };
+	Shader GBufferAlphaShader("G-Buffer.vs", "G-Buffer.fs", NULL, alphaTestDefines);
+	Shader DepthPrepassShader("DepthPrepass.vs", "DepthPrepass.fs");
+	Shader DepthPrepassAlphaShader("DepthPrepass.vs", "DepthPrepass.fs", NULL, alphaTestDefines);
 	Shader DeferredLighting("PP.vs", "DeferredLighting.fs");
+	Shader LightVolumeShader("LightVolume.vs", "LightVolume.fs");
+	//same passes for the compact G-Buffer layout
+	std::vector<std::string> compactDefines = { "COMPACT_GBUFFER" };
+	Shader GBufferCompactShader("G-Buffer.vs", "G-Buffer.fs", NULL, compactDefines);
+	Shader GBufferCompactAlphaShader("G-Buffer.vs", "G-Buffer.fs", NULL, { "COMPACT_GBUFFER", "ALPHA_TEST" });
+	Shader DeferredLightingCompact("PP.vs", "DeferredLighting.fs", NULL, compactDefines);
+	Shader LightVolumeCompactShader("LightVolume.vs", "LightVolume.fs", NULL, compactDefines);
 
 	unsigned int backTex = LoadTexture("get.png", "textures");
 	unsigned int floorTex = LoadTexture("brickwall.jpg", "textures");
@@ -156,26 +361,9 @@ int main() {
 		1.0f,  1.0f,  1.0f, 1.0f
 	};
 
-	glm::vec3 pointLightPositions[] = {
-		glm::vec3(5.6f,  0.6f, -2.25f),
-		glm::vec3(5.6f,  0.6f, 2.25f),
-		glm::vec3(-5.6f,  0.6f, -2.25f),
-		glm::vec3(-5.6f,  0.6f, 2.25f),
-		glm::vec3(2.44f,  -0.6f,  -1.1f),
-		glm::vec3(2.44f,  0.6f,  1.1f),
-		glm::vec3(-2.44f,  0.6f,  -1.1f),
-		glm::vec3(-2.44f,  0.6f,  1.1f)
-	};
-
-	glm::vec3 pointLightColors[] = {
-	glm::vec3(1.0f, 1.0f, 1.0f),
-	glm::vec3(0.3f, 0.3f, 0.7f),
-	glm::vec3(0.0f, 0.0f, 0.3f),
-	glm::vec3(0.4f, 0.4f, 0.4f)
-	};
-
 	
 	//VAOs, VBOs for in scene objects 
+	GpuMemory::Category() = GPU_MEMORY_GEOMETRY;
 	unsigned int VBO, backgroundVBO, lightVAO, backgroundVAO;
 	glGenVertexArrays(1, &lightVAO);
 	glGenVertexArrays(1, &backgroundVAO);
@@ -248,129 +436,90 @@ int main() {
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	glBindVertexArray(0);
+	GpuMemory::Category() = GPU_MEMORY_OTHER;
 
-	//FrameBuffer for point light depth map
-	unsigned int depthCubeFBO, depthCubeMap[NR_POINT_LIGHTS];
-	glGenTextures(NR_POINT_LIGHTS, depthCubeMap);
-	for (int j = 0; j < NR_POINT_LIGHTS; j++) {
-		glBindTexture(GL_TEXTURE_CUBE_MAP, depthCubeMap[j]);
-		for (unsigned int i = 0; i < 6; i++) {
-			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_DEPTH_COMPONENT,
-				POINT_SHADOW_SIZE, POINT_SHADOW_SIZE, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-		}
-
-		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	//RENDER GRAPH
+	//every frame is declared as passes over transient targets, which are allocated lazily and aliased when their lifetimes don't overlap
+	RenderGraph renderGraph;
 
-	}
-	
-	glGenFramebuffers(1, &depthCubeFBO);
-	glBindFramebuffer(GL_FRAMEBUFFER, depthCubeFBO);
-	//glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthCubeMap[0], 0);
-	glDrawBuffer(GL_NONE);
-	glReadBuffer(GL_NONE);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-	//FRAMEBUFFERS FOR ANTI_ALIASING 
-	unsigned int ColorFrameBuffer, TexColorBuffer[2], Colorrbo; //MultiSample Anti-Aliasing
-	//createFrameBuffer(&MSAAFrameBuffer, &MSAATexColorBuffer, &MSAArbo, GL_RGB16F, true);
-	glGenFramebuffers(1, &ColorFrameBuffer);
-	glGenTextures(2, TexColorBuffer);
-	glBindFramebuffer(GL_FRAMEBUFFER, ColorFrameBuffer);
-	for (int i = 0; i < 2; i++) {
-		glBindTexture(GL_TEXTURE_2D, TexColorBuffer[i]);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, TexColorBuffer[i], 0);
-	}
-	glGenRenderbuffers(1, &Colorrbo);
-	glBindRenderbuffer(GL_RENDERBUFFER, Colorrbo);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, SCR_WIDTH, SCR_HEIGHT);
-	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, Colorrbo);
-	// tell OpenGL which color attachments we'll use (of this framebuffer) for rendering 
-	unsigned int Bloomattachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
-	glDrawBuffers(2, Bloomattachments);
-	// finally check if framebuffer is complete
-	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-		std::cout << "Framebuffer not complete!" << std::endl;
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-	unsigned int PingPongFBO[2], PingPongBuffer[2];
-	glGenFramebuffers(2, PingPongFBO);
-	glGenTextures(2, PingPongBuffer);
-	for (unsigned int i = 0; i < 2; i++) {
-
-		glBindFramebuffer(GL_FRAMEBUFFER, PingPongFBO[i]);
-		glBindTexture(GL_TEXTURE_2D, PingPongBuffer[i]);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, PingPongBuffer[i], 0);
-	}
+	//BLOOM MIP CHAIN
+	Bloom bloom;
+	GpuTimer bloomTimer;
+	bool timedMipChainBloom = mipChainBloom;
+	float lastBloomReport = 0.0f;
 
 	//G-BUFFER
-	unsigned int gBuffer;
-	glGenFramebuffers(1, &gBuffer);
-	glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
-	unsigned int gPosition, gNormal, gColorSpec;
-
-	// - Position Color Buffer
-	glGenTextures(1, &gPosition);
-	glBindTexture(GL_TEXTURE_2D, gPosition);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gPosition, 0);
-
-	// - Normal Color Buffer
-	glGenTextures(1, &gNormal);
-	glBindTexture(GL_TEXTURE_2D, gNormal);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, gNormal, 0);
-
-	// - Color + Specular Color Buffer
-	glGenTextures(1, &gColorSpec);
-	glBindTexture(GL_TEXTURE_2D, gColorSpec);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, gColorSpec, 0);
-
-	unsigned int attachments[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
-	glDrawBuffers(3, attachments);
-
-	unsigned int gRBO;
-	glGenRenderbuffers(1, &gRBO);
-	glBindRenderbuffer(GL_RENDERBUFFER, gRBO);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, SCR_WIDTH, SCR_HEIGHT);
-	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, gRBO);
-	
-// finally check if framebuffer is complete
-	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-		std::cout << "Framebuffer not complete!" << std::endl;
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GBuffer gBuffer;
 
-	//FRAMEBUFFER FOR POST-PROCESSING
-	unsigned int PPFrameBuffer, PPTexColorBuffer, PPrbo; //Post Processing
-	createFrameBuffer(&PPFrameBuffer, &PPTexColorBuffer, &PPrbo, GL_RGB16F, false);
+	//DYNAMIC RESOLUTION
+	DynamicResolution dynamicResolution;
 
-	//SETTING UP FRAMEBUFFER FOR DEPTH MAP GENERATION
-	unsigned int DepthMapFrameBuffer, depthMap;
-	createFrameBuffer(&DepthMapFrameBuffer, &depthMap, "DEPTH");
+	//POINT LIGHTS
+	//eight flickering torches, the only lights with point shadows, and any number of animated lights on top
+	const unsigned int NR_LIGHTS = 8;
+	const float torchLinear = 0.7f, torchQuadratic = 1.8f;
+	glm::vec3 torchPositions[NR_LIGHTS] = {
+		glm::vec3(2.44, 0.6, -1.1),
+		glm::vec3(2.44, 0.6, 1.1),
+		glm::vec3(-2.44, 0.6, -1.1),
+		glm::vec3(-2.44, 0.6, 1.1),
+		glm::vec3(5.6, 0.6, -2.25),
+		glm::vec3(5.6, 0.6, 2.25),
+		glm::vec3(-5.6, 0.6, -2.25),
+		glm::vec3(-5.6, 0.6, 2.25)
+	};
+	LightSystem lightSystem;
+	LightAnimation torch;
+	torch.Flags = LIGHT_FLICKER;
+	for (unsigned int i = 0; i < NR_LIGHTS; i++)
+		lightSystem.Add(torchPositions[i], glm::vec3(1.0f, 0.0f, 0.0f), torchLinear, torchQuadratic, torch, i);
+	unsigned int placement = 13;
+	for (unsigned int i = 0; i < extraLights; i++) {
+		glm::vec3 position(LightSystem::Random(placement) * 18.0f - 9.0f, LightSystem::Random(placement) * 5.8f + 0.2f, LightSystem::Random(placement) * 8.0f - 4.0f);
+		glm::vec3 color(LightSystem::Random(placement), LightSystem::Random(placement), LightSystem::Random(placement));
+		LightAnimation animation;
+		animation.Flags = (i % 3 == 0) ? LIGHT_ORBIT : (i % 3 == 1) ? LIGHT_PULSE : LIGHT_FLICKER;
+		animation.OrbitRadius = 0.3f + 0.7f * LightSystem::Random(placement);
+		animation.OrbitSpeed = 0.5f + 1.5f * LightSystem::Random(placement);
+		animation.PulseAmount = 0.5f;
+		animation.PulseSpeed = 1.0f + 3.0f * LightSystem::Random(placement);
+		animation.Phase = 6.2831853f * LightSystem::Random(placement);
+		//small and quickly attenuated, so thousands of them don't cover the screen
+		lightSystem.Add(position, glm::vec3(0.2f) + 0.8f * color, 1.4f, 12.0f, animation);
+	}
+	std::cout << "Point lights: " << lightSystem.Size() << std::endl;
+
+	//PER-FRAME DYNAMIC DATA
+	//suballocated from a persistently mapped ring, fenced so a frame never overwrites data the GPU still reads
+	RingBuffer frameData(RING_FRAME_SIZE + lightSystem.Size() * sizeof(LightInstance));
+	GLint textureBufferLimit;
+	fullScreenLightsFit = LightSystem::LightDataFits(frameData, textureBufferLimit);
+	if (!fullScreenLightsFit) {
+		std::cout << "Point lights: " << frameData.Capacity() / sizeof(glm::vec4) << " light data texels are over GL_MAX_TEXTURE_BUFFER_SIZE ("
+			<< textureBufferLimit << "), only light volumes are available" << std::endl;
+		useLightVolumes = true;
+	}
+
+	//LIGHT VOLUMES FOR THE DEFERRED POINT LIGHTS
+	//the lights of a frame are uploaded once, the volumes read them as instances and the full-screen pass as a buffer texture
+	LightVolume lightVolume;
+	RingBuffer::Allocation lightUpload;
+	unsigned int uploadedLights = 0;
+	//samples-passed queries count the pixels the point lights actually shade, read back a frame late so we never stall
+	unsigned int shadedPixelQuery[2], queriedLights[2] = { 0, 0 };
+	glGenQueries(2, shadedPixelQuery);
+	unsigned long long shadedPixels = 0, fullScreenPixels = 0;
+	unsigned int countedFrames = 0;
+	float lastPixelReport = 0.0f;
+	unsigned int frameIndex = 0;
+
+	//CASCADED SHADOW MAP FOR THE DIRECTIONAL LIGHT
+	CascadedShadowMap cascadedShadowMap(SHADOW_SIZE);
 
 	PPShader.use();
 	PPShader.setInt("screenTexture", 0);
+	PPShader.setInt("bloomTexture", 1);
+	PPShader.setFloat("bloomStrength", 0.5f);
 
 	glEnable(GL_DEPTH_TEST);
 	//glEnable(GL_MULTISAMPLE);
@@ -382,162 +531,518 @@ int main() {
 	//Model myModel("backpack/backpack.obj");
 	Model myModel("Sponza-Master/sponza.obj");
 	glm::vec3 size = glm::vec3(0.005f, 0.005f, 0.005f);
+	std::cout << "Meshes: " << myModel.meshes.size() << ", alpha tested: " << myModel.AlphaTestedMeshes() << std::endl;
 
-	glDepthFunc(GL_LEQUAL);
-
-
-	const unsigned int NR_LIGHTS = 8;
-	glm::vec3 lightPositions[8] = {
-		glm::vec3(2.44, 0.6, -1.1),
-		glm::vec3(2.44, 0.6, 1.1),
-		glm::vec3(-2.44, 0.6, -1.1),
-		glm::vec3(-2.44, 0.6, 1.1),
-		glm::vec3(5.6, 0.6, -2.25),
-		glm::vec3(5.6, 0.6, 2.25),
-		glm::vec3(-5.6, 0.6, -2.25),
-		glm::vec3(-5.6, 0.6, 2.25)
-	};
-	glm::vec3 lightColors[8] = {
-		glm::vec3(1.0, 0.0, 0.0),
-		glm::vec3(1.0, 0.0, 0.0),
-		glm::vec3(1.0, 0.0, 0.0),
-		glm::vec3(1.0, 0.0, 0.0),
-		glm::vec3(1.0, 0.0, 0.0),
-		glm::vec3(1.0, 0.0, 0.0),
-		glm::vec3(1.0, 0.0, 0.0),
-		glm::vec3(1.0, 0.0, 0.0)
-	};
-
-	//FIRST LIGHTING PASS 
-	//GENERATE DIRECTIONAL DEPTH MAP
-
-	float near_plane = 0.1f, far_plane = 20.0f;
-	glm::mat4 lightProjection = glm::ortho(-20.0f, 20.0f, -20.0f, 20.0f, near_plane, far_plane);
-	glm::mat4 lightView = glm::lookAt(lightPos,
-		glm::vec3(0.0f, 0.0f, 0.0f),
-		glm::vec3(0.0f, 1.0f, 0.0f));
-	glm::mat4 lightSpaceMatrix = lightProjection * lightView;
-
-	SimpleDepthShader.use();
-	SimpleDepthShader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
-
-	glViewport(0, 0, SHADOW_SIZE, SHADOW_SIZE);
-	glBindFramebuffer(GL_FRAMEBUFFER, DepthMapFrameBuffer);
-	glClear(GL_DEPTH_BUFFER_BIT);
-	//glEnable(GL_CULL_FACE);
-	//glCullFace(GL_FRONT);
+	if (bvhBenchmark) {
+		RunBVHBenchmark(myModel, glm::scale(glm::mat4(1.0f), size));
+		return 0;
+	}
 
-	glm::mat4 lightmodel = glm::mat4(1.0f);
-	lightmodel = glm::translate(lightmodel, glm::vec3(0.0f, 0.0f, 0.0f)); // translate it down so it's at the center of the scene
-	lightmodel = glm::scale(lightmodel, size);
-	SimpleDepthShader.setMat4("model", lightmodel);
-	myModel.Draw(SimpleDepthShader);
+	//GPU-DRIVEN DRAWS
+	//the merged buffers and per-mesh commands are built once, the per-mesh draws stay the 3.3 fallback
+	std::unique_ptr<Shader> IndirectCullShader;
+	std::unique_ptr<IndirectDraw> indirectDraw;
+	if (IndirectDraw::Supported()) {
+		IndirectCullShader.reset(new Shader("IndirectCull.cs"));
+		indirectDraw.reset(new IndirectDraw(myModel.meshes, *IndirectCullShader));
+		myModel.Indirect = indirectDraw.get();
+	}
+	else
+		std::cout << "Indirect draws: need GL 4.3, drawing mesh by mesh" << std::endl;
+	GpuMemory::Report(std::cout);
 
-	glDisable(GL_CULL_FACE);
+	glDepthFunc(GL_LEQUAL);
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-	srand(13);
+	//Sponza never moves, so it only goes into the cached static shadow layer
+	std::vector<ShadowCaster> staticCasters = { { &myModel, glm::scale(glm::mat4(1.0f), size) } };
+	std::vector<ShadowCaster> dynamicCasters;
+	unsigned int shadowCascadesRendered = 0, pointShadowFacesRendered = 0;
+	unsigned int cameraMeshesDrawn = 0;
+
+	//CPU OCCLUSION CULLING FOR THE CAMERA
+	OcclusionCuller occlusionCuller;
+
+	//JOB SYSTEM
+	//culling and light setup for a frame run on the workers while this thread records the shadow passes
+	JobSystem jobs;
+	JobCounter frameJobs;
+	DrawList cameraDrawList;
+	std::cout << "Job system: " << jobs.Workers() << " workers" << std::endl;
+
+	//POINT LIGHT SHADOW ATLAS
+	//the torches flicker but never move, so their shadows are sized for full brightness and rendered once
+	PointShadowAtlas pointShadowAtlas(NR_LIGHTS);
+	std::vector<PointShadowLight> pointShadowLights;
+	for (unsigned int i = 0; i < NR_LIGHTS; i++)
+		pointShadowLights.push_back({ lightSystem.Position(i), CalculateLightRadius(glm::vec3(1.0f), torchLinear, torchQuadratic) });
+	float lastShadowReport = 0.0f;
+
+	//PROFILER
+	//the passes below and every render graph pass, on the CPU and the GPU
+	Profiler profiler;
+	profiler.Tracing = !tracePath.empty();
+	float lastProfileReport = 0.0f;
+
+	//GL CALL STATISTICS
+	//counted in debug builds, where GLStats.h wraps the glad entry points
+#ifdef GL_STATS
+	GLStatsLog glStatsLog;
+#else
+	if (!glStatsPath.empty())
+		std::cout << "GL stats: compiled out of release builds, not writing " << glStatsPath << std::endl;
+#endif
+
+	//BENCHMARK RUNS
+	FrameTimings frameTimings;
+	unsigned int framesRendered = 0;
+	if (benchmark) {
+		//every frame at the window's resolution so runs compare
+		dynamicResolutionEnabled = false;
+		std::cout << (replaying ? "Replay: " : "Headless: ") << benchmarkFrames << " frames at " << windowWidth << "x" << windowHeight
+			<< " on " << (const char*)glGetString(GL_RENDERER) << std::endl;
+	}
 
 	//RENDER LOOP
 	while (!glfwWindowShouldClose(window)) {
 
 	    // per-frame time logic
 	   // --------------------
-		float currentFrame = glfwGetTime();
+		//a benchmark run steps a fixed 60 Hz clock, so every run animates the same frames
+		float currentFrame = benchmark ? framesRendered * CAMERA_PATH_STEP : (float)glfwGetTime();
 		deltaTime = currentFrame - lastFrame;
 		lastFrame = currentFrame;
+#ifdef GL_STATS
+		glStatsLog.BeginFrame();
+#endif
 				
 		processInput(window);
-
-		//pointLightPositions[0].x = 2.0 * sin(glfwGetTime());
-		//pointLightPositions[0].z = 2.0 * cos(glfwGetTime());
-
-		//lightSourcePos = glm::vec3(1.414*(float)sin(glfwGetTime()), 0.0f, 1.414*(float)cos(glfwGetTime()));
-		for (unsigned int i = 0; i < 8; i++) {
-			float x = (rand() % 100) / 100.0;
-			if (x > 0.9) {
-				float change = ((rand() % 100) / 100.0);
-				if (change < 0.5 && lightColors[i].r > 0.9)
-					lightColors[i].r -= change;
-				else if (change < 0.5 && lightColors[i].r < 0.9)
-					lightColors[i].r += change;
-			}
+		if (replaying)
+			cameraPath.Apply(currentFrame, camera);
+		else if (!recordPath.empty())
+			cameraPath.Record(currentFrame, camera);
+
+		dynamicResolution.Enabled = dynamicResolutionEnabled;
+		if (dynamicResolution.Update())
+			std::cout << "Dynamic resolution: " << (int)(dynamicResolution.Scale * 100.0f + 0.5f) << "% (GPU frame "
+				<< dynamicResolution.LastFrameMs << " ms, budget " << dynamicResolution.BudgetMs << " ms)" << std::endl;
+		unsigned int renderWidth = dynamicResolution.Size(windowWidth);
+		unsigned int renderHeight = dynamicResolution.Size(windowHeight);
+		float aspect = (float)std::max(windowWidth, 1u) / (float)std::max(windowHeight, 1u);
+
+		renderGraph.Reset();
+		gBuffer.Declare(renderGraph, renderWidth, renderHeight, compactGBuffer);
+		if (gBufferLayoutChanged) {
+			gBufferLayoutChanged = false;
+			std::cout << "G-Buffer layout: " << (compactGBuffer ? "compact" : "classic") << " ("
+				<< gBuffer.BytesPerPixel() << " bytes/pixel)" << std::endl;
 		}
+		Shader& GBufferPass = gBuffer.Compact ? GBufferCompactShader : GBufferShader;
+		Shader& GBufferAlphaPass = gBuffer.Compact ? GBufferCompactAlphaShader : GBufferAlphaShader;
+		Shader& DeferredPass = gBuffer.Compact ? DeferredLightingCompact : DeferredLighting;
+		Shader& LightVolumePass = gBuffer.Compact ? LightVolumeCompactShader : LightVolumeShader;
 
 		// render
        // ------
-		glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
-		glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
-
-		glClearColor(1.0f, 0.1f, 0.1f, 1.0f);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		glEnable(GL_DEPTH_TEST);
-		GBufferShader.use();
 		glm::mat4 model = glm::mat4(1.0f);
 		model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f)); // translate it down so it's at the center of the scene
 		model = glm::scale(model, size);
-		glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 200.0f);
+		glm::mat4 projection = camera.GetProjectionMatrix(aspect, NEAR_PLANE, FAR_PLANE);
 		glm::mat4 view = camera.GetViewMatrix();
-		GBufferShader.setMat4("projection", projection);
-		GBufferShader.setMat4("view", view);
-		GBufferShader.setMat4("model", model);
-		myModel.Draw(GBufferShader); 
 
-		
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
-		glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
-		glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
-
-		DeferredLighting.use();
-		DeferredLighting.setInt("gPosition", 0);
-		DeferredLighting.setInt("gNormal", 1);
-		DeferredLighting.setInt("gAlbedoSpec", 2);
-
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, gPosition);
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, gNormal);
-		glActiveTexture(GL_TEXTURE2);
-		glBindTexture(GL_TEXTURE_2D, gColorSpec);
-
-		for (unsigned int i = 0; i < 8; i++)
-		{
-			DeferredLighting.setVec3("lights[" + std::to_string(i) + "].Position", lightPositions[i]);
-			DeferredLighting.setVec3("lights[" + std::to_string(i) + "].Color", lightColors[i]);
-			// update attenuation parameters and calculate radius
-			const float linear = 0.7;
-			const float quadratic = 1.8;
-			DeferredLighting.setFloat("lights[" + std::to_string(i) + "].Linear", linear);
-			DeferredLighting.setFloat("lights[" + std::to_string(i) + "].Quadratic", quadratic);
+		if (animateSun)
+			lightPos = glm::vec3(glm::rotate(glm::mat4(1.0f), 0.2f * deltaTime, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::vec4(lightPos, 1.0f));
+		//the directional light looks from lightPos towards the centre of the scene
+		glm::vec3 lightDir = glm::normalize(glm::vec3(0.0f, 0.0f, 0.0f) - lightPos);
+
+		//FRAME JOBS
+		//the bounds are refreshed here first, after that the jobs and the shadow passes only read them
+		myModel.IndirectEnabled = indirectDraws;
+		myModel.UpdateBounds(model);
+		Frustum cameraFrustum = camera.GetFrustum(aspect, NEAR_PLANE, FAR_PLANE);
+		glm::mat4 viewProjection = projection * view;
+		jobs.Run([&]() {
+			//flicker, orbit and pulse the lights and refresh their radii
+			lightSystem.Animate(currentFrame);
+		}, frameJobs);
+		//CPU CULLING, the frustum through the BVH, then whatever the big occluders hide, then the draw order
+		//(the indirect path culls the frustum on the GPU in the geometry pass, and only takes the occlusion results from here)
+		if (!myModel.DrawsIndirect() || occlusionCulling) {
+			jobs.Run([&]() {
+				myModel.Cull(cameraFrustum, cameraDrawList);
+				if (occlusionCulling)
+					occlusionCuller.Cull(myModel, model, viewProjection, cameraDrawList, jobs);
+				if (!myModel.DrawsIndirect())
+					myModel.Sort(cameraDrawList);
+			}, frameJobs);
+		}
+
+		//FIRST LIGHTING PASS
+		//GENERATE DIRECTIONAL DEPTH MAP, only the cascades whose light matrix changed are re-rendered
+		dynamicResolution.BeginFrame();
+		if (benchmark)
+			frameTimings.BeginFrame();
+		profiler.Enabled = profilerSummary || profiler.Tracing;
+		profiler.BeginFrame();
+		profiler.Begin("frame");
+		frameData.BeginFrame();
+		glEnable(GL_DEPTH_TEST);
+		profiler.Begin("shadow cascades");
+		cascadedShadowMap.Update(camera, aspect, NEAR_PLANE, FAR_PLANE, lightDir);
+		if (cascadedShadowMap.Filter != shadowFilter)
+			cascadedShadowMap.SetFilter(shadowFilter);
+		cascadedShadowMap.Render(staticCasters, dynamicCasters, SimpleDepthShader);
+		cascadedShadowMap.Prefilter(ShadowMomentsShader, ShadowBlurShader, quadVAO);
+		shadowCascadesRendered += cascadedShadowMap.CascadesRendered;
+		profiler.End();
+
+		//POINT LIGHT DEPTH MAPS, only the most important stale faces within the per-frame budget
+		profiler.Begin("point shadows");
+		pointShadowAtlas.Update(pointShadowLights, projection * view, camera.Position, std::tan(glm::radians(camera.Zoom) * 0.5f));
+		pointShadowAtlas.Render(staticCasters, PointDepthShader);
+		pointShadowFacesRendered += pointShadowAtlas.FacesRendered;
+		profiler.End();
+
+		//the passes below read the lights and the draw list
+		profiler.Begin("wait for jobs");
+		jobs.Wait(frameJobs);
+		profiler.End();
+		lightUpload = lightSystem.Upload(frameData, uploadedLights);
+		cameraMeshesDrawn = cameraDrawList.MeshesDrawn;
+
+		if (currentFrame - lastShadowReport > 1.0f) {
+			std::cout << "Shadow cascades re-rendered/second: " << shadowCascadesRendered
+				<< ", point shadow faces: " << pointShadowFacesRendered << std::endl;
+			if (myModel.DrawsIndirect())
+				std::cout << "Meshes culled on the GPU: " << indirectDraw->Commands() << " commands, " << indirectDraw->Batches()
+					<< " material batches" << std::endl;
+			else
+				std::cout << "Meshes drawn after culling: camera " << cameraMeshesDrawn << "/" << myModel.meshes.size()
+					<< ", shadow cascades " << cascadedShadowMap.MeshesDrawn << ", point shadows " << pointShadowAtlas.MeshesDrawn << std::endl;
+			if (occlusionCulling)
+				std::cout << "Occlusion culling: " << occlusionCuller.MeshesOccluded << " meshes occluded by " << occlusionCuller.OccludersDrawn
+					<< " occluders (" << occlusionCuller.TrianglesRasterized << " triangles)" << std::endl;
+			GLState::Report(std::cout);
+			GLState::Reset();
+			if (frameData.Stalls > 0) {
+				std::cout << "Ring buffer: waited on the GPU in " << frameData.Stalls << " frames" << std::endl;
+				frameData.Stalls = 0;
+			}
+			shadowCascadesRendered = pointShadowFacesRendered = 0;
+			lastShadowReport = currentFrame;
+		}
+
+		RGTextureDesc hdrDesc = { renderWidth, renderHeight, GL_RGBA16F, GL_RGBA, GL_FLOAT, GL_LINEAR };
+		RenderGraph::Resource lighting = renderGraph.CreateTexture("lighting", hdrDesc);
+
+		//GEOMETRY PASS
+		renderGraph.AddPass("geometry", {}, gBuffer.Targets(), [&]() {
+			glEnable(GL_DEPTH_TEST);
+			glClearColor(1.0f, 0.1f, 0.1f, 1.0f);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			Shader* passes[4] = { &GBufferPass, &GBufferAlphaPass, &DepthPrepassShader, &DepthPrepassAlphaShader };
+			for (unsigned int i = 0; i < 4; i++) {
+				passes[i]->use();
+				passes[i]->setMat4("projection", projection);
+				passes[i]->setMat4("view", view);
+				passes[i]->setMat4("model", model);
+			}
+			if (myModel.DrawsIndirect()) {
+				//one multi-draw per depth only pass, one per material where textures are bound
+				myModel.Indirect->Cull(cameraFrustum, occlusionCulling ? &cameraDrawList.Visible : NULL);
+				if (depthPrepass) {
+					glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+					DepthPrepassShader.use();
+					myModel.Indirect->DrawGeometry(INDIRECT_OPAQUE);
+					DepthPrepassAlphaShader.use();
+					myModel.Indirect->Draw(DepthPrepassAlphaShader, INDIRECT_ALPHA_TESTED);
+					glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+					glDepthFunc(GL_EQUAL);
+					glDepthMask(GL_FALSE);
+					GBufferPass.use();
+					myModel.Indirect->Draw(GBufferPass);
+					glDepthMask(GL_TRUE);
+					glDepthFunc(GL_LEQUAL);
+				}
+				else {
+					GBufferPass.use();
+					myModel.Indirect->Draw(GBufferPass, INDIRECT_OPAQUE);
+					GBufferAlphaPass.use();
+					myModel.Indirect->Draw(GBufferAlphaPass, INDIRECT_ALPHA_TESTED);
+				}
+			}
+			else if (depthPrepass) {
+				//DEPTH PREPASS, opaque meshes without their textures, then the cutouts
+				glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+				DepthPrepassShader.use();
+				myModel.DrawGeometry(cameraDrawList.Opaque);
+				DepthPrepassAlphaShader.use();
+				myModel.Draw(DepthPrepassAlphaShader, cameraDrawList.AlphaTested);
+				glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+				//only the visible texel of each pixel matches the depth, so even the cutouts can skip discard
+				glDepthFunc(GL_EQUAL);
+				glDepthMask(GL_FALSE);
+				GBufferPass.use();
+				myModel.Draw(GBufferPass, cameraDrawList.Opaque);
+				myModel.Draw(GBufferPass, cameraDrawList.AlphaTested);
+				glDepthMask(GL_TRUE);
+				glDepthFunc(GL_LEQUAL);
+			}
+			else {
+				//opaque first, they fill the depth buffer with early depth testing on and hide more of the cutouts
+				GBufferPass.use();
+				myModel.Draw(GBufferPass, cameraDrawList.Opaque);
+				GBufferAlphaPass.use();
+				myModel.Draw(GBufferAlphaPass, cameraDrawList.AlphaTested);
+			}
+		});
+		glm::mat4 invViewProjection = glm::inverse(viewProjection);
+
+		//DEFERRED LIGHTING PASS
+		//the light accumulation target shares the G-Buffer's depth (a copy of it when compact, which samples it)
+		//so the light volumes can be depth tested against the scene
+		RenderGraph::Resource lightingDepth = gBuffer.LightingDepth(renderGraph);
+		std::vector<RenderGraph::Resource> deferredReads = gBuffer.Inputs();
+		deferredReads.push_back(lightingDepth);
+		renderGraph.AddPass("deferred lighting", deferredReads, { lighting, lightingDepth }, [&]() {
+			glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+
+			DeferredPass.use();
+			gBuffer.BindTextures(renderGraph, DeferredPass);
+			DeferredPass.setMat4("invViewProjection", invViewProjection);
+
+			//only clear the colour, the depth is the G-Buffer's
+			glClear(GL_COLOR_BUFFER_BIT);
+
+			lightSystem.BindLightData(frameData, 6);
+			DeferredPass.setInt("lightData", 6);
+			DeferredPass.setInt("lightOffset", lightUpload.Offset / sizeof(glm::vec4));
+			DeferredPass.setInt("lightCount", uploadedLights);
+			DeferredPass.setVec3("viewPos", camera.Position);
+			DeferredPass.setBool("lightVolumes", useLightVolumes);
+
+			cascadedShadowMap.SetUniforms(DeferredPass, 3, 5);
+			pointShadowAtlas.SetUniforms(DeferredPass, 4);
+			DeferredPass.setMat4("view", view);
+			DeferredPass.setVec3("dirlight.direction", lightDir);
+			DeferredPass.setVec3("light.ambient", glm::vec3(0.1f, 0.1f, 0.1f));
+			DeferredPass.setVec3("light.diffuse", glm::vec3(1.0f, 1.0f, 1.0f));
+			DeferredPass.setFloat("far_plane", SHADOW_DISTANCE);
+
+			glBindVertexArray(quadVAO);
+			glDisable(GL_DEPTH_TEST);
+			glDrawArrays(GL_TRIANGLES, 0, 6);
+		});
+
+		//POINT LIGHTS THROUGH LIGHT VOLUMES
+		//only the back faces of each sphere that lie behind the scene pass the depth test, which bounds the
+		//shaded pixels to the ones inside a light's radius (and still works when the camera is inside it)
+		if (useLightVolumes) {
+			std::vector<RenderGraph::Resource> volumeReads = deferredReads;
+			volumeReads.push_back(lighting); //blended onto
+			renderGraph.AddPass("light volumes", volumeReads, { lighting, lightingDepth }, [&]() {
+				lightVolume.Update(lightUpload, uploadedLights, frameData);
+
+				LightVolumePass.use();
+				gBuffer.BindTextures(renderGraph, LightVolumePass);
+				LightVolumePass.setMat4("invViewProjection", invViewProjection);
+				LightVolumePass.setMat4("projection", projection);
+				LightVolumePass.setMat4("view", view);
+				LightVolumePass.setVec3("viewPos", camera.Position);
+				LightVolumePass.setVec2("screenSize", (float)renderWidth, (float)renderHeight);
+				pointShadowAtlas.SetUniforms(LightVolumePass, 4);
+
+				glEnable(GL_DEPTH_TEST);
+				glDepthFunc(GL_GEQUAL);
+				glDepthMask(GL_FALSE);
+				glEnable(GL_CULL_FACE);
+				glCullFace(GL_FRONT);
+				glEnable(GL_BLEND);
+				glBlendFunc(GL_ONE, GL_ONE);
+
+				queriedLights[frameIndex % 2] = uploadedLights;
+				glBeginQuery(GL_SAMPLES_PASSED, shadedPixelQuery[frameIndex % 2]);
+				lightVolume.Draw();
+				glEndQuery(GL_SAMPLES_PASSED);
+
+				glDisable(GL_BLEND);
+				glCullFace(GL_BACK);
+				glDisable(GL_CULL_FACE);
+				glDepthMask(GL_TRUE);
+				glDepthFunc(GL_LEQUAL);
+
+				//last frame's count, if the GPU is done with it
+				if (frameIndex > 0) {
+					GLint available = 0;
+					glGetQueryObjectiv(shadedPixelQuery[(frameIndex + 1) % 2], GL_QUERY_RESULT_AVAILABLE, &available);
+					if (available) {
+						GLuint64 samples = 0;
+						glGetQueryObjectui64v(shadedPixelQuery[(frameIndex + 1) % 2], GL_QUERY_RESULT, &samples);
+						shadedPixels += samples;
+						fullScreenPixels += (unsigned long long)renderWidth * renderHeight * queriedLights[(frameIndex + 1) % 2];
+						countedFrames++;
+					}
+				}
+				frameIndex++;
+			});
+		}
+
+		//BLOOM
+		if (timedMipChainBloom != mipChainBloom) {
+			bloomTimer.Reset();
+			timedMipChainBloom = mipChainBloom;
+		}
+		renderGraph.AddPass("bloom timer begin", {}, {}, [&]() { bloomTimer.Begin(); }, true);
+		RenderGraph::Resource bloomResult;
+		if (mipChainBloom) {
+			bloomResult = bloom.AddPasses(renderGraph, lighting, renderWidth, renderHeight, BloomDownsampleShader, BloomUpsampleShader, quadVAO);
 		}
-		DeferredLighting.setVec3("viewPos", camera.Position);
-
-		DeferredLighting.setMat4("lightSpaceMatrix", lightSpaceMatrix);
-		DeferredLighting.setInt("shadowMap", 3);
-		glActiveTexture(GL_TEXTURE3);
-		glBindTexture(GL_TEXTURE_2D, depthMap);
-		DeferredLighting.setVec3("light.position", lightPos);
-		DeferredLighting.setVec3("light.ambient", glm::vec3(0.1f, 0.1f, 0.1f));
-		DeferredLighting.setVec3("light.diffuse", glm::vec3(1.0f, 1.0f, 1.0f));
-		DeferredLighting.setFloat("far_plane", far_plane);
-
-		//PPShader.use();
-		//PPShader.setInt("screenTexture", 0);
-		//PPShader.setInt("bloomTexture", 1);
-		//PPShader.setFloat("exposure", 0.5);
-		glBindVertexArray(quadVAO);
-		//glDisable(GL_DEPTH_TEST);
-		//glActiveTexture(GL_TEXTURE0);
-		//glBindTexture(GL_TEXTURE_2D, gPosition);
-		glDrawArrays(GL_TRIANGLES, 0, 6);
-
-		glfwSwapBuffers(window);
+		else {
+			//bright pass, then 10 full resolution 9-tap blurs alternating direction, the graph folds them into two textures
+			bloomResult = renderGraph.CreateTexture("bloomBright", hdrDesc);
+			renderGraph.AddPass("bloom threshold", { lighting }, { bloomResult }, [&, lighting]() {
+				BloomThresholdShader.use();
+				BloomThresholdShader.setInt("image", 0);
+				BloomThresholdShader.setFloat("threshold", BLOOM_THRESHOLD);
+				glActiveTexture(GL_TEXTURE0);
+				glBindTexture(GL_TEXTURE_2D, renderGraph.GetTexture(lighting));
+				glBindVertexArray(quadVAO);
+				glDrawArrays(GL_TRIANGLES, 0, 6);
+			});
+			for (unsigned int i = 0; i < 10; i++) {
+				bool horizontal = i % 2 == 0;
+				RenderGraph::Resource source = bloomResult;
+				bloomResult = renderGraph.CreateTexture("bloomBlur" + std::to_string(i), hdrDesc);
+				renderGraph.AddPass("bloom blur " + std::to_string(i), { source }, { bloomResult }, [&, source, horizontal]() {
+					BloomShader.use();
+					BloomShader.setInt("image", 0);
+					BloomShader.setBool("horizontal", horizontal);
+					glActiveTexture(GL_TEXTURE0);
+					glBindTexture(GL_TEXTURE_2D, renderGraph.GetTexture(source));
+					glBindVertexArray(quadVAO);
+					glDrawArrays(GL_TRIANGLES, 0, 6);
+				});
+			}
+		}
+		renderGraph.AddPass("bloom timer end", {}, {}, [&]() { bloomTimer.End(); }, true);
+
+		//PRESENT THE LIT IMAGE
+		//drawn at the window size, the bilinear lookups upscale the internal resolution targets
+		//(a headless run has no default framebuffer to show, it presents into a texture instead)
+		std::vector<RenderGraph::Resource> presentTargets;
+		RenderGraph::Resource output;
+		if (headless) {
+			RGTextureDesc outputDesc = { windowWidth, windowHeight, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, GL_LINEAR };
+			output = renderGraph.CreateTexture("output", outputDesc);
+			presentTargets.push_back(output);
+		}
+		renderGraph.AddPass("upscale + present", { lighting, bloomResult }, presentTargets, [&, lighting, bloomResult]() {
+			glViewport(0, 0, windowWidth, windowHeight);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			PPShader.use();
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, renderGraph.GetTexture(lighting));
+			glActiveTexture(GL_TEXTURE1);
+			glBindTexture(GL_TEXTURE_2D, renderGraph.GetTexture(bloomResult));
+			glActiveTexture(GL_TEXTURE0);
+			glBindVertexArray(quadVAO);
+			glDrawArrays(GL_TRIANGLES, 0, 6);
+		}, true);
+
+		//CAPTURE THE LAST HEADLESS FRAME
+		if (headless && !capturePath.empty() && framesRendered + 1 == benchmarkFrames) {
+			bool hdr = capturePath.size() > 4 && capturePath.compare(capturePath.size() - 4, 4, ".exr") == 0;
+			renderGraph.AddPass("capture", { lighting, output }, {}, [&, lighting, output, hdr]() {
+				unsigned int width = hdr ? renderWidth : windowWidth, height = hdr ? renderHeight : windowHeight;
+				glActiveTexture(GL_TEXTURE0);
+				glBindTexture(GL_TEXTURE_2D, renderGraph.GetTexture(hdr ? lighting : output));
+				glPixelStorei(GL_PACK_ALIGNMENT, 1);
+				bool written;
+				if (hdr) {
+					std::vector<float> pixels((size_t)width * height * 4);
+					glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, &pixels[0]);
+					written = ImageWriter::WriteEXR(capturePath, width, height, pixels);
+				}
+				else {
+					std::vector<unsigned char> pixels((size_t)width * height * 4);
+					glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+					written = ImageWriter::WritePNG(capturePath, width, height, pixels);
+				}
+				std::cout << (written ? "Captured " : "FAILED TO WRITE ") << capturePath << std::endl;
+			}, true);
+		}
+
+		renderGraph.Compile();
+		glDisable(GL_DEPTH_TEST);
+		renderGraph.Execute(&profiler);
+		glEnable(GL_DEPTH_TEST);
+		frameData.EndFrame();
+		profiler.End();
+		profiler.EndFrame();
+#ifdef GL_STATS
+		glStatsLog.EndFrame();
+#endif
+		dynamicResolution.EndFrame();
+		if (benchmark) {
+			frameTimings.EndFrame();
+			if (++framesRendered == benchmarkFrames)
+				glfwSetWindowShouldClose(window, true);
+		}
+
+		if (countedFrames > 0 && currentFrame - lastPixelReport > 1.0f) {
+			std::cout << "Point light shaded pixels/frame: " << shadedPixels / countedFrames
+				<< " (full-screen: " << fullScreenPixels / countedFrames << ", "
+				<< 100.0 * shadedPixels / fullScreenPixels << "%)" << std::endl;
+			shadedPixels = fullScreenPixels = 0;
+			countedFrames = 0;
+			lastPixelReport = currentFrame;
+		}
+		if (profilerSummary && currentFrame - lastProfileReport > 1.0f) {
+			profiler.Report(std::cout);
+			lastProfileReport = currentFrame;
+		}
+		if (currentFrame - lastBloomReport > 1.0f && bloomTimer.Samples() > 0) {
+			std::cout << "Bloom GPU time (" << (mipChainBloom ? "mip chain" : "full resolution Gaussian") << "): "
+				<< bloomTimer.AverageMs() << " ms" << std::endl;
+			bloomTimer.Reset();
+			lastBloomReport = currentFrame;
+		}
+
+		//nothing to swap to without a display
+		if (!headless)
+			glfwSwapBuffers(window);
 		glfwPollEvents();
 	}
 
-	glfwTerminate();
+	if (benchmark) {
+		glFinish();
+		frameTimings.Finish();
+		frameTimings.Report(std::cout);
+		frameTimings.Histogram(std::cout);
+		if (!timingsPath.empty() && !frameTimings.WriteCSV(timingsPath))
+			std::cout << "FAILED TO WRITE " << timingsPath << std::endl;
+	}
+#ifdef GL_STATS
+	glStatsLog.Summary(std::cout);
+	if (!glStatsPath.empty() && !glStatsLog.WriteCSV(glStatsPath))
+		std::cout << "FAILED TO WRITE " << glStatsPath << std::endl;
+#endif
+	GpuMemory::Report(std::cout);
+	if (profiler.Tracing) {
+		if (profiler.WriteTrace(tracePath))
+			std::cout << "Wrote profiler trace to " << tracePath << " (" << profiler.FramesDropped << " frames dropped)" << std::endl;
+		else
+			std::cout << "FAILED TO WRITE " << tracePath << std::endl;
+	}
+	if (!recordPath.empty() && !replaying) {
+		if (cameraPath.Save(recordPath))
+			std::cout << "Recorded " << cameraPath.Keys.size() << " camera keys (" << cameraPath.Duration() << " s) to " << recordPath << std::endl;
+		else
+			std::cout << "FAILED TO WRITE " << recordPath << std::endl;
+	}
+
 	return 0;
 }
 
@@ -569,9 +1074,58 @@ void processInput(GLFWwindow* window) {
 		}
 }
 
+//TOGGLES, ONCE PER KEY PRESS
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+	if (action != GLFW_PRESS)
+		return;
+	if (key == GLFW_KEY_L) {
+		useLightVolumes = !useLightVolumes || !fullScreenLightsFit;
+		std::cout << "Point lights: " << (useLightVolumes ? "light volumes" : "full-screen") << std::endl;
+	}
+	if (key == GLFW_KEY_G) {
+		compactGBuffer = !compactGBuffer;
+		gBufferLayoutChanged = true;
+	}
+	if (key == GLFW_KEY_O)
+		animateSun = !animateSun;
+	if (key == GLFW_KEY_B) {
+		mipChainBloom = !mipChainBloom;
+		std::cout << "Bloom: " << (mipChainBloom ? "mip chain" : "full resolution Gaussian") << std::endl;
+	}
+	if (key == GLFW_KEY_P) {
+		depthPrepass = !depthPrepass;
+		std::cout << "Depth prepass: " << (depthPrepass ? "on" : "off") << std::endl;
+	}
+	if (key == GLFW_KEY_C) {
+		occlusionCulling = !occlusionCulling;
+		std::cout << "Occlusion culling: " << (occlusionCulling ? "on" : "off") << std::endl;
+	}
+	if (key == GLFW_KEY_R) {
+		dynamicResolutionEnabled = !dynamicResolutionEnabled;
+		std::cout << "Dynamic resolution: " << (dynamicResolutionEnabled ? "on" : "off") << std::endl;
+	}
+	if (key == GLFW_KEY_I) {
+		indirectDraws = !indirectDraws;
+		std::cout << "Indirect draws: " << (indirectDraws ? "on" : "off") << std::endl;
+	}
+	if (key == GLFW_KEY_T) {
+		profilerSummary = !profilerSummary;
+		std::cout << "Profiler summary: " << (profilerSummary ? "on" : "off") << std::endl;
+	}
+	if (key == GLFW_KEY_M)
+		GpuMemory::Report(std::cout);
+	if (key == GLFW_KEY_V) {
+		shadowFilter = (ShadowFilter)((shadowFilter + 1) % 3);
+		std::cout << "Shadow filter: " << SHADOW_FILTER_NAMES[shadowFilter] << std::endl;
+	}
+}
+
 //CALLBACK FOR ADJUSTING SIZE OF WINDOW
 void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
 	glViewport(0, 0, width, height);
+	//the render graph targets follow on the next frame
+	windowWidth = width;
+	windowHeight = height;
 }
 
 void mouse_callback(GLFWwindow* window, double Xpos, double Ypos) {
@@ -597,6 +1151,7 @@ void scroll_callback(GLFWwindow* window, double Xoffset, double Yoffset) {
 
 unsigned int LoadTexture(const char* path, const string& directory)
 {
+	GpuMemoryScope tag(GPU_MEMORY_MATERIAL);
 	string filename = string(path);
 	bool isDiffuse = (filename == "diffuse.jpg") ? true : false;
 	filename = directory + '/' + filename;
@@ -643,91 +1198,8 @@ unsigned int LoadTexture(const char* path, const string& directory)
 	return textureID;
 }
 
-void createFrameBuffer(unsigned int* fbo, unsigned int* texColorBuffer, unsigned int* rbo, GLint Format, bool MultiSample) {
-	glGenFramebuffers(1, fbo);
-	glBindFramebuffer(GL_FRAMEBUFFER, *fbo);
-
-	glGenTextures(1, texColorBuffer);
-	if (MultiSample)
-		glBindTexture(GL_TEXTURE_2D, *texColorBuffer);
-	else
-		glBindTexture(GL_TEXTURE_2D, *texColorBuffer);
-
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-
-	if (Format == GL_DEPTH_COMPONENT) {
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, SHADOW_SIZE, SHADOW_SIZE, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, *texColorBuffer, 0);
-		glDrawBuffer(GL_NONE);
-		glReadBuffer(GL_NONE);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-		float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
-		glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-	}
-	else if (Format == GL_RGB16F || Format == GL_SRGB) {
-		glTexImage2D(GL_TEXTURE_2D, 0, Format, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGB, GL_FLOAT, NULL);
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, *texColorBuffer, 0);
-	}
-	else {
-		glTexImage2D(GL_TEXTURE_2D, 0, Format, SCR_WIDTH, SCR_HEIGHT, 0, Format, GL_UNSIGNED_BYTE, NULL);
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, *texColorBuffer, 0);
-	}
-
-	glGenRenderbuffers(1, rbo);
-	glBindRenderbuffer(GL_RENDERBUFFER, *rbo);
-	if (MultiSample)
-		glRenderbufferStorageMultisample(GL_RENDERBUFFER, 4, GL_DEPTH24_STENCIL8, SCR_WIDTH, SCR_HEIGHT);
-	else
-		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, SCR_WIDTH, SCR_HEIGHT);
-
-	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, *rbo);
-
-	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-		std::cout << "ERROR::FRAMEBUFFER::Framebuffer is not complete" << std::endl;
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	glBindTexture(GL_TEXTURE_2D, 0);
-	glBindRenderbuffer(GL_RENDERBUFFER, 0);
-
-}
-
-void createFrameBuffer(unsigned int* fbo, unsigned int* texColorBuffer, const char* format) {
-	glGenFramebuffers(1, fbo);
-	glBindFramebuffer(GL_FRAMEBUFFER, *fbo);
-
-	glGenTextures(1, texColorBuffer);
-	glBindTexture(GL_TEXTURE_2D, *texColorBuffer);
-
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-
-	if (format == "RGB") {
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, *texColorBuffer, 0);
-	}
-	else if (format == "DEPTH") {
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, SHADOW_SIZE, SHADOW_SIZE, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, *texColorBuffer, 0);
-		glDrawBuffer(GL_NONE);
-		glReadBuffer(GL_NONE);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-		float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
-		glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-	}
-
-	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-		std::cout << "ERROR::FRAMEBUFFER::Framebuffer is not complete" << std::endl;
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	glBindTexture(GL_TEXTURE_2D, 0);
-}
-
 unsigned int loadCubeMap(vector<std::string> texture_faces) {
+	GpuMemoryScope tag(GPU_MEMORY_MATERIAL);
 	unsigned int textureID;
 	glGenTextures(1, &textureID);
 	glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);